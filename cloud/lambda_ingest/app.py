@@ -2,11 +2,13 @@ import base64
 import json
 import os
 import time
+from collections import deque
 from datetime import datetime, timezone
 from decimal import Decimal
-from typing import Any, Dict, List, Tuple
+from typing import Any, Deque, Dict, List, Tuple
 
 import boto3
+from botocore.exceptions import ClientError
 
 STORAGE_BACKEND = os.getenv("STORAGE_BACKEND", "dynamodb").strip().lower()
 API_TOKEN = os.getenv("API_TOKEN", "")
@@ -17,21 +19,103 @@ TS_TABLE_EVT = os.getenv("TS_TABLE_EVENTS", "events")
 
 DDB_TABLE_TELE = os.getenv("DDB_TABLE_TELEMETRY", "telemetry")
 DDB_TABLE_EVT = os.getenv("DDB_TABLE_EVENTS", "events")
+# Per-run upload progress; defaults to the telemetry table in dynamodb mode
+DDB_TABLE_PROGRESS = os.getenv("DDB_TABLE_PROGRESS", "")
 
 _ts_client = boto3.client("timestream-write")
 _ddb = boto3.resource("dynamodb")
 
 TTL_SECONDS = 365 * 24 * 60 * 60
 
+# Backpressure hints returned to devices in a trailing "ctl" object
+WRITE_CAPACITY_PER_S = float(os.getenv("WRITE_CAPACITY_PER_S", "25"))
+CTL_MAX_BATCH = int(os.getenv("CTL_MAX_BATCH", "4"))
+CTL_TICK_MS_MIN = int(os.getenv("CTL_TICK_MS_MIN", "1000"))
+CTL_TICK_MS_MAX = int(os.getenv("CTL_TICK_MS_MAX", "30000"))
+CTL_RETRY_AFTER_S = int(os.getenv("CTL_RETRY_AFTER_S", "10"))
+CTL_WINDOW_S = 10.0
+THROTTLE_CODES = {"ProvisionedThroughputExceededException", "ThrottlingException", "RequestLimitExceeded"}
+DDB_BATCH = 25
+DDB_UNPROCESSED_TRIES = 4
+
+# Utilization is per container: _consumed holds the write capacity units DynamoDB
+# reported for this container's own requests, measured against WRITE_CAPACITY_PER_S
+# as this container's share. Only throttling (an error or unprocessed items) reflects
+# the whole table. Timestream reports no capacity, so there only throttling counts.
+_consumed: Deque[Tuple[float, float]] = deque()
+_last_throttle = 0.0
+
+
+def _note_consumed(units: float) -> None:
+    now = time.time()
+    _consumed.append((now, units))
+    while _consumed and now - _consumed[0][0] > CTL_WINDOW_S:
+        _consumed.popleft()
+
+
+def _note_throttle() -> None:
+    global _last_throttle
+    _last_throttle = time.time()
+
+
+def _utilization() -> float:
+    """Full while the backend pushed back within the window, else this container's WCU over its share."""
+    now = time.time()
+    if now - _last_throttle <= CTL_WINDOW_S:
+        return 1.0
+    if WRITE_CAPACITY_PER_S <= 0:
+        return 0.0
+    units = sum(u for t, u in _consumed if now - t <= CTL_WINDOW_S)
+    return (units / CTL_WINDOW_S) / WRITE_CAPACITY_PER_S
+
+
+def _control_hints(throttled: bool = False) -> Dict[str, Any]:
+    util = 1.0 if throttled else _utilization()
+    # Full speed below 50% utilization, stretching the tick linearly up to the max at 100%
+    ramp = min(max((util - 0.5) / 0.5, 0.0), 1.0)
+    ctl = {
+        "max_batch": max(1, CTL_MAX_BATCH if ramp < 1.0 else CTL_MAX_BATCH // 2),
+        "tick_ms": int(CTL_TICK_MS_MIN + (CTL_TICK_MS_MAX - CTL_TICK_MS_MIN) * ramp),
+    }
+    if throttled:
+        ctl["retry_after_s"] = CTL_RETRY_AFTER_S
+    return ctl
+
 
-def _response(code: int, payload: Dict[str, Any]) -> Dict[str, Any]:
+def _response(code: int, payload: Dict[str, Any], headers: Dict[str, str] = None) -> Dict[str, Any]:
+    h = {"Content-Type": "application/json"}
+    if headers:
+        h.update(headers)
     return {
         "statusCode": code,
-        "headers": {"Content-Type": "application/json"},
+        "headers": h,
         "body": json.dumps(payload),
     }
 
 
+def _accepted_response(
+    accepted: int, last_key: Any, ack: Dict[str, Any] = None, acks: List[Dict[str, Any]] = None
+) -> Dict[str, Any]:
+    payload: Dict[str, Any] = {"accepted": accepted, "last_key": last_key}
+    if ack:
+        payload["ack"] = ack
+    if acks:
+        payload["acks"] = acks
+    # ack/ctl stay last so they survive in the device's short tail-of-response window
+    payload["ctl"] = _control_hints()
+    return _response(200, payload)
+
+
+def _throttled_response(exc: ClientError) -> Dict[str, Any]:
+    _note_throttle()
+    ctl = _control_hints(throttled=True)
+    return _response(
+        429,
+        {"error": exc.response.get("Error", {}).get("Code", "throttled"), "ctl": ctl},
+        {"Retry-After": str(ctl["retry_after_s"])},
+    )
+
+
 def _parse_body(event: Dict[str, Any]) -> Dict[str, Any]:
     body = event.get("body") or "{}"
     if event.get("isBase64Encoded"):
@@ -93,6 +177,21 @@ def _parse_rtc_iso_to_ms(rtc_iso: str) -> int:
         return 0
 
 
+def _record_ts_ms(r: Dict[str, Any]) -> int:
+    """Sample time of a telemetry row in epoch ms.
+
+    Prefers the device's per-row `epoch`/`ems` (sample time); rows from firmware
+    without a wall clock fall back to `ms` and then the upload-time `rtc_iso`.
+    """
+    epoch = _to_int(r.get("epoch"), 0)
+    if epoch > 0:
+        return epoch * 1000 + _to_int(r.get("ems"), 0)
+    ms = _to_int(r.get("ms"), 0)
+    if ms <= 0:
+        ms = _parse_rtc_iso_to_ms(str(r.get("rtc_iso", "")))
+    return ms
+
+
 def _ttl_from_ms(ms: int) -> int:
     base_s = int(ms / 1000) if ms > 0 else int(time.time())
     return base_s + TTL_SECONDS
@@ -101,9 +200,7 @@ def _ttl_from_ms(ms: int) -> int:
 def _telemetry_items_ddb(device_id: str, records: List[Dict[str, Any]]) -> List[Dict[str, Any]]:
     out: List[Dict[str, Any]] = []
     for r in records:
-        ms = _to_int(r.get("ms"), 0)
-        if ms <= 0:
-            ms = _parse_rtc_iso_to_ms(str(r.get("rtc_iso", "")))
+        ms = _record_ts_ms(r)
         if ms <= 0:
             continue
 
@@ -120,6 +217,7 @@ def _telemetry_items_ddb(device_id: str, records: List[Dict[str, Any]]) -> List[
                 "expires_at": _ttl_from_ms(ms),
                 "run_file": run_file,
                 "line_index": line_index,
+                "device_ms": _to_int(r.get("ms"), 0),
                 "step": step,
                 "mask": _to_int(r.get("mask"), 0),
                 "t1": _to_decimal(_to_float(r.get("t1"), 0.0)),
@@ -171,27 +269,50 @@ def _event_items_ddb(device_id: str, records: List[Dict[str, Any]]) -> List[Dict
                 "arg1": _to_int(r.get("arg1"), 0),
                 "current_step": _to_int(r.get("current_step"), 0),
                 "rtc_iso": str(r.get("rtc_iso", "")),
+                **({"detail": _ddb_detail(r["detail"])} if isinstance(r.get("detail"), dict) else {}),
             }
         )
     return out
 
 
+def _ddb_detail(detail: Dict[str, Any]) -> Dict[str, Any]:
+    return {str(k): _to_decimal(v) if isinstance(v, (int, float)) else str(v) for k, v in detail.items()}
+
+
 def _write_ddb(table_name: str, items: List[Dict[str, Any]]) -> int:
     if not items:
         return 0
-    table = _ddb.Table(table_name)
-    accepted = 0
-    with table.batch_writer(overwrite_by_pkeys=["device_id", "sk"]) as batch:
-        for item in items:
-            batch.put_item(Item=item)
-            accepted += 1
-    return accepted
+    # Last write per key wins, as batch_writer(overwrite_by_pkeys=...) did; a batch
+    # may not repeat a key
+    unique = list({(item["device_id"], item["sk"]): item for item in items}.values())
+    client = _ddb.meta.client
+    for i in range(0, len(unique), DDB_BATCH):
+        pending = [{"PutRequest": {"Item": item}} for item in unique[i : i + DDB_BATCH]]
+        for attempt in range(DDB_UNPROCESSED_TRIES):
+            resp = client.batch_write_item(RequestItems={table_name: pending}, ReturnConsumedCapacity="TOTAL")
+            _note_consumed(sum(c.get("CapacityUnits", 0.0) for c in resp.get("ConsumedCapacity", [])))
+            pending = resp.get("UnprocessedItems", {}).get(table_name, [])
+            if not pending:
+                break
+            _note_throttle()
+            time.sleep(0.05 * 2**attempt)
+        if pending:
+            # Puts are idempotent: the device re-sends the batch after Retry-After
+            raise ClientError(
+                {"Error": {"Code": "ProvisionedThroughputExceededException", "Message": f"{len(pending)} unprocessed"}},
+                "BatchWriteItem",
+            )
+    return len(items)
 
 
 def _telemetry_records_ts(device_id: str, records: List[Dict[str, Any]]) -> List[Dict[str, Any]]:
+    # The series is (device_id, run_file, step): upload-time states are measures, so a
+    # row's live and backfill copies land on the same record and the later one, with
+    # the higher version, replaces the earlier
+    version = int(time.time() * 1000)
     out: List[Dict[str, Any]] = []
     for r in records:
-        ms = _to_int(r.get("ms"), 0)
+        ms = _record_ts_ms(r)
         if ms <= 0:
             continue
         run_file = str(r.get("run_file", ""))
@@ -201,9 +322,6 @@ def _telemetry_records_ts(device_id: str, records: List[Dict[str, Any]]) -> List
             {"Name": "device_id", "Value": device_id},
             {"Name": "run_file", "Value": run_file or "unknown"},
             {"Name": "step", "Value": step or "-"},
-            {"Name": "sd_state", "Value": str(r.get("sd_state", "unknown"))},
-            {"Name": "rtc_state", "Value": str(r.get("rtc_state", "unknown"))},
-            {"Name": "run_state", "Value": str(r.get("run_state", "unknown"))},
         ]
         mv = [
             {"Name": "line_index", "Value": str(line_index), "Type": "BIGINT"},
@@ -215,6 +333,9 @@ def _telemetry_records_ts(device_id: str, records: List[Dict[str, Any]]) -> List
             {"Name": "tavg", "Value": str(_to_float(r.get("tavg"), 0.0)), "Type": "DOUBLE"},
             {"Name": "uavg", "Value": str(_to_float(r.get("uavg"), 0.0)), "Type": "DOUBLE"},
             {"Name": "rtc_iso", "Value": str(r.get("rtc_iso", "")), "Type": "VARCHAR"},
+            {"Name": "sd_state", "Value": str(r.get("sd_state", "unknown")), "Type": "VARCHAR"},
+            {"Name": "rtc_state", "Value": str(r.get("rtc_state", "unknown")), "Type": "VARCHAR"},
+            {"Name": "run_state", "Value": str(r.get("run_state", "unknown")), "Type": "VARCHAR"},
         ]
         out.append(
             {
@@ -224,7 +345,7 @@ def _telemetry_records_ts(device_id: str, records: List[Dict[str, Any]]) -> List
                 "MeasureValues": mv,
                 "Time": str(ms),
                 "TimeUnit": "MILLISECONDS",
-                "Version": line_index if line_index > 0 else 1,
+                "Version": version,
             }
         )
     return out
@@ -263,17 +384,278 @@ def _event_records_ts(device_id: str, records: List[Dict[str, Any]]) -> List[Dic
     return out
 
 
+COLUMNAR_BATCH_KEYS = ("run_file", "rtc_iso", "sd_state", "rtc_state", "run_state", "lane")
+COLUMNAR_WRAP = {"ms": 2**32}  # device millis(): a signed delta or a large first row wraps
+
+
+def _expand_columnar(body: Dict[str, Any]) -> List[Dict[str, Any]]:
+    """Expand a `col1` batch into the per-record dicts used by /telemetry/batch.
+
+    Batch-level constants are copied into every row; columns listed in `delta`
+    are cumulative sums starting from 0 (so the first row carries absolute values);
+    `ms` is summed modulo 2**32 like the device counter.
+    """
+    cols = body.get("cols") or []
+    rows = body.get("rows") or []
+    if not isinstance(cols, list) or not isinstance(rows, list):
+        raise ValueError("cols and rows must be lists")
+    delta = set(body.get("delta") or [])
+    consts = {k: body[k] for k in COLUMNAR_BATCH_KEYS if k in body}
+    running = {c: 0 for c in delta}
+    out: List[Dict[str, Any]] = []
+    for row in rows:
+        if not isinstance(row, list) or len(row) != len(cols):
+            raise ValueError("row width does not match cols")
+        rec = dict(consts)
+        for col, val in zip(cols, row):
+            if col in delta:
+                running[col] += _to_int(val, 0)
+                if col in COLUMNAR_WRAP:
+                    running[col] %= COLUMNAR_WRAP[col]
+                val = running[col]
+            rec[col] = val
+        out.append(rec)
+    return out
+
+
+ACK_SK_PREFIX = "~ack#"  # sorts after every "<ts_ms>#..." telemetry key
+ACK_AHEAD_CAP = 512  # out-of-order ranges kept per run
+ACK_UPDATE_TRIES = 5
+
+
+def _progress_table():
+    name = DDB_TABLE_PROGRESS or (DDB_TABLE_TELE if STORAGE_BACKEND == "dynamodb" else "")
+    return _ddb.Table(name) if name else None
+
+
+def _merge_ranges(ranges: List[List[int]]) -> List[List[int]]:
+    """Sort [first, last] ranges and join the ones that overlap or touch."""
+    out: List[List[int]] = []
+    for a, b in sorted(ranges):
+        if out and a <= out[-1][1] + 1:
+            out[-1][1] = max(out[-1][1], b)
+        else:
+            out.append([a, b])
+    return out
+
+
+def _load_ahead(raw: Any) -> List[List[int]]:
+    # Older items hold single line indexes instead of ranges
+    out = []
+    for x in raw or []:
+        if isinstance(x, (list, tuple)) and len(x) == 2:
+            out.append([_to_int(x[0], 0), _to_int(x[1], 0)])
+        else:
+            out.append([_to_int(x, 0)] * 2)
+    return out
+
+
+def _batch_span(body: Dict[str, Any]) -> Tuple[str, int, int]:
+    """`span: [first, last]` on a backfill batch: every line in it that is not among
+    the records is a gap or unreadable line on the device and will never come."""
+    span = body.get("span")
+    if not isinstance(span, list) or len(span) != 2:
+        return None
+    first, last = _to_int(span[0], 0), _to_int(span[1], 0)
+    run_file = str(body.get("run_file", ""))
+    if not run_file or first <= 0 or last < first:
+        return None
+    return run_file, first, last
+
+
+def _update_progress(
+    device_id: str, records: List[Dict[str, Any]], span: Tuple[str, int, int] = None
+) -> List[Dict[str, Any]]:
+    """Track the highest contiguous line_index stored per (device_id, run_file).
+
+    Out-of-order rows (live lane, retries after a gap) are kept as a capped list of
+    `ahead` ranges and folded in once the gap below them is filled. Each update is
+    conditional on the item's `rev`, so concurrent batches for one run cannot lose
+    each other's rows. Returns one ack per run in the batch, with `gap_to` (the last
+    missing line of the first gap) when rows above `contiguous` are held.
+    """
+    table = _progress_table()
+    if table is None:
+        return []
+    by_run: Dict[str, List[List[int]]] = {}
+    for r in records:
+        line_index = _to_int(r.get("line_index"), 0)
+        if line_index > 0:
+            by_run.setdefault(str(r.get("run_file", "")) or "unknown", []).append([line_index, line_index])
+    if span:
+        # The backfill run goes last, nearest the end of the response the device keeps
+        ranges = by_run.pop(span[0], [])
+        by_run[span[0]] = ranges + [[span[1], span[2]]]
+    acks: List[Dict[str, Any]] = []
+    for run_file, lines in by_run.items():
+        key = {"device_id": device_id, "sk": f"{ACK_SK_PREFIX}{run_file}"}
+        for _ in range(ACK_UPDATE_TRIES):
+            item = table.get_item(Key=key, ConsistentRead=True).get("Item") or {}
+            contiguous = _to_int(item.get("contiguous"), 0)
+            ahead = _merge_ranges(_load_ahead(item.get("ahead")) + lines)
+            while ahead and ahead[0][0] <= contiguous + 1:
+                contiguous = max(contiguous, ahead.pop(0)[1])
+            rev = _to_int(item.get("rev"), 0)
+            cond = {"ConditionExpression": "attribute_not_exists(#rev)"} if "rev" not in item else {
+                "ConditionExpression": "#rev = :rev",
+                "ExpressionAttributeValues": {":rev": rev},
+            }
+            try:
+                table.put_item(
+                    Item={
+                        **key,
+                        "run_file": run_file,
+                        "contiguous": contiguous,
+                        "ahead": ahead[:ACK_AHEAD_CAP],
+                        "rev": rev + 1,
+                        "updated_ms": int(time.time() * 1000),
+                    },
+                    ExpressionAttributeNames={"#rev": "rev"},
+                    **cond,
+                )
+            except ClientError as exc:
+                if exc.response.get("Error", {}).get("Code", "") == "ConditionalCheckFailedException":
+                    continue
+                raise
+            ack: Dict[str, Any] = {"run_file": run_file, "contiguous": contiguous}
+            if ahead:
+                ack["gap_to"] = ahead[0][0] - 1
+            acks.append(ack)
+            break
+    return acks
+
+
 def _write_ts(table: str, records: List[Dict[str, Any]]) -> int:
     if not records:
         return 0
     accepted = 0
     for i in range(0, len(records), 100):
         chunk = records[i : i + 100]
-        _ts_client.write_records(DatabaseName=TS_DB, TableName=table, Records=chunk)
+        try:
+            _ts_client.write_records(DatabaseName=TS_DB, TableName=table, Records=chunk)
+        except ClientError as exc:
+            # A newer copy already stored (ExistingVersion) is as good as this one
+            rejected = exc.response.get("RejectedRecords") or []
+            if exc.response.get("Error", {}).get("Code") != "RejectedRecordsException" or not rejected:
+                raise
+            if any("ExistingVersion" not in r for r in rejected):
+                raise
         accepted += len(chunk)
     return accepted
 
 
+def _write_telemetry(device_id: str, records: List[Dict[str, Any]]) -> Tuple[int, Any]:
+    if STORAGE_BACKEND == "dynamodb":
+        items = _telemetry_items_ddb(device_id, records)
+        accepted = _write_ddb(DDB_TABLE_TELE, items)
+        last_key = None
+        if items:
+            lk = items[-1]
+            last_key = {
+                "device_id": lk.get("device_id"),
+                "run_file": lk.get("run_file"),
+                "step": lk.get("step"),
+                "time": lk.get("ts_ms"),
+            }
+        return accepted, last_key
+    ts_records = _telemetry_records_ts(device_id, records)
+    accepted = _write_ts(TS_TABLE_TELE, ts_records)
+    last_key = None
+    if ts_records:
+        lk = ts_records[-1]
+        dims = {d["Name"]: d["Value"] for d in lk.get("Dimensions", [])}
+        last_key = {
+            "device_id": dims.get("device_id"),
+            "run_file": dims.get("run_file"),
+            "step": dims.get("step"),
+            "time": lk.get("Time"),
+        }
+    return accepted, last_key
+
+
+def _write_events(device_id: str, records: List[Dict[str, Any]]) -> Tuple[int, Any]:
+    if STORAGE_BACKEND == "dynamodb":
+        items = _event_items_ddb(device_id, records)
+        accepted = _write_ddb(DDB_TABLE_EVT, items)
+        last_key = None
+        if items:
+            lk = items[-1]
+            last_key = {
+                "device_id": lk.get("device_id"),
+                "run_file": lk.get("run_file"),
+                "event_type": lk.get("event_type"),
+                "time": lk.get("ts_ms"),
+            }
+        return accepted, last_key
+    evt_records = _event_records_ts(device_id, records)
+    accepted = _write_ts(TS_TABLE_EVT, evt_records)
+    last_key = None
+    if evt_records:
+        lk = evt_records[-1]
+        dims = {d["Name"]: d["Value"] for d in lk.get("Dimensions", [])}
+        last_key = {
+            "device_id": dims.get("device_id"),
+            "run_file": dims.get("run_file"),
+            "event_type": dims.get("event_type"),
+            "time": lk.get("Time"),
+        }
+    return accepted, last_key
+
+
+def _store_telemetry(device_id: str, records: List[Dict[str, Any]], span: Tuple[str, int, int] = None) -> Dict[str, Any]:
+    accepted, last_key = _write_telemetry(device_id, records)
+    return _accepted_response(accepted, last_key, acks=_update_progress(device_id, records, span))
+
+
+JOURNAL_EVENT_KEYS = ("seq", "type", "event_type", "ms", "epoch", "screen", "arg0", "arg1", "run_file", "current_step")
+
+
+def _split_journal(records: List[Dict[str, Any]]) -> Tuple[List[Dict[str, Any]], List[Dict[str, Any]]]:
+    """Split a `jrnl1` batch into telemetry rows and event rows.
+
+    Samples are telemetry rows as sent by /telemetry/batch. Events, step summaries,
+    health snapshots and run start/end markers go to the events table keyed by the
+    journal `seq`; fields beyond the event columns are kept in `detail`.
+    """
+    tele: List[Dict[str, Any]] = []
+    events: List[Dict[str, Any]] = []
+    now_ms = int(time.time() * 1000)
+    for r in records:
+        kind = str(r.get("type", ""))
+        if kind == "sample":
+            tele.append(r)
+            continue
+        ev = dict(r)
+        if kind == "step":
+            ev.update(event_type="step_summary", arg0=r.get("samples"), arg1=r.get("heater_pct"),
+                      current_step=r.get("step_index"))
+        elif kind == "health":
+            ev.update(event_type="health", arg0=r.get("free_min"), arg1=r.get("net_drops"))
+        elif kind == "run":
+            ev.update(event_type=f"run_{r.get('kind', '')}", arg0=r.get("lines"))
+        elif kind != "event":
+            continue
+        epoch = _to_int(r.get("epoch"), 0)
+        ev["ms"] = epoch * 1000 if epoch > 0 else now_ms
+        ev["line_index"] = _to_int(r.get("seq"), 0)
+        detail = {k: v for k, v in r.items() if k not in JOURNAL_EVENT_KEYS}
+        if kind != "event" and detail:
+            ev["detail"] = detail
+        events.append(ev)
+    return tele, events
+
+
+def _store_journal(device_id: str, records: List[Dict[str, Any]]) -> Dict[str, Any]:
+    tele, events = _split_journal(records)
+    accepted, last_key = _write_telemetry(device_id, tele) if tele else (0, None)
+    if events:
+        n, last_key = _write_events(device_id, events)
+        accepted += n
+    _update_progress(device_id, tele)
+    seqs = [_to_int(r.get("seq"), 0) for r in records]
+    return _accepted_response(accepted, last_key, {"journal_seq": max(seqs) if seqs else 0})
+
+
 def lambda_handler(event: Dict[str, Any], context: Any) -> Dict[str, Any]:
     try:
         body = _parse_body(event)
@@ -290,67 +672,31 @@ def lambda_handler(event: Dict[str, Any], context: Any) -> Dict[str, Any]:
     if not isinstance(records, list):
         return _response(400, {"error": "records must be list"})
 
+    if STORAGE_BACKEND not in ("dynamodb", "timestream"):
+        return _response(500, {"error": f"unsupported storage backend: {STORAGE_BACKEND}"})
+
     try:
+        if path.endswith("/telemetry/columnar"):
+            try:
+                records = _expand_columnar(body)
+            except ValueError as exc:
+                return _response(400, {"error": str(exc)})
+            return _store_telemetry(device_id, records, _batch_span(body))
+
         if path.endswith("/telemetry/batch"):
-            if STORAGE_BACKEND == "dynamodb":
-                items = _telemetry_items_ddb(device_id, records)
-                accepted = _write_ddb(DDB_TABLE_TELE, items)
-                last_key = None
-                if items:
-                    lk = items[-1]
-                    last_key = {
-                        "device_id": lk.get("device_id"),
-                        "run_file": lk.get("run_file"),
-                        "step": lk.get("step"),
-                        "time": lk.get("ts_ms"),
-                    }
-                return _response(200, {"accepted": accepted, "last_key": last_key})
-            if STORAGE_BACKEND == "timestream":
-                ts_records = _telemetry_records_ts(device_id, records)
-                accepted = _write_ts(TS_TABLE_TELE, ts_records)
-                last_key = None
-                if ts_records:
-                    lk = ts_records[-1]
-                    dims = {d["Name"]: d["Value"] for d in lk.get("Dimensions", [])}
-                    last_key = {
-                        "device_id": dims.get("device_id"),
-                        "run_file": dims.get("run_file"),
-                        "step": dims.get("step"),
-                        "time": lk.get("Time"),
-                    }
-                return _response(200, {"accepted": accepted, "last_key": last_key})
-            return _response(500, {"error": f"unsupported storage backend: {STORAGE_BACKEND}"})
+            return _store_telemetry(device_id, records, _batch_span(body))
 
         if path.endswith("/events/batch"):
-            if STORAGE_BACKEND == "dynamodb":
-                items = _event_items_ddb(device_id, records)
-                accepted = _write_ddb(DDB_TABLE_EVT, items)
-                last_key = None
-                if items:
-                    lk = items[-1]
-                    last_key = {
-                        "device_id": lk.get("device_id"),
-                        "run_file": lk.get("run_file"),
-                        "event_type": lk.get("event_type"),
-                        "time": lk.get("ts_ms"),
-                    }
-                return _response(200, {"accepted": accepted, "last_key": last_key})
-            if STORAGE_BACKEND == "timestream":
-                evt_records = _event_records_ts(device_id, records)
-                accepted = _write_ts(TS_TABLE_EVT, evt_records)
-                last_key = None
-                if evt_records:
-                    lk = evt_records[-1]
-                    dims = {d["Name"]: d["Value"] for d in lk.get("Dimensions", [])}
-                    last_key = {
-                        "device_id": dims.get("device_id"),
-                        "run_file": dims.get("run_file"),
-                        "event_type": dims.get("event_type"),
-                        "time": lk.get("Time"),
-                    }
-                return _response(200, {"accepted": accepted, "last_key": last_key})
-            return _response(500, {"error": f"unsupported storage backend: {STORAGE_BACKEND}"})
+            accepted, last_key = _write_events(device_id, records)
+            return _accepted_response(accepted, last_key)
+
+        if path.endswith("/journal/batch"):
+            return _store_journal(device_id, records)
 
         return _response(404, {"error": "unknown route"})
+    except ClientError as exc:
+        if exc.response.get("Error", {}).get("Code", "") in THROTTLE_CODES:
+            return _throttled_response(exc)
+        return _response(500, {"error": str(exc)})
     except Exception as exc:
         return _response(500, {"error": str(exc)})
@@ -0,0 +1,186 @@
+"""The same rows sent as /telemetry/batch and /telemetry/columnar must store the same items.
+
+  cd cloud/lambda_ingest && python -m pytest -q
+"""
+import json
+import os
+from types import SimpleNamespace
+
+import pytest
+
+os.environ.setdefault("AWS_DEFAULT_REGION", "us-east-1")
+os.environ.setdefault("API_TOKEN", "test-token")
+pytest.importorskip("boto3")
+
+import app  # noqa: E402
+
+DEVICE = "MEGA001"
+BATCH_KEYS = {"run_file": "RUN01.CSV", "rtc_iso": "2026-01-13T12:00:05Z", "sd_state": "ok",
+              "rtc_state": "ok", "run_state": "running"}
+COLS = ["line_index", "ms", "epoch", "ems", "t1", "u1", "t2", "u2", "tavg", "uavg", "mask", "step"]
+ROWS = [
+    # line_index, ms, epoch, ems, t1, u1, t2, u2, tavg, uavg, mask, step
+    [41, 123000, 1768305600, 250, 25.1, 60.2, 25.3, 59.8, 25.2, 60.0, 4, "S1"],
+    [42, 126000, 1768305603, 250, -0.5, 61.0, -0.7, 60.4, -0.6, 60.7, 5, "S1"],
+    [44, 129500, 1768305606, 750, 25.2, 60.1, 25.2, 60.1, 25.2, 60.1, 0, "S2"],
+    [45, 130000, 0, 0, 25.2, 60.1, 25.2, 60.1, 25.2, 60.1, 0, "S2"],  # clock not set
+]
+# A reset inside the run: millis() starts over, epoch keeps going
+RESUMED = [
+    [41, 4294960000, 1768305600, 250, 25.1, 60.2, 25.3, 59.8, 25.2, 60.0, 4, "S1"],
+    [42, 1500, 1768305660, 500, 25.2, 60.1, 25.2, 60.1, 25.2, 60.1, 4, "S1"],
+    [43, 4500, 0, 0, 25.2, 60.1, 25.2, 60.1, 25.2, 60.1, 4, "S1"],
+]
+
+
+def _event(path, body):
+    return {
+        "rawPath": path,
+        "headers": {"X-Api-Token": "test-token", "X-Device-Id": DEVICE},
+        "body": json.dumps(body),
+    }
+
+
+def _batch_body(src=ROWS):
+    records = [dict(BATCH_KEYS, **dict(zip(COLS, row))) for row in src]
+    return {"device_id": DEVICE, "records": records}
+
+
+def _columnar_body(src=ROWS, unsigned_ms=False):
+    """Deltas as the firmware sends them: signed, or unsigned 32-bit ms (older firmware)."""
+    delta = ["line_index", "ms", "epoch"]
+    prev = {c: 0 for c in delta}
+    rows = []
+    for row in src:
+        out = list(row)
+        for c in delta:
+            i = COLS.index(c)
+            d = row[i] - prev[c]
+            if c == "ms":
+                d %= 2**32
+                if not unsigned_ms and d >= 2**31:
+                    d -= 2**32
+            out[i], prev[c] = d, row[i]
+        rows.append(out)
+    return dict(BATCH_KEYS, device_id=DEVICE, fmt="col1", lane="sd", cols=COLS, delta=delta, rows=rows)
+
+
+@pytest.fixture
+def stored(monkeypatch):
+    """Runs a request and returns what would have been written to the telemetry table."""
+    monkeypatch.setattr(app, "API_TOKEN", "test-token")
+    monkeypatch.setattr(app, "_progress_table", lambda: None)
+    monkeypatch.setattr(app.time, "time", lambda: 1768305700.0)  # Timestream record version
+    writes = []
+    monkeypatch.setattr(app, "_write_ddb", lambda table, items: writes.extend(items) or len(items))
+    monkeypatch.setattr(app, "_write_ts", lambda table, records: writes.extend(records) or len(records))
+
+    def run(backend, path, body):
+        monkeypatch.setattr(app, "STORAGE_BACKEND", backend)
+        del writes[:]
+        resp = app.lambda_handler(_event(path, body), None)
+        assert resp["statusCode"] == 200, resp["body"]
+        assert json.loads(resp["body"])["accepted"] == len(ROWS)
+        return list(writes)
+
+    return run
+
+
+@pytest.mark.parametrize("backend", ["dynamodb", "timestream"])
+def test_columnar_stores_same_items_as_batch(stored, backend):
+    batch = stored(backend, "/v1/telemetry/batch", _batch_body())
+    columnar = stored(backend, "/v1/telemetry/columnar", _columnar_body())
+    assert len(batch) == len(ROWS)
+    assert columnar == batch
+
+
+def test_expanded_rows_match_record_builders(monkeypatch):
+    monkeypatch.setattr(app.time, "time", lambda: 1768305700.0)
+    expanded = app._expand_columnar(_columnar_body())
+    records = _batch_body()["records"]
+    assert app._telemetry_items_ddb(DEVICE, expanded) == app._telemetry_items_ddb(DEVICE, records)
+    assert app._telemetry_records_ts(DEVICE, expanded) == app._telemetry_records_ts(DEVICE, records)
+
+
+def test_timestream_backfill_replaces_live_copy(monkeypatch):
+    live = _batch_body()["records"][:1]
+    backfill = [dict(live[0], sd_state="degraded", run_state="paused", rtc_iso="2026-01-13T12:05:00Z")]
+    monkeypatch.setattr(app.time, "time", lambda: 1768305700.0)
+    (first,) = app._telemetry_records_ts(DEVICE, live)
+    monkeypatch.setattr(app.time, "time", lambda: 1768306000.0)
+    (second,) = app._telemetry_records_ts(DEVICE, backfill)
+    assert first["Dimensions"] == second["Dimensions"]
+    assert first["Time"] == second["Time"]
+    assert second["Version"] > first["Version"]
+
+
+@pytest.mark.parametrize("unsigned_ms", [False, True])
+def test_columnar_ms_going_back(unsigned_ms):
+    expanded = app._expand_columnar(_columnar_body(RESUMED, unsigned_ms))
+    assert [r["ms"] for r in expanded] == [row[1] for row in RESUMED]
+    records = _batch_body(RESUMED)["records"]
+    assert app._telemetry_items_ddb(DEVICE, expanded) == app._telemetry_items_ddb(DEVICE, records)
+
+
+def test_columnar_rejects_ragged_rows(stored):
+    body = _columnar_body()
+    body["rows"][1] = body["rows"][1][:-1]
+    resp = app.lambda_handler(_event("/v1/telemetry/columnar", body), None)
+    assert resp["statusCode"] == 400
+
+
+class _FakeClient:
+    """batch_write_item that leaves the first `unprocessed` puts of each call undone."""
+
+    def __init__(self, unprocessed=0, units=1.0):
+        self.unprocessed = unprocessed
+        self.units = units
+        self.calls = []
+
+    def batch_write_item(self, RequestItems, ReturnConsumedCapacity):
+        assert ReturnConsumedCapacity == "TOTAL"
+        (table, puts), = RequestItems.items()
+        self.calls.append(len(puts))
+        resp = {"ConsumedCapacity": [{"TableName": table, "CapacityUnits": self.units * len(puts)}]}
+        if self.unprocessed:
+            resp["UnprocessedItems"] = {table: puts[: self.unprocessed]}
+        return resp
+
+
+@pytest.fixture
+def ddb_client(monkeypatch):
+    monkeypatch.setattr(app, "_consumed", app.deque())
+    monkeypatch.setattr(app, "_last_throttle", 0.0)
+    monkeypatch.setattr(app, "WRITE_CAPACITY_PER_S", 10.0)
+    monkeypatch.setattr(app.time, "sleep", lambda s: None)
+
+    def install(client):
+        monkeypatch.setattr(app, "_ddb", SimpleNamespace(meta=SimpleNamespace(client=client)))
+        return client
+
+    return install
+
+
+def _items(n):
+    return [{"device_id": DEVICE, "sk": f"RUN01.CSV#{i:08d}"} for i in range(n)]
+
+
+def test_hints_follow_consumed_capacity(ddb_client):
+    client = ddb_client(_FakeClient(units=1.0))
+    assert app._write_ddb("telemetry", _items(30) + _items(5)) == 35
+    assert client.calls == [25, 5]  # repeated keys collapse, 25 puts per request
+    assert app._control_hints()["tick_ms"] == app.CTL_TICK_MS_MIN  # 30 WCU over 10 s: 30%
+    app._write_ddb("telemetry", _items(50))
+    assert app._utilization() == pytest.approx(0.8)  # 80 WCU over 10 s at 10 WCU/s
+    span = app.CTL_TICK_MS_MAX - app.CTL_TICK_MS_MIN
+    assert app._control_hints()["tick_ms"] == int(app.CTL_TICK_MS_MIN + span * 0.6)
+
+
+def test_unprocessed_items_throttle(ddb_client):
+    client = ddb_client(_FakeClient(unprocessed=2))
+    with pytest.raises(app.ClientError) as exc:
+        app._write_ddb("telemetry", _items(3))
+    assert len(client.calls) == app.DDB_UNPROCESSED_TRIES
+    assert exc.value.response["Error"]["Code"] in app.THROTTLE_CODES
+    ctl = app._control_hints()
+    assert ctl["tick_ms"] == app.CTL_TICK_MS_MAX and ctl["max_batch"] == max(1, app.CTL_MAX_BATCH // 2)
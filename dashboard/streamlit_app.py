@@ -192,6 +192,35 @@ def events_panel_dynamodb(device_id: str, minutes: int) -> pd.DataFrame:
     return df[[c for c in cols if c in df.columns]].sort_values("time", ascending=False)
 
 
+def reconstruct_compressed(df: pd.DataFrame, period_s: int) -> pd.DataFrame:
+    """Rebuild rows dropped by on-device swinging-door compression.
+
+    Kept rows are the corners of a piecewise-linear signal, so linear interpolation
+    per device/run recovers every dropped sample within LOG_DB_T / LOG_DB_H. A channel
+    whose deadband is 0 is not tracked by the device, so its dropped samples are only
+    interpolated.
+    Mask and step are piecewise constant and are forward-filled.
+    """
+    if df.empty or "time" not in df.columns:
+        return df
+    num_cols = [c for c in ["t1", "t2", "tavg", "u1", "u2", "uavg"] if c in df.columns]
+    hold_cols = [c for c in ["device_id", "run_file", "step", "mask"] if c in df.columns]
+    group_cols = [c for c in ["device_id", "run_file"] if c in df.columns]
+    parts = []
+    groups = df.groupby(group_cols, dropna=False) if group_cols else [(None, df)]
+    for _, g in groups:
+        g = g.dropna(subset=["time"]).drop_duplicates(subset=["time"]).set_index("time").sort_index()
+        if len(g) < 2:
+            parts.append(g.reset_index())
+            continue
+        grid = pd.date_range(g.index[0], g.index[-1], freq=f"{period_s}s")
+        r = g.reindex(g.index.union(grid))
+        r[num_cols] = r[num_cols].interpolate(method="time")
+        r[hold_cols] = r[hold_cols].ffill()
+        parts.append(r.loc[grid].rename_axis("time").reset_index())
+    return pd.concat(parts, ignore_index=True) if parts else df
+
+
 def latest_panel() -> pd.DataFrame:
     if STORAGE_BACKEND == "timestream":
         return latest_panel_timestream()
@@ -257,11 +286,14 @@ devices = sorted(latest_df["device_id"].dropna().astype(str).unique().tolist())
 sel = st.selectbox("Device", devices, index=0)
 
 hist_df = history_panel(sel, minutes)
+reconstruct = st.checkbox("Reconstruct compressed rows (linear)", value=False)
 st.subheader("Temperature / Humidity")
 if not hist_df.empty:
     if "time" in hist_df.columns:
         hist_df["time"] = pd.to_datetime(hist_df["time"], utc=True, errors="coerce")
     to_numeric_cols(hist_df, ["t1", "t2", "tavg", "u1", "u2", "uavg"])
+    if reconstruct:
+        hist_df = reconstruct_compressed(hist_df, 1)
     if "time" in hist_df.columns:
         st.line_chart(hist_df.set_index("time")[[c for c in ["t1", "t2", "tavg"] if c in hist_df.columns]], height=220)
         st.line_chart(hist_df.set_index("time")[[c for c in ["u1", "u2", "uavg"] if c in hist_df.columns]], height=220)
@@ -0,0 +1,85 @@
+#pragma once
+// HD44780 character LCD in 4-bit mode on FastPin pins (write-only, RW tied low).
+//
+// Drop-in for the LiquidCrystal calls the sketch uses: begin, clear, setCursor and
+// Print. The four data lines go out in one PinBank store per nibble, and the
+// controller's execution time is waited out before the next command instead of
+// after every nibble, so work done between two writes overlaps the LCD delay.
+
+#include <Arduino.h>
+#include "FastPin.h"
+
+template <typename Rs, typename En, typename D4, typename D5, typename D6, typename D7>
+class FastLcd : public Print {
+public:
+  static const uint16_t EXEC_US = 50;     // 37 us nominal, margin for slow RC clocks
+  static const uint16_t CLEAR_US = 2000;  // clear display / return home
+
+  void begin(uint8_t cols, uint8_t rows) {
+    Rs::output();
+    En::output();
+    Data::output();
+    Rs::low();
+    En::low();
+    rows_ = rows;
+    rowOffset_[0] = 0x00;
+    rowOffset_[1] = 0x40;
+    rowOffset_[2] = cols;
+    rowOffset_[3] = 0x40 + cols;
+    delay(50);  // power-up: Vcc above 2.7 V for 40 ms
+    // 8-bit mode three times, then 4-bit (HD44780 datasheet, fig. 24)
+    nibble(0x03);
+    delayMicroseconds(4500);
+    nibble(0x03);
+    delayMicroseconds(4500);
+    nibble(0x03);
+    delayMicroseconds(150);
+    nibble(0x02);
+    busyUs_ = EXEC_US;
+    startUs_ = micros();
+    command(rows > 1 ? 0x28 : 0x20);  // 4-bit, lines, 5x8 font
+    command(0x0C);                    // display on, no cursor
+    clear();
+    command(0x06);                    // left to right, no shift
+  }
+
+  void clear() { send(0x01, false, CLEAR_US); }
+
+  void setCursor(uint8_t col, uint8_t row) {
+    if (row >= rows_) row = rows_ - 1;
+    send(0x80 | (uint8_t)(col + rowOffset_[row & 3]), false, EXEC_US);
+  }
+
+  void command(uint8_t v) { send(v, false, EXEC_US); }
+
+  size_t write(uint8_t c) override {
+    send(c, true, EXEC_US);
+    return 1;
+  }
+  using Print::write;
+
+private:
+  typedef PinBank<D4, D5, D6, D7> Data;
+
+  // Enable high for at least 450 ns, data latched on the falling edge
+  static void nibble(uint8_t n) {
+    Data::write(n);
+    En::high();
+    delayMicroseconds(1);
+    En::low();
+  }
+
+  void send(uint8_t v, bool data, uint16_t busyUs) {
+    while ((uint16_t)((uint16_t)micros() - startUs_) < busyUs_) {}
+    Rs::set(data);
+    nibble(v >> 4);
+    nibble(v & 0x0F);
+    startUs_ = (uint16_t)micros();
+    busyUs_ = busyUs;
+  }
+
+  uint8_t rows_ = 1;
+  uint8_t rowOffset_[4] = {0x00, 0x40, 0x10, 0x50};
+  uint16_t startUs_ = 0;
+  uint16_t busyUs_ = 0;
+};
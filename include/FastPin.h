@@ -0,0 +1,163 @@
+#pragma once
+// Compile-time GPIO for pins that never change at run time.
+//
+// A pin is a type: FastPin<PIN register address, bit, active-low>. Every access
+// compiles to one or two instructions on constant addresses instead of the
+// pin-to-port table lookups behind digitalWrite()/digitalRead(). DDRx and PORTx
+// follow PINx on every AVR port. Ports above 0x3F in data space (PORTH..PORTL on
+// the Mega) have no SBI/CBI, so read-modify-writes there run with interrupts off.
+//
+// PinBank<P0, P1, ...> maps bit i of a mask onto pin Pi, honouring each pin's
+// polarity, and touches every port it spans exactly once per write or read.
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+// PIN register addresses (data space) on the ATmega2560
+enum AvrPort : uint16_t {
+  AVR_PORT_A = 0x20, AVR_PORT_B = 0x23, AVR_PORT_C = 0x26, AVR_PORT_D = 0x29,
+  AVR_PORT_E = 0x2C, AVR_PORT_F = 0x2F, AVR_PORT_G = 0x32, AVR_PORT_H = 0x100,
+  AVR_PORT_J = 0x103, AVR_PORT_K = 0x106, AVR_PORT_L = 0x109
+};
+
+template <uint16_t Reg, uint8_t Bit, bool ActiveLow = false>
+struct FastPin {
+  static_assert(Bit < 8, "FastPin bit must be 0..7");
+  static const uint16_t REG = Reg;
+  static const uint8_t MASK = 1 << Bit;
+  static const bool ACTIVE_LOW = ActiveLow;
+  static const bool BIT_OPS = Reg + 2 <= 0x3F;   // PORTx reachable by SBI/CBI
+
+  static volatile uint8_t &pinReg() { return *(volatile uint8_t *)Reg; }
+  static volatile uint8_t &ddrReg() { return *(volatile uint8_t *)(Reg + 1); }
+  static volatile uint8_t &portReg() { return *(volatile uint8_t *)(Reg + 2); }
+
+  static void output() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { ddrReg() |= MASK; }
+  }
+
+  static void inputPullup() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      ddrReg() &= (uint8_t)~MASK;
+      portReg() |= MASK;
+    }
+  }
+
+  // Raw level
+  static void high() {
+    if (BIT_OPS) portReg() |= MASK;
+    else ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { portReg() |= MASK; }
+  }
+
+  static void low() {
+    if (BIT_OPS) portReg() &= (uint8_t)~MASK;
+    else ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { portReg() &= (uint8_t)~MASK; }
+  }
+
+  static bool level() { return (pinReg() & MASK) != 0; }
+
+  // Logical state, after polarity
+  static void set(bool on) {
+    if (on != ActiveLow) high();
+    else low();
+  }
+
+  static bool active() { return level() != ActiveLow; }
+};
+
+template <typename... Pins> struct PinBank;
+
+template <>
+struct PinBank<> {
+  static constexpr bool uses(uint16_t) { return false; }
+  static constexpr uint8_t portMask(uint16_t) { return 0; }
+  static uint8_t portLevels(uint16_t, uint8_t) { return 0; }
+  static uint8_t gather(uint16_t, uint8_t) { return 0; }
+  static constexpr uint8_t idleMask(uint8_t) { return 0; }
+};
+
+template <typename P, typename... Rest>
+struct PinBank<P, Rest...> {
+  typedef PinBank<Rest...> Tail;
+
+  static constexpr bool uses(uint16_t reg) { return P::REG == reg || Tail::uses(reg); }
+
+  // Port bits owned by this bank on the port at reg
+  static constexpr uint8_t portMask(uint16_t reg) { return (P::REG == reg ? P::MASK : 0) | Tail::portMask(reg); }
+
+  // Port bits to drive high on reg for the logical mask (bit 0 = P)
+  static uint8_t portLevels(uint16_t reg, uint8_t mask) {
+    return (P::REG == reg && ((mask & 1) != 0) != P::ACTIVE_LOW ? P::MASK : 0) | Tail::portLevels(reg, mask >> 1);
+  }
+
+  // Logical bits of the pins on reg, from one PINx snapshot
+  static uint8_t gather(uint16_t reg, uint8_t pins) {
+    return (P::REG == reg && ((pins & P::MASK) != 0) != P::ACTIVE_LOW ? 1 : 0) | (uint8_t)(Tail::gather(reg, pins) << 1);
+  }
+
+  static void output();
+  static void inputPullup();
+  static void write(uint8_t mask);
+  static uint8_t read();
+};
+
+// Walks the pin list and acts once per port, at the port's last pin in the list
+template <typename Bank, typename... Pins> struct PinBankOps;
+
+template <typename Bank>
+struct PinBankOps<Bank> {
+  static void ddr(bool) {}
+  static void store(uint8_t) {}
+  static uint8_t load() { return 0; }
+};
+
+template <typename Bank, typename P, typename... Rest>
+struct PinBankOps<Bank, P, Rest...> {
+  static const bool LAST = !PinBank<Rest...>::uses(P::REG);
+  static const uint8_t M = Bank::portMask(P::REG);
+
+  static void ddr(bool out) {
+    if (LAST) {
+      if (out) {
+        P::ddrReg() |= M;
+      } else {
+        P::ddrReg() &= (uint8_t)~M;
+        P::portReg() |= M;
+      }
+    }
+    PinBankOps<Bank, Rest...>::ddr(out);
+  }
+
+  static void store(uint8_t mask) {
+    if (LAST) P::portReg() = (uint8_t)((P::portReg() & (uint8_t)~M) | Bank::portLevels(P::REG, mask));
+    PinBankOps<Bank, Rest...>::store(mask);
+  }
+
+  static uint8_t load() {
+    uint8_t bits = LAST ? Bank::gather(P::REG, P::pinReg()) : 0;
+    return bits | PinBankOps<Bank, Rest...>::load();
+  }
+};
+
+template <typename P, typename... Rest>
+void PinBank<P, Rest...>::output() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { PinBankOps<PinBank, P, Rest...>::ddr(true); }
+}
+
+template <typename P, typename... Rest>
+void PinBank<P, Rest...>::inputPullup() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { PinBankOps<PinBank, P, Rest...>::ddr(false); }
+}
+
+// All pins change inside one interrupt-free block: one store per port
+template <typename P, typename... Rest>
+void PinBank<P, Rest...>::write(uint8_t mask) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { PinBankOps<PinBank, P, Rest...>::store(mask); }
+}
+
+// Bit i set when pin i is active; one PINx read per port
+template <typename P, typename... Rest>
+uint8_t PinBank<P, Rest...>::read() {
+  return PinBankOps<PinBank, P, Rest...>::load();
+}
@@ -0,0 +1,28 @@
+#pragma once
+// 64-bit extension of a wrapping 32-bit counter such as millis() or micros().
+//
+// carry() has to see every wrap: call it with the current reading at least once per
+// counter period (the sketch does from the Timer0 compare ISR, every ~1 ms). read()
+// also counts a wrap that happened after the last carry(). On the AVR both run with
+// interrupts off. Nothing here touches hardware, so the wrap logic is unit-tested on
+// the host (test/test_mono, `pio test -e native`).
+
+#include <stdint.h>
+
+class MonoClock {
+public:
+  void carry(uint32_t now) {
+    if (now < low_) high_++;
+    low_ = now;
+  }
+
+  uint64_t read(uint32_t now) const {
+    uint32_t high = high_;
+    if (now < low_) high++;
+    return ((uint64_t)high << 32) | now;
+  }
+
+private:
+  volatile uint32_t high_ = 0;
+  volatile uint32_t low_ = 0;
+};
@@ -0,0 +1,147 @@
+#pragma once
+// Fixed-capacity single-producer/single-consumer ring buffer.
+//
+// head and tail are free-running 8-bit counters masked into the array, so the
+// capacity must be a power of two (2..128) and indexing never divides. Each index
+// is one byte written by one side only: push() from an ISR with pop() from loop()
+// (or the reverse) needs no lock. RING_DROP_OLDEST lets the producer move head as
+// well, so under that policy the operations run with interrupts off.
+
+#include <stdint.h>
+#include <util/atomic.h>
+
+enum RingPolicy : uint8_t { RING_DROP_NEWEST, RING_DROP_OLDEST };
+
+template <typename T, uint8_t N, RingPolicy P = RING_DROP_NEWEST>
+class SpscRing {
+  static_assert(N >= 2 && N <= 128 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two, 2..128");
+  static const uint8_t MASK = N - 1;
+
+public:
+  SpscRing() : head_(0), tail_(0), highWater_(0), overflows_(0) {}
+
+  static uint8_t capacity() { return N; }
+  uint8_t count() const { return (uint8_t)(tail_ - head_); }
+  bool empty() const { return tail_ == head_; }
+  bool full() const { return count() >= N; }
+  uint8_t space() const { return (uint8_t)(N - count()); }
+  uint8_t highWater() const { return highWater_; }
+  uint16_t overflows() const {
+    uint16_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { n = overflows_; }
+    return n;
+  }
+
+  // Producer. A full ring rejects the item (DROP_NEWEST, returns false) or discards
+  // its oldest item (DROP_OLDEST); either way the overflow counter goes up.
+  bool push(const T &item) {
+    if (P == RING_DROP_NEWEST) return pushOne(item);
+    bool ok;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { ok = pushOne(item); }
+    return ok;
+  }
+
+  // Producer. Returns how many items were taken; each rejected one is an overflow.
+  uint8_t pushBulk(const T *items, uint8_t n) {
+    uint8_t done = 0;
+    if (P == RING_DROP_NEWEST) {
+      for (uint8_t i = 0; i < n; i++) if (pushOne(items[i])) done++;
+      return done;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      for (uint8_t i = 0; i < n; i++) if (pushOne(items[i])) done++;
+    }
+    return done;
+  }
+
+  // Consumer.
+  bool pop(T &out) {
+    if (P == RING_DROP_NEWEST) return popOne(out);
+    bool ok;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { ok = popOne(out); }
+    return ok;
+  }
+
+  // Consumer. Returns how many items were copied out.
+  uint8_t popBulk(T *out, uint8_t maxItems) {
+    uint8_t done = 0;
+    if (P == RING_DROP_NEWEST) {
+      while (done < maxItems && popOne(out[done])) done++;
+      return done;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      while (done < maxItems && popOne(out[done])) done++;
+    }
+    return done;
+  }
+
+  // Consumer. Puts an item it just popped back at the front; fails when full.
+  bool unpop(const T &item) {
+    bool ok = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      if ((uint8_t)(tail_ - head_) < N) {
+        uint8_t h = (uint8_t)(head_ - 1);
+        buf_[h & MASK] = item;
+        head_ = h;
+        ok = true;
+      }
+    }
+    return ok;
+  }
+
+  // Consumer. i-th queued item counting from the oldest; i must be < count().
+  // Not for DROP_OLDEST rings fed from an ISR, whose producer can overwrite it.
+  const T &peek(uint8_t i = 0) const { return buf_[(uint8_t)(head_ + i) & MASK]; }
+
+  // Consumer. Discards up to n items from the front.
+  void drop(uint8_t n = 1) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      uint8_t c = (uint8_t)(tail_ - head_);
+      head_ = (uint8_t)(head_ + (n < c ? n : c));
+    }
+  }
+
+  void clear() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { head_ = tail_; }
+  }
+
+  void resetStats() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      highWater_ = count();
+      overflows_ = 0;
+    }
+  }
+
+private:
+  static void barrier() { __asm__ __volatile__("" ::: "memory"); }
+
+  bool pushOne(const T &item) {
+    uint8_t t = tail_;
+    if ((uint8_t)(t - head_) >= N) {
+      overflows_++;
+      if (P == RING_DROP_NEWEST) return false;
+      head_ = (uint8_t)(head_ + 1);
+    }
+    buf_[t & MASK] = item;
+    barrier();  // the slot is written before the consumer can see it
+    tail_ = (uint8_t)(t + 1);
+    uint8_t level = (uint8_t)(tail_ - head_);
+    if (level > highWater_) highWater_ = level;
+    return true;
+  }
+
+  bool popOne(T &out) {
+    uint8_t h = head_;
+    if (h == tail_) return false;
+    out = buf_[h & MASK];
+    barrier();  // the slot is read before the producer may reuse it
+    head_ = (uint8_t)(h + 1);
+    return true;
+  }
+
+  T buf_[N];
+  volatile uint8_t head_;
+  volatile uint8_t tail_;
+  volatile uint8_t highWater_;
+  volatile uint16_t overflows_;
+};
@@ -8,7 +8,6 @@
   - WiFi placeholder on Serial1 (not used now)
 */
 #include <Arduino.h>
-#include <LiquidCrystal.h>
 #include <SPI.h>
 #include <SD.h>
 #include <DHT.h>
@@ -19,19 +18,32 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include <avr/wdt.h>
+#include <avr/eeprom.h>
+#include "SpscRing.h"
+#include "FastPin.h"
+#include "FastLcd.h"
+#include "MonoClock.h"
 
 // ===== Pin map (Mega) =====
 // SD shield uses CS=10, SPI on ICSP
 const byte SD_CS = 10;
 
-// LCD pins (RS, E, D4, D5, D6, D7)
-LiquidCrystal lcd(30, 31, 32, 33, 34, 35);
+// Fixed pins go through FastPin (include/FastPin.h): PIN register, bit, active-low
 
-// Buttons
-const byte BTN_UP   = 22;
-const byte BTN_DOWN = 23;
-const byte BTN_OK   = 24;
-const byte BTN_BACK = 25;
+// LCD (RS, E, D4, D5, D6, D7) = D30..D35 = PC7..PC2
+FastLcd<FastPin<AVR_PORT_C, 7>, FastPin<AVR_PORT_C, 6>, FastPin<AVR_PORT_C, 5>,
+        FastPin<AVR_PORT_C, 4>, FastPin<AVR_PORT_C, 3>, FastPin<AVR_PORT_C, 2> > lcd;
+
+// Buttons D22..D25 = PA0..PA3 to GND, internal pull-ups; bit n of Buttons::read() = pressed
+typedef PinBank<FastPin<AVR_PORT_A, 0, true>, FastPin<AVR_PORT_A, 1, true>,
+                FastPin<AVR_PORT_A, 2, true>, FastPin<AVR_PORT_A, 3, true> > Buttons;
+const byte BTN_UP   = 0;
+const byte BTN_DOWN = 1;
+const byte BTN_OK   = 2;
+const byte BTN_BACK = 3;
 
 // DHT22 sensors
 const byte DHT1_PIN = 26;
@@ -42,25 +54,79 @@ const bool DHT_USE_PULLUP = false; // set true only if no external pull-up resis
 DHT dht1(DHT1_PIN, DHTTYPE);
 DHT dht2(DHT2_PIN, DHTTYPE);
 
-// Relays (bit0 lamp, bit1 fan, bit2 heater, bit3 spray)
-const byte RELAY_PINS[4] = {40, 41, 42, 43};
+// Relays (bit0 lamp, bit1 fan, bit2 heater, bit3 spray) = D40..D43 = PG1, PG0, PL7, PL6
 const bool RELAY_ACTIVE_LOW = true; // set false if your relay module is active HIGH
+typedef PinBank<FastPin<AVR_PORT_G, 1, RELAY_ACTIVE_LOW>, FastPin<AVR_PORT_G, 0, RELAY_ACTIVE_LOW>,
+                FastPin<AVR_PORT_L, 7, RELAY_ACTIVE_LOW>, FastPin<AVR_PORT_L, 6, RELAY_ACTIVE_LOW> > Relays;
 
 // ===== UI + buttons =====
-struct Btn { byte pin; bool stable; bool last; unsigned long t; };
-const unsigned long DB_MS = 30;
-Btn bU = {BTN_UP,   HIGH, HIGH, 0};
-Btn bD = {BTN_DOWN, HIGH, HIGH, 0};
-Btn bO = {BTN_OK,   HIGH, HIGH, 0};
-Btn bB = {BTN_BACK, HIGH, HIGH, 0};
-
-bool edge(Btn &b) {
-  bool r = digitalRead(b.pin);
-  if (r != b.last) { b.last = r; b.t = millis(); }
-  if (millis() - b.t > DB_MS && r != b.stable) { b.stable = r; return true; }
-  return false;
+// PA0..PA3 have no pin-change interrupt, so the Timer0 compare ISR (monotonic clock)
+// samples the buttons every BTN_SAMPLE_TICKS and debounces them there. Debounced
+// edges, long presses and auto-repeat go into btnEvents with a millis() stamp;
+// loop() only drains the queue, so presses made while it is busy in SD or DHT work
+// are handled late instead of lost.
+enum BtnEventKind : uint8_t { BTN_PRESS, BTN_RELEASE, BTN_LONG, BTN_REPEAT };
+struct BtnEvent {
+  uint8_t button;          // BTN_UP..BTN_BACK
+  uint8_t kind;            // BtnEventKind
+  uint16_t ms;             // low 16 bits of millis()
+};
+const uint8_t BTN_COUNT = 4;
+const uint8_t BTN_SAMPLE_TICKS = 4;        // ~4.1 ms between samples
+const uint8_t BTN_DEBOUNCE_SAMPLES = 7;    // ~30 ms stable before an edge counts
+const uint8_t BTN_LONG_SAMPLES = 146;      // ~600 ms held: BTN_LONG, then repeats
+const uint8_t BTN_REPEAT_SAMPLES = 37;     // ~150 ms between BTN_REPEAT
+const uint16_t BTN_STALE_MS = 3000;        // older events are dropped, not replayed
+SpscRing<BtnEvent, 16> btnEvents;          // ISR -> loop
+volatile bool btnSampling = false;         // set once the pull-ups are on
+uint8_t btnStable = 0;                     // ISR-owned from here down
+uint8_t btnDebounce[BTN_COUNT];
+uint8_t btnHeld[BTN_COUNT];
+
+void buttonsBegin() {
+  Buttons::inputPullup();
+  delayMicroseconds(50);                   // let the inputs charge through the pull-ups
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    btnStable = Buttons::read();           // a button held at boot does not fire
+    memset(btnDebounce, 0, sizeof(btnDebounce));
+    memset(btnHeld, 0, sizeof(btnHeld));
+    btnEvents.clear();
+    btnSampling = true;
+  }
+}
+
+void btnPush(uint8_t button, uint8_t kind) {
+  BtnEvent e = {button, kind, (uint16_t)millis()};
+  btnEvents.push(e);
+}
+
+// Timer0 compare ISR
+void buttonsSample() {
+  static uint8_t div = 0;
+  if (!btnSampling || ++div < BTN_SAMPLE_TICKS) return;
+  div = 0;
+  uint8_t now = Buttons::read();
+  for (uint8_t i = 0; i < BTN_COUNT; i++) {
+    uint8_t bit = 1 << i;
+    if ((now ^ btnStable) & bit) {
+      if (++btnDebounce[i] < BTN_DEBOUNCE_SAMPLES) continue;
+      btnStable ^= bit;
+      btnDebounce[i] = 0;
+      btnHeld[i] = 0;
+      btnPush(i, (btnStable & bit) ? BTN_PRESS : BTN_RELEASE);
+      continue;
+    }
+    btnDebounce[i] = 0;
+    if (!(btnStable & bit)) continue;
+    btnHeld[i]++;
+    if (btnHeld[i] == BTN_LONG_SAMPLES) {
+      btnPush(i, BTN_LONG);
+    } else if (btnHeld[i] == BTN_LONG_SAMPLES + BTN_REPEAT_SAMPLES) {
+      btnPush(i, BTN_REPEAT);
+      btnHeld[i] = BTN_LONG_SAMPLES;
+    }
+  }
 }
-inline bool pressed(const Btn &b) { return b.stable == LOW; }
 
 enum UiScreen {
   SCREEN_MENU,
@@ -78,14 +144,14 @@ enum UiScreen {
   SCREEN_RETRIEVAL
 };
 UiScreen screen = SCREEN_MENU;
-const char* MENU_ITEMS[] = { "Exp SD", "Exp Interno", "Servico", "Ajustar Hora" };
+const char MENU_ITEMS[][13] PROGMEM = { "Exp SD", "Exp Interno", "Servico", "Ajustar Hora" };
 const uint8_t NITEMS = 4;
 uint8_t menuIndex = 0;
-const char* SERVICE_ITEMS[] = { "Sensores", "Reles", "Cfg Aqec", "WiFi Status", "Recarregar CFG" };
+const char SERVICE_ITEMS[][15] PROGMEM = { "Sensores", "Reles", "Cfg Aqec", "WiFi Status", "Recarregar CFG" };
 const uint8_t NSERVICE = 5;
 uint8_t serviceIndex = 0;
 bool sensorCfgPage = false;
-const char* CONFIG_ITEMS[] = { "Intervalo Aqec" };
+const char CONFIG_ITEMS[][15] PROGMEM = { "Intervalo Aqec" };
 const uint8_t NCONFIG = 1;
 uint8_t configIndex = 0;
 uint16_t heaterIntervalEdit = 10;
@@ -105,6 +171,13 @@ struct Meta {
   uint16_t intervalMin;
   uint16_t stepCount;
   uint16_t stepUnitMs;
+  uint16_t logFastMs;       // LOG_FAST_MS, period inside the fast window / steep slope
+  uint16_t logSlowS;        // LOG_SLOW_S, period when the signal is flat
+  uint16_t logFastWindowS;  // LOG_FAST_WINDOW_S, fast window after each step start
+  uint16_t logSlope10;      // LOG_SLOPE_C_MIN x10, |dT/dt| that keeps fast logging
+  uint16_t logDbT10;        // LOG_DB_T x10, swinging-door tolerance for T1/T2 (0 = not tracked)
+  uint16_t logDbH10;        // LOG_DB_H x10, swinging-door tolerance for U1/U2 (0 = not tracked)
+  uint16_t logMaxGapS;      // LOG_MAX_GAP_S, a row is always kept after this gap
 };
 Meta meta;
 const uint8_t MAX_FILES = 9; // 6 SD + 3 internal
@@ -119,31 +192,28 @@ char currentFile[13];
 bool sdOk = false;
 unsigned long lastSdCheckMs = 0;
 
-struct InternalExp { const char *name; const char *const *lines; };
-const char *const INT1_LINES[] = {
-  "ID=INT1","PROGRAM=1","RETRIEVALS=0","INTERVAL_MIN=0","STEP_UNIT=SEC",
-  "S1,3,0,1000,0000,0,0","S2,4,0,0100,0000,0,0","S3,5,0,0010,0000,0,0",
-  "S4,3,0,0001,0000,0,0","S5,4,0,1100,0000,0,0", NULL
-};
-const char *const INT2_LINES[] = {
-  "ID=INT2","PROGRAM=1","RETRIEVALS=0","INTERVAL_MIN=0","STEP_UNIT=SEC",
-  "A1,5,0,1010,0000,0,0","A2,5,0,0101,0000,0,0","A3,5,0,0011,0000,0,0",
-  "A4,5,0,1111,0000,0,0", NULL
-};
-const char *const INT3_LINES[] = {
-  "ID=INT3","PROGRAM=1","RETRIEVALS=0","INTERVAL_MIN=0","STEP_UNIT=SEC",
-  "B1,2,0,1000,0000,0,0","B2,2,0,0100,0000,0,0","B3,2,0,0010,0000,0,0",
-  "B4,2,0,0001,0000,0,0","B5,2,0,1110,0000,0,0", NULL
-};
-const char *const INT4_LINES[] = {
-  "ID=INT4","PROGRAM=1","RETRIEVALS=0","INTERVAL_MIN=0","STEP_UNIT=SEC",
-  "T28,60,0,0000,0000,28,0", NULL
-};
-const InternalExp INTERNAL_EXPS[] = {
-  {"INT1.CSV", INT1_LINES},
-  {"INT2.CSV", INT2_LINES},
-  {"INT3.CSV", INT3_LINES},
-  {"INT4.CSV", INT4_LINES},
+// Internal experiments live in flash as newline-separated CSV text
+struct InternalExp { char name[13]; PGM_P text; };
+const char INT1_TEXT[] PROGMEM =
+  "ID=INT1\nPROGRAM=1\nRETRIEVALS=0\nINTERVAL_MIN=0\nSTEP_UNIT=SEC\n"
+  "S1,3,0,1000,0000,0,0\nS2,4,0,0100,0000,0,0\nS3,5,0,0010,0000,0,0\n"
+  "S4,3,0,0001,0000,0,0\nS5,4,0,1100,0000,0,0\n";
+const char INT2_TEXT[] PROGMEM =
+  "ID=INT2\nPROGRAM=1\nRETRIEVALS=0\nINTERVAL_MIN=0\nSTEP_UNIT=SEC\n"
+  "A1,5,0,1010,0000,0,0\nA2,5,0,0101,0000,0,0\nA3,5,0,0011,0000,0,0\n"
+  "A4,5,0,1111,0000,0,0\n";
+const char INT3_TEXT[] PROGMEM =
+  "ID=INT3\nPROGRAM=1\nRETRIEVALS=0\nINTERVAL_MIN=0\nSTEP_UNIT=SEC\n"
+  "B1,2,0,1000,0000,0,0\nB2,2,0,0100,0000,0,0\nB3,2,0,0010,0000,0,0\n"
+  "B4,2,0,0001,0000,0,0\nB5,2,0,1110,0000,0,0\n";
+const char INT4_TEXT[] PROGMEM =
+  "ID=INT4\nPROGRAM=1\nRETRIEVALS=0\nINTERVAL_MIN=0\nSTEP_UNIT=SEC\n"
+  "T28,60,0,0000,0000,28,0\n";
+const InternalExp INTERNAL_EXPS[] PROGMEM = {
+  {"INT1.CSV", INT1_TEXT},
+  {"INT2.CSV", INT2_TEXT},
+  {"INT3.CSV", INT3_TEXT},
+  {"INT4.CSV", INT4_TEXT},
 };
 const uint8_t INTERNAL_COUNT = 4;
 
@@ -184,12 +254,21 @@ struct UploadCursor {
   uint8_t synced;
 };
 
+const uint8_t NET_RECOVER_SAMPLES = 8;
+enum NetRecoverTier { NET_TIER_STATUS, NET_TIER_FAST, NET_TIER_FULL, NET_TIER_COUNT };
+
 struct NetStats {
   uint32_t sent;
   uint32_t failed;
   uint32_t retried;
   uint32_t pendingLines;
   int16_t lastHttpCode;
+  uint16_t drops;
+  uint16_t recoveredBy[NET_TIER_COUNT];   // which tier brought the link back
+  uint16_t lastTierMs[NET_TIER_COUNT];    // duration of the last attempt of each tier
+  uint16_t recoverMs[NET_RECOVER_SAMPLES]; // time-to-online after a drop (ring, ms)
+  uint8_t recoverHead;
+  uint8_t recoverCount;
 };
 
 struct EventRecord {
@@ -219,29 +298,66 @@ NetStats netStats = {};
 UploadCursor uploadCursor = {};
 UploadCursor eventCursor = {};
 unsigned long lastNetAttemptMs = 0;
+unsigned long netDownSinceMs = 0;
+bool netWasOnline = false;      // a join from NET_OFF is a first join, not a recovery
+unsigned long netTierStartMs = 0;
+uint8_t netRecoverTier = NET_TIER_STATUS;
+bool wifiLinkSeen = false;
+bool wifiAutoConnSet = false;
+char wifiCachedBssid[18] = "";
+uint8_t wifiCachedChannel = 0;
 unsigned long lastCloudTickMs = 0;
 unsigned long cloudBackoffMs = 1000;
 const unsigned long CLOUD_TICK_MS = 3000;
+const unsigned long CLOUD_TICK_MIN_MS = 500;
+const unsigned long CLOUD_TICK_MAX_MS = 60000;
+const unsigned long CLOUD_RETRY_AFTER_MAX_MS = 300000;
 const unsigned long CLOUD_CONNECT_RETRY_MS = 5000;
-const uint8_t CLOUD_BATCH_MAX = 1;
-const uint16_t CLOUD_JSON_MAX = 400;
+const uint8_t CLOUD_BATCH_MAX = 5;        // telemetry rows per POST, shrunk to fit CLOUD_JSON_MAX
+const uint8_t CLOUD_EVENT_BATCH_MAX = 1;
+const bool CLOUD_COLUMNAR = true;         // POST telemetry/columnar instead of telemetry/batch
+bool cloudColumnar = CLOUD_COLUMNAR;      // cleared until reboot when the backend has no columnar route
+const uint16_t CLOUD_JSON_MAX = 640;
 char activeRunUpload[13] = "";
 bool cloudBusy = false;
 char cloudPayload[CLOUD_JSON_MAX];
 char cloudPath[40];
 uint16_t cloudPayloadLen = 0;
-unsigned long cloudJobStartedMs = 0;
-uint8_t cloudJobState = 0;
 bool cloudJobIsEvent = false;
+bool cloudJobIsLive = false;
+bool cloudLastJobLive = false;
+uint32_t cloudLiveThrough = 0;
 int cloudJobHttpCode = -1;
-unsigned long cloudJobDeadlineMs = 0;
 uint16_t cloudHttpLen = 0;
 UploadCursor cloudNextCursor = {};
 bool cloudHasCursorUpdate = false;
 bool cloudLastJobDone = false;
 bool cloudLastJobOk = false;
-uint8_t wifiStage = 0;
-unsigned long wifiStageMs = 0;
+// Server-driven pacing: the ingest response carries hints the uploader adopts
+unsigned long cloudTickMs = CLOUD_TICK_MS;    // suggested gap between jobs (ctl.tick_ms)
+unsigned long cloudTickGapMs = CLOUD_TICK_MS; // gap before the next job, stretched by errors / Retry-After
+uint8_t cloudBatchLimit = 0;                  // ctl.max_batch, 0 = CLOUD_BATCH_MAX
+long cloudHintBatch = -1;
+long cloudHintTickMs = -1;
+long cloudHintRetryS = -1;
+// Server ack for the run of the last batch: highest contiguous line_index held, and
+// the last line of the first gap above it when the server holds rows past the gap
+long cloudAckContiguous = -1;
+long cloudAckGapTo = -1;
+uint32_t cloudJobFromLine = 0;
+char ackSkipRun[13] = "";
+uint32_t ackSkipThrough = 0;     // rows <= this are already on the server, skip without sending
+const uint16_t ACK_SKIP_SCAN_MAX = 200;
+char ackFullRun[13] = "";        // CFG RESYNC ... FULL: re-send even what the server acks ("ALL" = every run)
+// Start points of the last backfill jobs, so a gap re-send seeks near it instead of byte 0
+struct UploadAnchor {
+  uint32_t lineIndex;
+  uint32_t byteOffset;
+};
+const uint8_t UPLOAD_ANCHOR_CAP = 4;
+SpscRing<UploadAnchor, UPLOAD_ANCHOR_CAP, RING_DROP_OLDEST> uploadAnchors;
+char uploadAnchorRun[13] = "";
+bool wifiJoinQueued = false;
 char espRxWindow[180];
 uint16_t espRxLen = 0;
 char serialCmdLine[120];
@@ -255,11 +371,47 @@ struct RunState {
   uint16_t stepCount;
   uint16_t currentStep;
   uint8_t retrievalIndex;
-  unsigned long expStartMs;
-  unsigned long totalPauseMs;
-  unsigned long pausedAt;
+  uint64_t expStartMs;   // monoMs()
+  uint64_t totalPauseMs;
+  uint64_t pausedAt;
 } run = {};
 
+// Power-loss checkpoint, rotated over EEPROM slots (highest valid seq wins)
+struct RunCheckpoint {
+  uint32_t seq;
+  uint8_t active;
+  uint8_t paused;
+  uint8_t waitRetrieval;
+  uint8_t source;         // RunSource
+  uint8_t internalIndex;
+  uint8_t retrievalIndex;
+  uint8_t heaterOn;
+  uint16_t currentStep;   // steps started (the running one included)
+  uint64_t runMs;         // run time excluding pauses
+  uint64_t stepPlanEndMs;
+  char expFile[13];
+  char logFile[13];
+  uint32_t logBytes;      // logFile size and rows at its last flush
+  uint32_t logRows;
+  uint32_t epoch;         // wall time when written, 0 if unknown
+  uint16_t checksum;
+};
+
+const int CKPT_ADDR = 512;  // after the config blob
+const uint8_t CKPT_SLOTS = 16;
+// Wear: seq, runMs and checksum change on every save, so each save costs every cell
+// of those fields in its slot one erase/write cycle. At most one save per
+// CKPT_MIN_GAP_MS (step boundaries) or CKPT_PERIOD_MS: 1440 saves/day over 16 slots
+// is 90 cycles per cell per day, ~3 years of continuous runs before the 100k rated
+// endurance. A save is written byte by byte behind the loop (ckptWriteTick).
+const unsigned long CKPT_PERIOD_MS = 60000UL;
+const unsigned long CKPT_MIN_GAP_MS = 60000UL;
+uint32_t ckptSeq = 0;
+uint8_t ckptSlot = 0;
+bool ckptDirty = false;
+unsigned long lastCkptMs = 0;
+bool resumeStepPending = false;
+
 File runFile;
 File logFile;
 bool logOpen = false;
@@ -283,20 +435,51 @@ struct LogRecord {
   int16_t hAvg_10;
   uint8_t mask;
   char step[10];
+  uint32_t lineIndex; // 1-based data row in the run file, matches the upload cursor
+  uint32_t epoch;     // sample time (UTC seconds), 0 while the clock is unknown
+  uint16_t epochMs;
 };
 
-const uint8_t LOG_BACKLOG_CAP = 8;
-LogRecord logQueue[LOG_BACKLOG_CAP];
-uint8_t logHead = 0;
-uint8_t logTail = 0;
-uint8_t logCount = 0;
-uint16_t droppedLogsCount = 0;
+const uint8_t LOG_BACKLOG_CAP = 16;      // power of two (SpscRing)
+SpscRing<LogRecord, LOG_BACKLOG_CAP, RING_DROP_OLDEST> logQueue;
+uint16_t logDroppedCount = 0;           // rows lost this run: RAM full and spill full/unusable
+uint32_t logSpilledCount = 0;           // rows parked in the EEPROM spill this run
 unsigned long lastFlushTryMs = 0;
+char logFileName[13] = "";
+const uint16_t RUN_NO_MAX = 999;   // RUN999.CSV is still a valid 8.3 name
+uint32_t logLineSeq = 0;       // last row number handed out to logQueue
+uint32_t logFileRows = 0;      // rows in logFileName, gap rows included
+uint32_t logSyncedBytes = 0;   // size and rows at the last flush: known to be on the card
+uint32_t logSyncedRows = 0;
+
+// Live lane: newest logged rows kept in RAM and sent ahead of the SD backfill
+const uint8_t LIVE_RING_CAP = 4;
+SpscRing<LogRecord, LIVE_RING_CAP, RING_DROP_OLDEST> liveRing;
 
 RTC_DS1307 rtc;
 bool rtcOk = false;
 bool rtcLostPowerOrInvalid = false;
 
+// millis() value rtcAnchorMs corresponds to rtcAnchorEpoch, so a sample's wall time is
+// derived without an I2C read. Re-anchored on an RTC second edge once a minute.
+const unsigned long RTC_REANCHOR_MS = 60000UL;
+const long CLK_SKEW_EVENT_MS = 1000L;
+uint32_t rtcAnchorEpoch = 0;
+unsigned long rtcAnchorMs = 0;
+bool rtcAnchorValid = false;
+bool rtcAnchorPending = true;
+uint32_t rtcAnchorSeenEpoch = 0;
+unsigned long rtcAnchorPollMs = 0;
+
+const unsigned long SNTP_SYNC_PERIOD_MS = 21600000UL; // 6 h
+const unsigned long SNTP_RETRY_MS = 30000UL;
+const long SNTP_CORRECT_THRESHOLD_S = 2;
+bool sntpConfigured = false;
+bool sntpSynced = false;
+bool sntpQueued = false;
+unsigned long lastSntpTryMs = 0;
+unsigned long lastSntpSyncMs = 0;
+
 struct TimeSetState {
   uint16_t year;
   uint8_t month;
@@ -311,27 +494,47 @@ TimeSetState timeSet = {2026, 1, 1, 0, 0, 0, 0};
 // Step timing
 bool stepActive = false;
 bool stepDone = false;
-unsigned long stepStartMs = 0;
-unsigned long stepDurationMs = 0;
+uint64_t stepStartMs = 0; // monoMs()
+uint64_t stepDurationMs = 0;
+// Step deadlines are absolute in run time (pauses excluded): the planned end of step N
+// is the sum of durations 1..N, so loop latency at a boundary does not accumulate.
+const long STEP_SKEW_EVENT_MS = 1000;
+const long STEP_SKEW_LATE_MS = 100;
+uint64_t stepPlanEndMs = 0;
+long stepSkewMs = 0;     // actual minus planned start of the current step
+long stepSkewMaxMs = 0;
+uint16_t stepLateCount = 0;
 
 // Sensors
 const unsigned long DHT_PERIOD_MS = 3000;
+const unsigned long DHT_WARMUP_MS = 1000; // DHT22 needs ~1 s after power-up
+unsigned long dhtWarmStartMs = 0;
+bool dhtWarm = false;
 const unsigned long DHT_FAIL_RETRY_MS = 2000;
 const unsigned long STEP_UNIT_MS_DEFAULT = 1000UL; // seconds-based steps
 const unsigned long SD_CHECK_MS = 3000;
 const unsigned long LOG_PERIOD_MS = 3000;
+const unsigned long LOG_PERIOD_MIN_MS = 500;
+const unsigned long SLOPE_BASE_MS = 30000; // baseline for the temperature slope estimate
 const unsigned long LOG_FLUSH_INTERVAL_MS = 400;
-const uint8_t LOG_FLUSH_EVERY = 5;
-const uint8_t LOG_FLUSH_BURST = 3;
+const uint8_t LOG_BURST_MAX = 8;               // rows per flush pass, budget permitting
+const uint8_t LOG_FLUSH_EVERY_MIN = 2;         // rows between flush() on a fast card
+const uint8_t LOG_UNFLUSHED_MAX = 10;          // rows at risk before a flush is forced
+const unsigned long LOG_FLUSH_MAX_AGE_MS = 30000; // written rows stay unflushed at most this long
 unsigned long lastReadMs = 0;
 unsigned long lastLogMs = 0;
-uint8_t logFlushCounter = 0;
+uint8_t lastLoggedMask = 0xFF;
+uint8_t logUnflushedRows = 0;
+unsigned long logUnflushedSinceMs = 0;      // first row written after the last flush
 bool haveValid = false;
 float t1 = NAN, h1 = NAN, t2 = NAN, h2 = NAN;
 float tAvg = NAN, hAvg = NAN;
 bool dht1Ok = false;
 bool dht2Ok = false;
 unsigned long lastValidSensorMs = 0;
+float tSlopeCPerMin = 0.0f;
+float slopeRefT = NAN;
+unsigned long slopeRefMs = 0;
 
 // Relay + thermostat
 uint8_t relayMask = 0;
@@ -341,6 +544,292 @@ bool heaterOn = false;
 const unsigned long POLL_MS = 3000;
 unsigned long lastPoll = 0;
 
+void emitUiEvent(const __FlashStringHelper *eventType, int16_t arg0, int16_t arg1);
+bool spillPush(const LogRecord &rec);
+uint16_t arcNextRunNo();
+void arcAbort();
+bool dumpActive();
+bool journalEnabled = false;   // JOURNAL=1 in CONFIG.CSV
+bool streamEnabled = false;    // STREAM=1 in CONFIG.CSV or CFG STREAM ON
+void journalSample(const char *runFile, const LogRecord &rec);
+void journalEvent(const __FlashStringHelper *type, int16_t arg0, int16_t arg1);
+void journalStepNote(const LogRecord &rec);
+void journalFlush();
+void journalReset();
+void journalJobCommitted();
+
+// ===== Monotonic clock =====
+// 64-bit ms/us time for run and step timing; millis() wraps after 49.7 days and
+// micros() after 71 min. Timer0 compare-A fires once per Timer0 cycle (~1.024 ms),
+// alongside the core's overflow ISR, and carries the 32-bit wraps into the high words.
+MonoClock monoMsClock;
+MonoClock monoUsClock;
+
+// Called with interrupts disabled
+void monoCarry() {
+  monoMsClock.carry(millis());
+  monoUsClock.carry(micros());
+}
+
+ISR(TIMER0_COMPA_vect) {
+  monoCarry();
+  buttonsSample();
+}
+
+void monoBegin() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    monoCarry();
+    OCR0A = 0x80; // mid-cycle, away from the overflow ISR; pin 13 PWM is not used
+    TIMSK0 |= bit(OCIE0A);
+  }
+}
+
+uint64_t monoMs() {
+  uint64_t t;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { t = monoMsClock.read(millis()); }
+  return t;
+}
+
+uint64_t monoUs() {
+  uint64_t t;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { t = monoUsClock.read(micros()); }
+  return t;
+}
+
+// ===== Watchdog =====
+// 8 s hardware watchdog in interrupt+reset mode: the first timeout runs WDT_vect, which
+// drops the relays and leaves which subsystem was running and for how long in RAM;
+// the second timeout resets and the next boot stores it. loop() pats the dog once per
+// pass and marks each subsystem.
+enum WdSubsystem { WD_LOOP, WD_BOOT, WD_SERIAL, WD_NET, WD_UI, WD_SENSORS, WD_LOG, WD_RUN, WD_COUNT };
+const char WD_NAMES[WD_COUNT][8] PROGMEM = {"loop", "boot", "serial", "net", "ui", "sensors", "log", "run"};
+
+PGM_P wdName(uint8_t sub) {
+  return WD_NAMES[sub < WD_COUNT ? sub : WD_LOOP];
+}
+
+struct HealthStore {
+  uint16_t magic;
+  uint16_t boots;
+  uint16_t wdtResets;
+  uint8_t stallPending;
+  uint8_t stallSubsystem;
+  uint32_t stallMs;      // time spent in the subsystem when the watchdog fired
+  uint32_t stallUptimeMs;
+};
+
+const uint16_t HEALTH_MAGIC = 0x4857; // "HW"
+const int HEALTH_ADDR = CKPT_ADDR + CKPT_SLOTS * (int)sizeof(RunCheckpoint);
+HealthStore health = {};
+uint8_t resetCause = 0; // MCUSR at boot
+volatile uint8_t wdCurrent = WD_LOOP;
+volatile unsigned long wdEnterMs = 0;
+unsigned long wdLastProgressMs[WD_COUNT];
+
+// Breadcrumb from WDT_vect to the next boot. .noinit RAM survives the reset; EEPROM is
+// off limits in the ISR, which may have cut into a write in progress.
+struct WdCrumb {
+  uint16_t magic;
+  uint8_t subsystem;
+  uint32_t stallMs;
+  uint32_t uptimeMs;
+  uint16_t check;        // rejects power-on garbage that happens to hold the magic
+};
+const uint16_t WD_CRUMB_MAGIC = 0x5744; // "WD"
+WdCrumb wdCrumb __attribute__((section(".noinit")));
+volatile bool wdRelaysDropped = false;  // WDT_vect fired but the loop came back before the reset
+
+uint16_t wdCrumbCheck() {
+  return (uint16_t)~(wdCrumb.subsystem ^ (uint16_t)wdCrumb.stallMs ^ (uint16_t)(wdCrumb.stallMs >> 16) ^
+                     (uint16_t)wdCrumb.uptimeMs ^ (uint16_t)(wdCrumb.uptimeMs >> 16));
+}
+
+void wdMark(uint8_t sub) {
+  unsigned long now = millis();
+  wdLastProgressMs[wdCurrent] = now;
+  wdCurrent = sub;
+  wdEnterMs = now;
+}
+
+ISR(WDT_vect) {
+  Relays::write(0);
+  wdRelaysDropped = true;
+  unsigned long now = millis();
+  wdCrumb.subsystem = wdCurrent;
+  wdCrumb.stallMs = now - wdEnterMs;
+  wdCrumb.uptimeMs = now;
+  wdCrumb.check = wdCrumbCheck();
+  wdCrumb.magic = WD_CRUMB_MAGIC;
+}
+
+// Called first thing in setup(): keeps the reset cause and stops a watchdog left running
+void wdEarlyInit() {
+  resetCause = MCUSR;
+  MCUSR = 0;
+  wdt_disable();
+}
+
+void wdStart() {
+  wdt_enable(WDTO_8S);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    WDTCSR |= bit(WDIE);
+  }
+}
+
+// Loop cost: time between wdPat() calls (one per pass), EMA 1/8 and peak since CFG HEALTH
+uint32_t loopStartUs = 0;
+uint32_t loopAvgUs = 0;
+uint32_t loopMaxUs = 0;
+uint16_t relayWriteUs = 0;   // last applyRelayMask() port update, first to last relay
+
+void wdPat() {
+  uint32_t us = micros();
+  if (loopStartUs) {
+    uint32_t d = us - loopStartUs;
+    loopAvgUs = loopAvgUs ? loopAvgUs - (loopAvgUs >> 3) + (d >> 3) : d;
+    if (d > loopMaxUs) loopMaxUs = d;
+  }
+  loopStartUs = us;
+  wdt_reset();
+  WDTCSR |= bit(WDIE); // re-arm the pre-reset interrupt (hardware clears it after it fires)
+  wdMark(WD_LOOP);
+}
+
+void applyRelayMask(uint8_t mask);
+
+// The stall ended before the reset: relayMask still holds the outputs the program
+// wants, so drive them again and log the stall here instead of after a reboot
+void wdRecoverTick() {
+  if (!wdRelaysDropped) return;
+  wdRelaysDropped = false;
+  wdCrumb.magic = 0;
+  applyRelayMask(relayMask);
+  emitUiEvent(F("wdt_recover"), wdCrumb.subsystem, (int16_t)min(wdCrumb.stallMs / 100UL, 32767UL));
+}
+
+// Counts the boot and reports a stall recorded before the last reset
+void healthBootReport() {
+  EEPROM.get(HEALTH_ADDR, health);
+  if (health.magic != HEALTH_MAGIC) {
+    memset(&health, 0, sizeof(health));
+    health.magic = HEALTH_MAGIC;
+  }
+  health.boots++;
+  if (wdCrumb.magic == WD_CRUMB_MAGIC && wdCrumb.check == wdCrumbCheck()) {
+    health.wdtResets++;
+    health.stallPending = 1;
+    health.stallSubsystem = wdCrumb.subsystem;
+    health.stallMs = wdCrumb.stallMs;
+    health.stallUptimeMs = wdCrumb.uptimeMs;
+  } else if (resetCause & bit(WDRF)) {
+    health.wdtResets++; // reset before the interrupt could leave its record
+  }
+  wdCrumb.magic = 0;
+  if (health.stallPending) {
+    emitUiEvent(F("wdt_stall"), health.stallSubsystem, (int16_t)min(health.stallMs / 100UL, 32767UL));
+    Serial.print(F("WDT stall in ")); Serial.print((const __FlashStringHelper *)wdName(health.stallSubsystem));
+    Serial.print(F(" for ")); Serial.print(health.stallMs); Serial.println(F(" ms"));
+    health.stallPending = 0;
+  }
+  EEPROM.put(HEALTH_ADDR, health);
+}
+
+void printHealth() {
+  Serial.println(F("HEALTH"));
+  Serial.print(F("BOOTS=")); Serial.println(health.boots);
+  Serial.print(F("WDT_RESETS=")); Serial.println(health.wdtResets);
+  Serial.print(F("RESET_CAUSE=0x")); Serial.println(resetCause, HEX);
+  Serial.print(F("LAST_STALL=")); Serial.print((const __FlashStringHelper *)wdName(health.stallSubsystem));
+  Serial.print(' '); Serial.print(health.stallMs); Serial.println(F(" ms"));
+  unsigned long now = millis();
+  Serial.print(F("PROGRESS_AGE_MS"));
+  for (uint8_t i = 0; i < WD_COUNT; i++) {
+    Serial.print(' '); Serial.print((const __FlashStringHelper *)wdName(i)); Serial.print('='); Serial.print(now - wdLastProgressMs[i]);
+  }
+  Serial.println();
+  Serial.print(F("LOOP_US avg=")); Serial.print(loopAvgUs);
+  Serial.print(F(" max=")); Serial.print(loopMaxUs);
+  Serial.print(F(" RELAY_WRITE_US=")); Serial.println(relayWriteUs);
+  loopMaxUs = 0;
+}
+
+// ===== Memory =====
+// Counts what would be printed; sizes a streamed message without buffering it
+class ByteCounter : public Print {
+public:
+  size_t count = 0;
+  size_t write(uint8_t) override { count++; return 1; }
+};
+
+// Shared arena for the transient line buffers of the SD parsers and the uploader.
+// Stack discipline: release in reverse order of allocation.
+const uint16_t SCRATCH_SIZE = 256;
+const uint16_t SCRATCH_LINE = 128;
+char scratchArena[SCRATCH_SIZE];
+uint16_t scratchUsed = 0;
+uint16_t scratchHighWater = 0;
+uint16_t scratchFailCount = 0;
+
+char *scratchAlloc(uint16_t n) {
+  if (n > SCRATCH_SIZE - scratchUsed) {
+    scratchFailCount++;
+    return NULL;
+  }
+  char *p = scratchArena + scratchUsed;
+  scratchUsed = (uint16_t)(scratchUsed + n);
+  if (scratchUsed > scratchHighWater) scratchHighWater = scratchUsed;
+  p[0] = '\0';
+  return p;
+}
+
+void scratchRelease(char *p) {
+  if (p >= scratchArena && p < scratchArena + SCRATCH_SIZE) scratchUsed = (uint16_t)(p - scratchArena);
+}
+
+// Stack high-water mark: the gap between heap and stack is painted at boot and the
+// untouched run just above the heap is the smallest headroom seen since.
+extern char __heap_start;
+extern char *__brkval;
+const uint8_t STACK_PAINT = 0xC5;
+const uint8_t STACK_PAINT_GUARD = 64;  // leave the painter's own frame alone
+
+char *heapEnd() {
+  return __brkval ? __brkval : &__heap_start;
+}
+
+void stackPaint() {
+  char here;
+  for (char *p = heapEnd(); p < &here - STACK_PAINT_GUARD; p++) *p = (char)STACK_PAINT;
+}
+
+uint16_t stackFreeNow() {
+  char here;
+  return (uint16_t)(&here - heapEnd());
+}
+
+uint16_t stackFreeMin() {
+  char here;
+  const char *p = heapEnd();
+  uint16_t n = 0;
+  while (p + n < &here && (uint8_t)p[n] == STACK_PAINT) n++;
+  return n;
+}
+
+void printMemStats() {
+  Serial.println(F("MEM"));
+  Serial.print(F("FREE_NOW=")); Serial.println(stackFreeNow());
+  Serial.print(F("FREE_MIN=")); Serial.println(stackFreeMin());
+  Serial.print(F("SCRATCH_HWM=")); Serial.print(scratchHighWater);
+  Serial.print('/'); Serial.print(SCRATCH_SIZE);
+  Serial.print(F(" FAIL=")); Serial.println(scratchFailCount);
+  Serial.print(F("LOGQ=")); Serial.print(logQueue.count()); Serial.print('/'); Serial.print(logQueue.capacity());
+  Serial.print(F(" HWM=")); Serial.print(logQueue.highWater());
+  Serial.print(F(" SPILLED=")); Serial.print(logSpilledCount);
+  Serial.print(F(" DROP=")); Serial.println(logDroppedCount);
+  Serial.print(F("BTNQ HWM=")); Serial.print(btnEvents.highWater()); Serial.print('/'); Serial.print(btnEvents.capacity());
+  Serial.print(F(" DROP=")); Serial.println(btnEvents.overflows());
+}
+
 // ===== Utility =====
 void print16(int col, int row, const char *s) {
   lcd.setCursor(col, row);
@@ -350,6 +839,30 @@ void print16(int col, int row, const char *s) {
   }
 }
 
+void print16(int col, int row, const __FlashStringHelper *s) {
+  PGM_P p = (PGM_P)s;
+  lcd.setCursor(col, row);
+  for (int i = 0; i < 16; i++) {
+    char c = p ? (char)pgm_read_byte(p) : '\0';
+    if (c) p++;
+    lcd.print(c ? c : ' ');
+  }
+}
+
+// Copies the next '\n'-terminated line of a flash text; returns where the following
+// line starts, or NULL once the text is exhausted
+PGM_P nextFlashLine(PGM_P p, char *out, size_t outSize) {
+  if (!p || !pgm_read_byte(p)) return NULL;
+  size_t n = 0;
+  char c;
+  while ((c = (char)pgm_read_byte(p)) != '\0' && c != '\n') {
+    if (n + 1 < outSize) out[n++] = c;
+    p++;
+  }
+  out[n] = '\0';
+  return c ? p + 1 : p;
+}
+
 void safeCopy(char *dst, size_t dstSize, const char *src) {
   if (!dst || dstSize == 0) return;
   if (!src) { dst[0] = '\0'; return; }
@@ -481,12 +994,68 @@ void adjustTimeField(int8_t delta) {
   clampTimeSet();
 }
 
+// ===== Wall clock =====
+void rtcAnchorRequest(bool invalidate) {
+  rtcAnchorPending = true;
+  rtcAnchorSeenEpoch = 0;
+  if (invalidate) rtcAnchorValid = false;
+}
+
+void rtcAnchorSet(uint32_t epoch, unsigned long ms) {
+  rtcAnchorEpoch = epoch;
+  rtcAnchorMs = ms;
+  rtcAnchorValid = true;
+}
+
+bool epochAtMs(unsigned long ms, uint32_t &sec, uint16_t &frac) {
+  sec = 0;
+  frac = 0;
+  if (!rtcAnchorValid) return false;
+  long d = (long)(ms - rtcAnchorMs); // rows queued just before a re-anchor are slightly negative
+  if (d >= 0) {
+    sec = rtcAnchorEpoch + (uint32_t)(d / 1000L);
+    frac = (uint16_t)(d % 1000L);
+  } else {
+    unsigned long nd = (unsigned long)(-d);
+    sec = rtcAnchorEpoch - (uint32_t)((nd + 999UL) / 1000UL);
+    frac = (uint16_t)((1000UL - nd % 1000UL) % 1000UL);
+  }
+  return true;
+}
+
+void rtcAnchorTick() {
+  unsigned long now = millis();
+  if (!rtcAnchorPending) {
+    if (now - rtcAnchorMs < RTC_REANCHOR_MS) return;
+    rtcAnchorRequest(false);
+  }
+  if (!rtcOk || rtcLostPowerOrInvalid) return;
+  if (now - rtcAnchorPollMs < 5) return;
+  rtcAnchorPollMs = now;
+  uint32_t e = rtc.now().unixtime();
+  if (rtcAnchorSeenEpoch == 0) {
+    rtcAnchorSeenEpoch = e;
+    return;
+  }
+  if (e == rtcAnchorSeenEpoch) return;
+  // The RTC second just ticked, so the anchor phase is known to within one poll
+  uint32_t sec;
+  uint16_t frac;
+  if (epochAtMs(now, sec, frac)) {
+    long skewMs = ((long)e - (long)sec) * 1000L - (long)frac;
+    if (labs(skewMs) >= CLK_SKEW_EVENT_MS) emitUiEvent(F("clk_skew"), (int16_t)constrain(skewMs, -32767L, 32767L), 0);
+  }
+  rtcAnchorSet(e, now);
+  rtcAnchorPending = false;
+}
+
 bool saveTimeSetToRtc() {
   if (!rtcOk) return false;
   clampTimeSet();
   DateTime dt(timeSet.year, timeSet.month, timeSet.day, timeSet.hour, timeSet.minute, timeSet.second);
   rtc.adjust(dt);
   rtcLostPowerOrInvalid = false;
+  rtcAnchorRequest(true);
   return true;
 }
 
@@ -512,14 +1081,24 @@ void clearEspRxWindow() {
   espRxWindow[0] = '\0';
 }
 
+// Sliding search window (strstr needs it contiguous). Room is made once per RX burst,
+// dropping only the oldest bytes the burst needs, so at least cap - 64 bytes of
+// history survive between polls instead of shifting the window for every byte.
+const uint8_t ESP_RX_BURST = 64;  // Serial1 RX buffer
+
+void espRxReserve(uint16_t n) {
+  const uint16_t cap = sizeof(espRxWindow) - 1;
+  if (n > cap) n = cap;
+  if (espRxLen + n <= cap) return;
+  uint16_t drop = espRxLen + n - cap;
+  memmove(espRxWindow, espRxWindow + drop, espRxLen - drop);
+  espRxLen -= drop;
+  espRxWindow[espRxLen] = '\0';
+}
+
 void appendEspRx(char c) {
-  if (espRxLen + 1 < sizeof(espRxWindow)) {
-    espRxWindow[espRxLen++] = c;
-  } else {
-    memmove(espRxWindow, espRxWindow + 1, sizeof(espRxWindow) - 2);
-    espRxLen = sizeof(espRxWindow) - 2;
-    espRxWindow[espRxLen++] = c;
-  }
+  if (espRxLen >= sizeof(espRxWindow) - 1) espRxReserve(ESP_RX_BURST);
+  espRxWindow[espRxLen++] = c;
   espRxWindow[espRxLen] = '\0';
 }
 
@@ -527,10 +1106,164 @@ bool espHas(const char *pat) {
   return strstr(espRxWindow, pat) != NULL;
 }
 
-void espSendCmd(const char *cmd) {
-  clearEspRxWindow();
-  Serial1.print(cmd);
-  Serial1.print("\r\n");
+// ===== AT command engine =====
+// Queued AT commands, each with its own terminal token, failure tokens, timeout and
+// completion callback. The next command is issued as soon as the previous one ends,
+// and a failure drops the rest of its group (e.g. CIPSEND + payload after CIPSTART).
+enum AtResult { AT_OK, AT_FAIL, AT_TIMEOUT };
+enum AtFailMode { AT_FAIL_NONE, AT_FAIL_ERROR, AT_FAIL_ERROR_OR_FAIL };
+enum AtGroup { AT_GROUP_NONE, AT_GROUP_WIFI, AT_GROUP_HTTP };
+enum AtStatId { AT_STAT_BASIC, AT_STAT_STATUS, AT_STAT_FAST_JOIN, AT_STAT_JOIN, AT_STAT_CONNECT, AT_STAT_SEND, AT_STAT_PAYLOAD, AT_STAT_RESPONSE, AT_STAT_CLOSE, AT_STAT_COUNT };
+typedef void (*AtBuildFn)(char *out, size_t outSize);
+typedef void (*AtActionFn)();
+typedef void (*AtDoneFn)(AtResult res);
+
+struct AtCommand {
+  const char *text;     // fixed command (CRLF appended)
+  AtBuildFn build;      // or command text built when issued
+  AtActionFn write;     // or raw bytes written when issued (no CRLF)
+  const char *okToken;
+  const char *okAlt;
+  uint8_t failMode;
+  uint8_t group;
+  uint8_t statId;
+  uint16_t timeoutMs;
+  AtActionFn poll;      // called every tick while waiting (e.g. parse streaming response)
+  AtDoneFn done;
+};
+
+struct AtStat {
+  uint16_t count;
+  uint16_t failed;
+  uint32_t totalMs;
+  uint16_t maxMs;
+};
+
+const uint8_t AT_QUEUE_CAP = 8;
+AtCommand atQueue[AT_QUEUE_CAP];
+uint8_t atHead = 0;
+uint8_t atCount = 0;
+bool atActive = false;
+unsigned long atIssuedMs = 0;
+AtStat atStats[AT_STAT_COUNT];
+
+AtCommand atCmd(const char *text, const char *okToken, uint16_t timeoutMs, uint8_t failMode, uint8_t group, uint8_t statId, AtDoneFn done) {
+  AtCommand c = {};
+  c.text = text;
+  c.okToken = okToken;
+  c.timeoutMs = timeoutMs;
+  c.failMode = failMode;
+  c.group = group;
+  c.statId = statId;
+  c.done = done;
+  return c;
+}
+
+uint8_t atFreeSlots() {
+  return (uint8_t)(AT_QUEUE_CAP - atCount);
+}
+
+bool atEnqueue(const AtCommand &c) {
+  if (atCount >= AT_QUEUE_CAP) return false;
+  atQueue[(atHead + atCount) % AT_QUEUE_CAP] = c;
+  atCount++;
+  return true;
+}
+
+bool atGroupQueued(uint8_t group) {
+  for (uint8_t i = 0; i < atCount; i++) {
+    if (atQueue[(atHead + i) % AT_QUEUE_CAP].group == group) return true;
+  }
+  return false;
+}
+
+// Removes queued (not yet issued) commands of a group, keeping order of the rest
+void atDropGroup(uint8_t group) {
+  uint8_t kept = 0;
+  uint8_t first = atActive ? 1 : 0;
+  for (uint8_t i = 0; i < atCount; i++) {
+    AtCommand c = atQueue[(atHead + i) % AT_QUEUE_CAP];
+    if (i >= first && c.group == group) continue;
+    atQueue[(atHead + kept) % AT_QUEUE_CAP] = c;
+    kept++;
+  }
+  atCount = kept;
+}
+
+void atIssue(AtCommand &c) {
+  if (c.text || c.build || c.write) clearEspRxWindow();
+  if (c.text) {
+    Serial1.print(c.text);
+    Serial1.print(F("\r\n"));
+  } else if (c.build) {
+    char cmd[136];
+    c.build(cmd, sizeof(cmd));
+    Serial1.print(cmd);
+    Serial1.print(F("\r\n"));
+  } else if (c.write) {
+    c.write();
+  }
+  atIssuedMs = millis();
+  atActive = true;
+}
+
+void atComplete(AtResult res) {
+  AtCommand c = atQueue[atHead];
+  atHead = (uint8_t)((atHead + 1) % AT_QUEUE_CAP);
+  atCount--;
+  atActive = false;
+  unsigned long elapsed = millis() - atIssuedMs;
+  AtStat &st = atStats[c.statId < AT_STAT_COUNT ? c.statId : AT_STAT_BASIC];
+  st.count++;
+  if (res != AT_OK) st.failed++;
+  st.totalMs += elapsed;
+  if (elapsed > st.maxMs) st.maxMs = (uint16_t)((elapsed < 65535UL) ? elapsed : 65535UL);
+  if (res != AT_OK && c.group != AT_GROUP_NONE) atDropGroup(c.group);
+  if (c.done) c.done(res);
+}
+
+void atEngineTick() {
+  int n = Serial1.available();
+  if (n > 0) {
+    espRxReserve((uint16_t)n);
+    while (n-- > 0) appendEspRx((char)Serial1.read());
+  }
+  // Several short commands may finish within one loop pass
+  for (uint8_t guard = 0; guard < AT_QUEUE_CAP; guard++) {
+    if (!atActive) {
+      if (atCount == 0) return;
+      atIssue(atQueue[atHead]);
+    }
+    AtCommand &c = atQueue[atHead];
+    if (c.poll) c.poll();
+    if (espHas(c.okToken) || (c.okAlt && espHas(c.okAlt))) {
+      atComplete(AT_OK);
+    } else if (c.failMode != AT_FAIL_NONE && (espHas("ERROR") || (c.failMode == AT_FAIL_ERROR_OR_FAIL && espHas("FAIL")))) {
+      atComplete(AT_FAIL);
+    } else if (millis() - atIssuedMs > c.timeoutMs) {
+      atComplete(AT_TIMEOUT);
+    } else {
+      return;
+    }
+  }
+}
+
+const char AT_STAT_NAMES[AT_STAT_COUNT][9] PROGMEM = {"basic", "status", "fastjoin", "join", "connect", "send", "payload", "response", "close"};
+
+PGM_P atStatName(uint8_t id) {
+  return AT_STAT_NAMES[id < AT_STAT_COUNT ? id : AT_STAT_BASIC];
+}
+
+void printAtStats() {
+  Serial.println(F("AT STATS name count fail avg_ms max_ms"));
+  for (uint8_t i = 0; i < AT_STAT_COUNT; i++) {
+    const AtStat &st = atStats[i];
+    Serial.print((const __FlashStringHelper *)atStatName(i)); Serial.print(' ');
+    Serial.print(st.count); Serial.print(' ');
+    Serial.print(st.failed); Serial.print(' ');
+    Serial.print(st.count ? (unsigned long)(st.totalMs / st.count) : 0UL); Serial.print(' ');
+    Serial.println(st.maxMs);
+  }
 }
 
 const char* netStateTxt() {
@@ -618,6 +1351,175 @@ bool loadConfigFromEeprom() {
 void saveThermoToEeprom() { saveConfigToEeprom(); }
 bool loadThermoFromEeprom() { return loadConfigFromEeprom(); }
 
+// ===== SD latency profile =====
+// Every log write and flush is timed. The EWMAs size the burst of rows per pass and
+// the flush cadence so a pass stays under the stall budget, with at most
+// LOG_UNFLUSHED_MAX rows (or LOG_FLUSH_MAX_AGE_MS) not yet flushed. Profiles are kept
+// per card, keyed by a hash of its CID, in the top 64 bytes of EEPROM, so a known
+// slow card starts out with the right cadence. A card whose latency climbs past the
+// slow thresholds gets an sd_slow event while it still works.
+struct SdCardProfile {
+  uint32_t cidKey;        // 0 = free slot
+  uint16_t writeEwmaUs;   // per row
+  uint16_t flushEwmaMs;
+  uint16_t flushMaxMs;
+  uint8_t slowCount;      // sd_slow events raised for this card
+  uint8_t age;            // LRU, 0 = most recent
+};
+const uint8_t SDP_CARDS = 4;
+struct SdProfileStore {
+  uint16_t magic;
+  uint16_t budgetMs;
+  SdCardProfile cards[SDP_CARDS];
+};
+const uint16_t SDP_MAGIC = 0x5344; // "SD"
+const int SDP_ADDR = 4096 - 64;    // Mega2560 EEPROM is 4 KB
+const uint16_t SD_BUDGET_DEFAULT_MS = 40;
+const uint16_t SD_WRITE_DEFAULT_US = 2000;
+const uint16_t SD_FLUSH_DEFAULT_MS = 20;
+const uint16_t SD_SLOW_WRITE_US = 20000;
+const uint16_t SD_SLOW_FLUSH_MS = 100;
+const uint16_t SD_SPIKE_FLUSH_MS = 250;
+const uint8_t SD_SPIKES_SLOW = 3;               // spikes within one profile save period
+const unsigned long SDP_SAVE_MS = 1800000UL;    // persist the profile every 30 min of logging
+
+SdProfileStore sdProfiles;
+uint8_t sdCard = 0xFF;                          // index in sdProfiles.cards, 0xFF = unknown card
+uint32_t sdWriteEwmaUs = SD_WRITE_DEFAULT_US;
+uint32_t sdFlushEwmaMs = SD_FLUSH_DEFAULT_MS;
+uint16_t sdFlushMaxMs = 0;
+uint8_t sdSpikes = 0;
+bool sdSlowFlagged = false;
+unsigned long sdProfileSavedMs = 0;
+
+void sdProfilesLoad() {
+  EEPROM.get(SDP_ADDR, sdProfiles);
+  if (sdProfiles.magic == SDP_MAGIC && sdProfiles.budgetMs >= 5 && sdProfiles.budgetMs <= 500) return;
+  memset(&sdProfiles, 0, sizeof(sdProfiles));
+  sdProfiles.magic = SDP_MAGIC;
+  sdProfiles.budgetMs = SD_BUDGET_DEFAULT_MS;
+}
+
+void sdProfileSave() {
+  if (sdCard < SDP_CARDS) {
+    SdCardProfile &c = sdProfiles.cards[sdCard];
+    c.writeEwmaUs = (uint16_t)min(sdWriteEwmaUs, 65535UL);
+    c.flushEwmaMs = (uint16_t)min(sdFlushEwmaMs, 65535UL);
+    if (sdFlushMaxMs > c.flushMaxMs) c.flushMaxMs = sdFlushMaxMs;
+  }
+  EEPROM.put(SDP_ADDR, sdProfiles); // put() only rewrites bytes that changed
+  sdProfileSavedMs = millis();
+  sdSpikes = 0;
+}
+
+uint32_t cidHash(const cid_t &cid) {
+  const uint8_t *p = (const uint8_t*)&cid;
+  uint32_t h = 2166136261UL; // FNV-1a over the CID minus its CRC byte
+  for (uint8_t i = 0; i < sizeof(cid_t) - 1; i++) {
+    h ^= p[i];
+    h *= 16777619UL;
+  }
+  return h ? h : 1;
+}
+
+// Picks (or allocates, evicting the oldest) the profile for the inserted card
+void sdProfileSelect(uint32_t cidKey) {
+  uint8_t pick = 0xFF;
+  for (uint8_t i = 0; i < SDP_CARDS; i++) {
+    if (sdProfiles.cards[i].cidKey == cidKey) pick = i;
+  }
+  if (pick == 0xFF) {
+    pick = 0;
+    for (uint8_t i = 0; i < SDP_CARDS; i++) {
+      if (sdProfiles.cards[i].cidKey == 0) { pick = i; break; }
+      if (sdProfiles.cards[i].age > sdProfiles.cards[pick].age) pick = i;
+    }
+    SdCardProfile &c = sdProfiles.cards[pick];
+    memset(&c, 0, sizeof(c));
+    c.cidKey = cidKey;
+    c.writeEwmaUs = SD_WRITE_DEFAULT_US;
+    c.flushEwmaMs = SD_FLUSH_DEFAULT_MS;
+  }
+  for (uint8_t i = 0; i < SDP_CARDS; i++) {
+    if (sdProfiles.cards[i].cidKey && sdProfiles.cards[i].age < 255) sdProfiles.cards[i].age++;
+  }
+  sdProfiles.cards[pick].age = 0;
+  sdCard = pick;
+  sdWriteEwmaUs = sdProfiles.cards[pick].writeEwmaUs;
+  sdFlushEwmaMs = sdProfiles.cards[pick].flushEwmaMs;
+  sdFlushMaxMs = 0;
+  sdSpikes = 0;
+  sdSlowFlagged = false;
+}
+
+void sdCheckSlow() {
+  bool slow = sdWriteEwmaUs >= SD_SLOW_WRITE_US || sdFlushEwmaMs >= SD_SLOW_FLUSH_MS || sdSpikes >= SD_SPIKES_SLOW;
+  bool fine = sdWriteEwmaUs < SD_SLOW_WRITE_US * 2UL / 3 && sdFlushEwmaMs < SD_SLOW_FLUSH_MS * 2UL / 3 && sdSpikes == 0;
+  if (slow && !sdSlowFlagged) {
+    sdSlowFlagged = true;
+    if (sdCard < SDP_CARDS && sdProfiles.cards[sdCard].slowCount < 255) sdProfiles.cards[sdCard].slowCount++;
+    emitUiEvent(F("sd_slow"), (int16_t)min(sdFlushEwmaMs, 32767UL), (int16_t)min(sdWriteEwmaUs / 100UL, 32767UL));
+    sdProfileSave();
+  } else if (fine) {
+    sdSlowFlagged = false;
+  }
+}
+
+void sdNoteWrite(uint32_t us) {
+  sdWriteEwmaUs = (sdWriteEwmaUs * 7 + us) / 8;
+}
+
+void sdNoteFlush(uint32_t ms) {
+  sdFlushEwmaMs = (sdFlushEwmaMs * 7 + ms) / 8;
+  if (ms > sdFlushMaxMs) sdFlushMaxMs = (uint16_t)min(ms, 65535UL);
+  if (ms >= SD_SPIKE_FLUSH_MS && sdSpikes < 255) sdSpikes++;
+  sdCheckSlow();
+  if (millis() - sdProfileSavedMs >= SDP_SAVE_MS) sdProfileSave();
+}
+
+// Rows between flushes: a flush should cost no more than the writes it covers
+uint8_t sdFlushEvery() {
+  uint32_t w = max(sdWriteEwmaUs, 200UL);
+  uint32_t n = (sdFlushEwmaMs * 1000UL + w - 1) / w;
+  return (uint8_t)constrain(n, (uint32_t)LOG_FLUSH_EVERY_MIN, (uint32_t)LOG_UNFLUSHED_MAX);
+}
+
+// Rows that fit one pass next to an expected flush; 0 = the flush alone fills the pass
+uint8_t sdBurstRows(bool flushDue) {
+  uint32_t budgetUs = (uint32_t)sdProfiles.budgetMs * 1000UL;
+  uint32_t flushUs = flushDue ? sdFlushEwmaMs * 1000UL : 0;
+  if (flushUs >= budgetUs) return 0;
+  uint32_t n = (budgetUs - flushUs) / max(sdWriteEwmaUs, 200UL);
+  return (uint8_t)constrain(n, 1UL, (uint32_t)LOG_BURST_MAX);
+}
+
+// Reads the CID with a separate probe once the library has mounted the card. The
+// probe re-inits the card at the library's SPI rate; the mounted volume stays valid.
+void sdProbeCard() {
+  Sd2Card probe;
+  cid_t cid;
+  if (!probe.init(SPI_HALF_SPEED, SD_CS) || !probe.readCID(&cid)) return;
+  uint32_t key = cidHash(cid);
+  if (sdCard < SDP_CARDS && sdProfiles.cards[sdCard].cidKey == key) return;
+  if (sdCard < SDP_CARDS) sdProfileSave();
+  sdProfileSelect(key);
+}
+
+void printSdProfile() {
+  Serial.print(F("SD_BUDGET_MS=")); Serial.println(sdProfiles.budgetMs);
+  if (sdCard < SDP_CARDS) {
+    Serial.print(F("CARD=")); Serial.print(sdProfiles.cards[sdCard].cidKey, HEX);
+    Serial.print(F(" SLOW_EVENTS=")); Serial.println(sdProfiles.cards[sdCard].slowCount);
+  }
+  Serial.print(F("WRITE_US=")); Serial.print(sdWriteEwmaUs);
+  Serial.print(F(" FLUSH_MS=")); Serial.print(sdFlushEwmaMs);
+  Serial.print(F(" FLUSH_MAX_MS=")); Serial.print(sdFlushMaxMs);
+  Serial.print(F(" SPIKES=")); Serial.println(sdSpikes);
+  Serial.print(F("BURST=")); Serial.print(sdBurstRows(false));
+  Serial.print(F(" FLUSH_EVERY=")); Serial.print(sdFlushEvery());
+  Serial.print(F(" SLOW=")); Serial.println(sdSlowFlagged ? 1 : 0);
+}
+
 // ===== SD =====
 bool initSD() {
   // Mega requires SS (53) as OUTPUT to keep SPI master mode
@@ -625,7 +1527,166 @@ bool initSD() {
   digitalWrite(53, HIGH);
   pinMode(SD_CS, OUTPUT);
   digitalWrite(SD_CS, HIGH);
-  return SD.begin(SD_CS);
+  if (!SD.begin(SD_CS)) return false;
+  // Only reached when a card (re)appears: a missing card costs one init timeout per retry
+  sdProbeCard();
+  return true;
+}
+
+// ===== SD file cache =====
+// Every open/exists/remove walks the FAT directory. Files touched on each upload tick
+// (EVENTS.CSV, the run being uploaded) keep an open handle in a small LRU cache, and
+// .ACK cursors are served from RAM. The run being logged is read through the logger's
+// own handle: FILE_WRITE is read/write with O_APPEND, so the uploader seeks where it
+// needs and the next log write still lands at the end.
+struct FileHandle {
+  File f;
+  char name[13];          // "" = free slot
+  bool append;
+  uint32_t lastUse;
+};
+const uint8_t FH_SLOTS = 3;
+FileHandle fhCache[FH_SLOTS];
+uint32_t fhUseSeq = 0;
+uint32_t fhHits = 0;
+uint32_t fhMisses = 0;
+
+struct AckCacheEntry {
+  char run[13];           // "" = free slot
+  uint32_t byteOffset;
+  uint32_t lineIndex;
+  uint32_t syncEpoch;
+  uint32_t lastUse;
+};
+const uint8_t ACK_CACHE_SLOTS = 4;
+AckCacheEntry ackCache[ACK_CACHE_SLOTS];
+uint32_t ackHits = 0;
+
+uint32_t sdWalkTotal = 0;
+uint16_t sdWalksThisMin = 0;
+uint16_t sdWalksLastMin = 0;
+unsigned long sdWalkMinStartMs = 0;
+
+void sdWalk() {
+  unsigned long now = millis();
+  if (now - sdWalkMinStartMs >= 60000UL) {
+    sdWalksLastMin = (now - sdWalkMinStartMs < 120000UL) ? sdWalksThisMin : 0;
+    sdWalksThisMin = 0;
+    sdWalkMinStartMs = now;
+  }
+  sdWalkTotal++;
+  if (sdWalksThisMin < 65535) sdWalksThisMin++;
+}
+
+File sdOpen(const char *name, uint8_t mode = FILE_READ) {
+  sdWalk();
+  return SD.open(name, mode);
+}
+
+bool sdExists(const char *name) {
+  sdWalk();
+  return SD.exists(name);
+}
+
+bool sdRemove(const char *name) {
+  sdWalk();
+  return SD.remove(name);
+}
+
+void fhClose(const char *name) {
+  for (uint8_t i = 0; i < FH_SLOTS; i++) {
+    if (fhCache[i].name[0] && cmpIgnoreCase(fhCache[i].name, name) == 0) {
+      fhCache[i].f.close();
+      fhCache[i].name[0] = '\0';
+    }
+  }
+}
+
+void fhCloseAll() {
+  for (uint8_t i = 0; i < FH_SLOTS; i++) {
+    if (fhCache[i].name[0]) fhCache[i].f.close();
+    fhCache[i].name[0] = '\0';
+  }
+  for (uint8_t i = 0; i < ACK_CACHE_SLOTS; i++) ackCache[i].run[0] = '\0';
+}
+
+// Cached handle for name; append opens FILE_WRITE (which also reads). The caller
+// seeks before reading and never closes the handle. NULL if the file cannot be opened.
+File *fhOpen(const char *name, bool append) {
+  if (logOpen && logFile && cmpIgnoreCase(name, logFileName) == 0) return &logFile;
+  uint8_t victim = 0;
+  for (uint8_t i = 0; i < FH_SLOTS; i++) {
+    FileHandle &h = fhCache[i];
+    if (h.name[0] && cmpIgnoreCase(h.name, name) == 0) {
+      if (append && !h.append) {
+        h.f.close();
+        h.name[0] = '\0';
+        victim = i;
+        break;
+      }
+      h.lastUse = ++fhUseSeq;
+      fhHits++;
+      return &h.f;
+    }
+    if (!h.name[0]) victim = i;
+    else if (fhCache[victim].name[0] && h.lastUse < fhCache[victim].lastUse) victim = i;
+  }
+  FileHandle &h = fhCache[victim];
+  if (h.name[0]) h.f.close();
+  h.name[0] = '\0';
+  fhMisses++;
+  h.f = sdOpen(name, append ? FILE_WRITE : FILE_READ);
+  if (!h.f) return NULL;
+  safeCopy(h.name, sizeof(h.name), name);
+  h.append = append;
+  h.lastUse = ++fhUseSeq;
+  return &h.f;
+}
+
+AckCacheEntry *ackCacheFind(const char *run) {
+  for (uint8_t i = 0; i < ACK_CACHE_SLOTS; i++) {
+    if (ackCache[i].run[0] && cmpIgnoreCase(ackCache[i].run, run) == 0) {
+      ackCache[i].lastUse = ++fhUseSeq;
+      return &ackCache[i];
+    }
+  }
+  return NULL;
+}
+
+void ackCacheStore(const char *run, uint32_t byteOffset, uint32_t lineIndex, uint32_t syncEpoch) {
+  AckCacheEntry *e = ackCacheFind(run);
+  if (!e) {
+    e = &ackCache[0];
+    for (uint8_t i = 0; i < ACK_CACHE_SLOTS; i++) {
+      if (!ackCache[i].run[0]) { e = &ackCache[i]; break; }
+      if (ackCache[i].lastUse < e->lastUse) e = &ackCache[i];
+    }
+    safeCopy(e->run, sizeof(e->run), run);
+  }
+  e->byteOffset = byteOffset;
+  e->lineIndex = lineIndex;
+  e->syncEpoch = syncEpoch;
+  e->lastUse = ++fhUseSeq;
+}
+
+void ackCacheDrop(const char *run) {
+  AckCacheEntry *e = ackCacheFind(run);
+  if (e) e->run[0] = '\0';
+}
+
+void printSdStats() {
+  Serial.println(F("SDSTAT"));
+  Serial.print(F("DIR_WALKS=")); Serial.print(sdWalkTotal);
+  Serial.print(F(" LAST_MIN=")); Serial.print(sdWalksLastMin);
+  Serial.print(F(" THIS_MIN=")); Serial.println(sdWalksThisMin);
+  Serial.print(F("HANDLE_HITS=")); Serial.print(fhHits);
+  Serial.print(F(" MISSES=")); Serial.print(fhMisses);
+  Serial.print(F(" ACK_HITS=")); Serial.println(ackHits);
+  for (uint8_t i = 0; i < FH_SLOTS; i++) {
+    if (!fhCache[i].name[0]) continue;
+    Serial.print(F("OPEN ")); Serial.print(fhCache[i].name);
+    Serial.println(fhCache[i].append ? F(" rw") : F(" r"));
+  }
 }
 
 void setSdState(SdState st) {
@@ -633,6 +1694,11 @@ void setSdState(SdState st) {
   SdState prev = sdState;
   sdState = st;
   sdOk = (sdState == SD_READY);
+  if (!sdOk) {
+    fhCloseAll();
+    arcAbort();
+    journalReset();
+  }
   if (prev == SD_READY && sdState != SD_READY && run.active) {
     sdDisconnectNotice = true;
   }
@@ -652,7 +1718,7 @@ bool ensureSdReady(bool force) {
     setSdState(run.active ? SD_DEGRADED : SD_UNAVAILABLE);
     return false;
   }
-  File root = SD.open("/");
+  File root = sdOpen("/");
   if (!root) {
     setSdState(run.active ? SD_DEGRADED : SD_UNAVAILABLE);
     return false;
@@ -671,7 +1737,7 @@ bool checkSD() {
 
 void addInternalExperiments() {
   for (uint8_t i = 0; i < INTERNAL_COUNT && expFileCount < MAX_FILES; i++) {
-    safeCopy(expFiles[expFileCount], sizeof(expFiles[expFileCount]), INTERNAL_EXPS[i].name);
+    strncpy_P(expFiles[expFileCount], INTERNAL_EXPS[i].name, sizeof(expFiles[expFileCount]));
     expIsInternal[expFileCount] = true;
     expInternalIndex[expFileCount] = i;
     expFileCount++;
@@ -687,7 +1753,7 @@ bool hasCsvExt(const char *name) {
 void scanExperimentFiles() {
   expFileCount = 0;
   if (checkSD()) {
-    File root = SD.open("/");
+    File root = sdOpen("/");
     if (root) {
       root.rewindDirectory();
       while (true) {
@@ -715,6 +1781,10 @@ void scanExperimentFiles() {
 
 uint16_t parseUint(const char *s, uint16_t def) { if (!s||!*s) return def; return (uint16_t)strtoul(s, NULL, 10); }
 float parseFloat(const char *s, float def) { if (!s||!*s) return def; return atof(s); }
+// Whole number that fits a uint16_t; false for empty or out-of-range text
+bool parseU16(const char *s, uint16_t &out) { if (!s||!*s) return false; unsigned long n = strtoul(s, NULL, 10); if (n > 65535UL) return false; out = (uint16_t)n; return true; }
+// Tenths in a uint16_t: negative, NaN and out-of-range values clamp to 0..6553.5
+uint16_t parseTenths(const char *s) { float f = parseFloat(s, 0) * 10.0f; if (!(f > 0.0f)) return 0; return f >= 65535.0f ? 65535 : (uint16_t)f; }
 
 uint16_t parseStepUnitMs(const char *v) {
   if (!v || !*v) return (uint16_t)STEP_UNIT_MS_DEFAULT;
@@ -740,6 +1810,12 @@ void applyThermoOverride(const char *key, const char *val) {
     if (v <= 3) thermoCfg.heaterRelayBit = (uint8_t)v;
   } else if (cmpIgnoreCase(key, "THERMO_SAFETY_MAX_ON_S") == 0) {
     if (v <= 3600) thermoCfg.safetyMaxSecOn = v;
+  } else if (cmpIgnoreCase(key, "JOURNAL") == 0) {
+    journalEnabled = v != 0;
+  } else if (cmpIgnoreCase(key, "STREAM") == 0) {
+    streamEnabled = v != 0;
+  } else if (cmpIgnoreCase(key, "SD_BUDGET_MS") == 0) {
+    if (v >= 5 && v <= 500) sdProfiles.budgetMs = v;
   } else if (cmpIgnoreCase(key, "WIFI_ENABLE") == 0) {
     cloudCfg.enabled = (v ? 1 : 0);
   } else if (cmpIgnoreCase(key, "WIFI_SSID") == 0) {
@@ -759,11 +1835,12 @@ void applyThermoOverride(const char *key, const char *val) {
 
 bool loadConfigOverridesFromSD() {
   if (!ensureSdReady(false)) return false;
-  File cfg = SD.open("CONFIG.CSV", FILE_READ);
+  File cfg = sdOpen("CONFIG.CSV", FILE_READ);
   if (!cfg) return false;
-  char line[128];
+  char *line = scratchAlloc(SCRATCH_LINE);
+  if (!line) { cfg.close(); return false; }
   while (cfg.available()) {
-    size_t n = cfg.readBytesUntil('\n', line, sizeof(line) - 1);
+    size_t n = cfg.readBytesUntil('\n', line, SCRATCH_LINE - 1);
     line[n] = '\0';
     while (n && (line[n - 1] == '\r' || line[n - 1] == '\n')) line[--n] = '\0';
     if (n == 0 || line[0] == '#') continue;
@@ -776,6 +1853,7 @@ bool loadConfigOverridesFromSD() {
     applyThermoOverride(k, v);
   }
   cfg.close();
+  scratchRelease(line);
   return true;
 }
 
@@ -787,26 +1865,41 @@ void loadThermoConfigChain() {
   if (!cloudConfigValid()) cloudCfg.enabled = 0;
 }
 
+void applyMetaKey(const char *k, const char *v) {
+  if (cmpIgnoreCase(k, "ID") == 0) safeCopy(meta.id, sizeof(meta.id), v);
+  else if (cmpIgnoreCase(k, "PROGRAM") == 0) meta.program = (uint8_t)parseUint(v, 1);
+  else if (cmpIgnoreCase(k, "RETRIEVALS") == 0 || cmpIgnoreCase(k, "RETIRADAS") == 0) meta.retrievals = (uint8_t)parseUint(v, 0);
+  else if (cmpIgnoreCase(k, "INTERVAL_MIN") == 0 || cmpIgnoreCase(k, "INTERVALO") == 0) meta.intervalMin = parseUint(v, 0);
+  else if (cmpIgnoreCase(k, "STEP_UNIT") == 0 || cmpIgnoreCase(k, "STEP_UNIT_MS") == 0 || cmpIgnoreCase(k, "UNIDADE") == 0) meta.stepUnitMs = parseStepUnitMs(v);
+  else if (cmpIgnoreCase(k, "LOG_FAST_MS") == 0) {
+    uint16_t ms;
+    if (parseU16(v, ms) && ms >= LOG_PERIOD_MIN_MS) meta.logFastMs = ms;
+  } else if (cmpIgnoreCase(k, "LOG_SLOW_S") == 0) {
+    uint16_t sec;
+    if (parseU16(v, sec) && sec >= 1 && sec <= 3600) meta.logSlowS = sec;
+  } else if (cmpIgnoreCase(k, "LOG_FAST_WINDOW_S") == 0) {
+    uint16_t sec;
+    if (parseU16(v, sec)) meta.logFastWindowS = sec;
+  } else if (cmpIgnoreCase(k, "LOG_SLOPE_C_MIN") == 0) meta.logSlope10 = parseTenths(v);
+  else if (cmpIgnoreCase(k, "LOG_DB_T") == 0) meta.logDbT10 = parseTenths(v);
+  else if (cmpIgnoreCase(k, "LOG_DB_H") == 0) meta.logDbH10 = parseTenths(v);
+  else if (cmpIgnoreCase(k, "LOG_MAX_GAP_S") == 0) {
+    uint16_t sec;
+    if (parseU16(v, sec)) meta.logMaxGapS = sec;
+  }
+}
+
 void parseMetaLine(char *line) {
   char *eq = strchr(line, '=');
   if (eq) {
     *eq = '\0';
-    const char *k = line; const char *v = eq + 1;
-    if (cmpIgnoreCase(k, "ID") == 0) safeCopy(meta.id, sizeof(meta.id), v);
-    else if (cmpIgnoreCase(k, "PROGRAM") == 0) meta.program = (uint8_t)parseUint(v, 1);
-    else if (cmpIgnoreCase(k, "RETRIEVALS") == 0 || cmpIgnoreCase(k, "RETIRADAS") == 0) meta.retrievals = (uint8_t)parseUint(v, 0);
-    else if (cmpIgnoreCase(k, "INTERVAL_MIN") == 0 || cmpIgnoreCase(k, "INTERVALO") == 0) meta.intervalMin = parseUint(v, 0);
-    else if (cmpIgnoreCase(k, "STEP_UNIT") == 0 || cmpIgnoreCase(k, "STEP_UNIT_MS") == 0 || cmpIgnoreCase(k, "UNIDADE") == 0) meta.stepUnitMs = parseStepUnitMs(v);
+    applyMetaKey(line, eq + 1);
     return;
   }
   char *first = strtok(line, ",");
   char *second = strtok(NULL, ",");
   if (!first || !second) return;
-  if (cmpIgnoreCase(first, "ID") == 0) safeCopy(meta.id, sizeof(meta.id), second);
-  else if (cmpIgnoreCase(first, "PROGRAM") == 0) meta.program = (uint8_t)parseUint(second, 1);
-  else if (cmpIgnoreCase(first, "RETRIEVALS") == 0 || cmpIgnoreCase(first, "RETIRADAS") == 0) meta.retrievals = (uint8_t)parseUint(second, 0);
-  else if (cmpIgnoreCase(first, "INTERVAL_MIN") == 0 || cmpIgnoreCase(first, "INTERVALO") == 0) meta.intervalMin = parseUint(second, 0);
-  else if (cmpIgnoreCase(first, "STEP_UNIT") == 0 || cmpIgnoreCase(first, "STEP_UNIT_MS") == 0 || cmpIgnoreCase(first, "UNIDADE") == 0) meta.stepUnitMs = parseStepUnitMs(second);
+  applyMetaKey(first, second);
 }
 
 bool parseStepLine(char *line, StepData &out) {
@@ -825,6 +1918,21 @@ bool parseStepLine(char *line, StepData &out) {
   return true;
 }
 
+void resetMeta() {
+  meta = {};
+  meta.program = 1;
+  meta.stepCount = 0;
+  meta.stepUnitMs = (uint16_t)STEP_UNIT_MS_DEFAULT;
+  // Adaptive logging defaults to the fixed legacy period until a program opts in
+  meta.logFastMs = (uint16_t)LOG_PERIOD_MS;
+  meta.logSlowS = (uint16_t)(LOG_PERIOD_MS / 1000UL);
+  meta.logFastWindowS = 0;
+  meta.logSlope10 = 0;
+  meta.logDbT10 = 0;
+  meta.logDbH10 = 0;
+  meta.logMaxGapS = 600;
+}
+
 void resetStepCache() {
   stepCacheCount = 0;
   stepCacheIndex = 0;
@@ -834,34 +1942,34 @@ void resetStepCache() {
 bool loadExperiment(const char *fileName) {
   if (!hasCsvExt(fileName)) return false;
   if (!ensureSdReady(false)) return false;
-  File f = SD.open(fileName, FILE_READ);
+  File f = sdOpen(fileName, FILE_READ);
   if (!f) return false;
-  meta = {};
-  meta.program = 1;
-  meta.stepCount = 0;
-  meta.stepUnitMs = (uint16_t)STEP_UNIT_MS_DEFAULT;
+  resetMeta();
   resetStepCache();
-  char line[96];
+  char *tmp = scratchAlloc(SCRATCH_LINE);
+  if (!tmp) { f.close(); return false; }
+  bool ok = true;
   while (f.available()) {
-    size_t n = f.readBytesUntil('\n', line, sizeof(line) - 1);
-    line[n] = '\0';
-    while (n && (line[n-1] == '\r' || line[n-1] == '\n')) line[--n] = '\0';
-    if (n == 0 || line[0] == '#') continue;
-    char tmp[96]; strncpy(tmp, line, sizeof(tmp) - 1); tmp[95] = '\0';
+    size_t n = f.readBytesUntil('\n', tmp, SCRATCH_LINE - 1);
+    tmp[n] = '\0';
+    while (n && (tmp[n-1] == '\r' || tmp[n-1] == '\n')) tmp[--n] = '\0';
+    if (n == 0 || tmp[0] == '#') continue;
     bool isMeta = false;
     if (strchr(tmp, '=')) isMeta = true;
     if (strncmp(tmp, "ID", 2) == 0 || strncmp(tmp, "PROGRAM", 7) == 0 || strncmp(tmp, "RETRIEVAL", 9) == 0 ||
-        strncmp(tmp, "RETIRADAS", 9) == 0 || strncmp(tmp, "INTERVAL", 8) == 0) isMeta = true;
+        strncmp(tmp, "RETIRADAS", 9) == 0 || strncmp(tmp, "INTERVAL", 8) == 0 || strncmp(tmp, "LOG_", 4) == 0) isMeta = true;
     if (isMeta) parseMetaLine(tmp);
     else {
       StepData st;
       if (parseStepLine(tmp, st)) {
-        if (stepCacheCount >= MAX_STEPS) { f.close(); return false; }
+        if (stepCacheCount >= MAX_STEPS) { ok = false; break; }
         stepCache[stepCacheCount++] = st;
       }
     }
   }
   f.close();
+  scratchRelease(tmp);
+  if (!ok) return false;
   safeCopy(currentFile, sizeof(currentFile), fileName);
   currentSource = SRC_SD;
   meta.stepCount = stepCacheCount;
@@ -871,32 +1979,31 @@ bool loadExperiment(const char *fileName) {
 
 bool loadExperimentInternal(uint8_t idx) {
   if (idx >= INTERNAL_COUNT) return false;
-  meta = {};
-  meta.program = 1;
-  meta.stepCount = 0;
-  meta.stepUnitMs = (uint16_t)STEP_UNIT_MS_DEFAULT;
+  resetMeta();
   resetStepCache();
-  const char *const *lines = INTERNAL_EXPS[idx].lines;
-  for (uint16_t i = 0; lines[i]; i++) {
-    char tmp[96];
-    strncpy(tmp, lines[i], sizeof(tmp) - 1);
-    tmp[95] = '\0';
+  char *tmp = scratchAlloc(SCRATCH_LINE);
+  if (!tmp) return false;
+  bool ok = true;
+  PGM_P text = (PGM_P)pgm_read_ptr(&INTERNAL_EXPS[idx].text);
+  while ((text = nextFlashLine(text, tmp, SCRATCH_LINE)) != NULL) {
     if (tmp[0] == '\0' || tmp[0] == '#') continue;
     bool isMeta = false;
     if (strchr(tmp, '=')) isMeta = true;
     if (strncmp(tmp, "ID", 2) == 0 || strncmp(tmp, "PROGRAM", 7) == 0 || strncmp(tmp, "RETRIEVAL", 9) == 0 ||
         strncmp(tmp, "RETIRADAS", 9) == 0 || strncmp(tmp, "INTERVAL", 8) == 0 || strncmp(tmp, "STEP_UNIT", 9) == 0 ||
-        strncmp(tmp, "UNIDADE", 7) == 0) isMeta = true;
+        strncmp(tmp, "UNIDADE", 7) == 0 || strncmp(tmp, "LOG_", 4) == 0) isMeta = true;
     if (isMeta) parseMetaLine(tmp);
     else {
       StepData st;
       if (parseStepLine(tmp, st)) {
-        if (stepCacheCount >= MAX_STEPS) return false;
+        if (stepCacheCount >= MAX_STEPS) { ok = false; break; }
         stepCache[stepCacheCount++] = st;
       }
     }
   }
-  safeCopy(currentFile, sizeof(currentFile), INTERNAL_EXPS[idx].name);
+  scratchRelease(tmp);
+  if (!ok) return false;
+  strncpy_P(currentFile, INTERNAL_EXPS[idx].name, sizeof(currentFile));
   currentSource = SRC_INT;
   currentInternalIndex = idx;
   meta.stepCount = stepCacheCount;
@@ -911,18 +2018,60 @@ bool openRunFile() {
   return stepCacheReady;
 }
 
+uint32_t countLinesFrom(const char *name, uint32_t offset);
+void logFlush();
+
+// Rows in a run file from its last known flush point; the whole file when the
+// card holds less than that (replaced or rewritten)
+uint32_t logRowsInFile(const char *name, uint32_t syncedBytes, uint32_t syncedRows) {
+  File f = sdOpen(name, FILE_READ);
+  uint32_t size = f ? f.size() : 0;
+  if (f) f.close();
+  if (syncedBytes && size >= syncedBytes) return syncedRows + countLinesFrom(name, syncedBytes);
+  uint32_t lines = countLinesFrom(name, 0);
+  return lines ? lines - 1 : 0;   // header
+}
+
+// A write torn by an SD drop can leave a line without its newline; terminate it so
+// it stays one (unreadable) row and the next row starts on its own line
+void logEndLine(File &f) {
+  uint32_t size = f.size();
+  if (size == 0) return;
+  uint8_t last = '\n';
+  if (f.seek(size - 1)) last = (uint8_t)f.read();
+  f.seek(size);
+  if (last != '\n') f.println();
+}
+
 bool openLogFile() {
   if (!ensureSdReady(false)) return false;
-  for (uint8_t i = 1; i < 99; i++) {
-    char name[13];
-    snprintf(name, sizeof(name), "RUN%02u.CSV", i);
-    if (!SD.exists(name)) {
-      logFile = SD.open(name, FILE_WRITE);
-      if (!logFile) {
-        setSdState(run.active ? SD_DEGRADED : SD_UNAVAILABLE);
+  // Same run keeps its file (resume after reset, SD reinsert); FILE_WRITE appends.
+  // A cached read handle would not see the appends, so the log handle replaces it.
+  if (logFileName[0]) fhClose(logFileName);
+  if (logFileName[0] && sdExists(logFileName)) {
+    logFileRows = logRowsInFile(logFileName, logSyncedBytes, logSyncedRows);
+    logFile = sdOpen(logFileName, FILE_WRITE);
+    if (!logFile) {
+      setSdState(run.active ? SD_DEGRADED : SD_UNAVAILABLE);
+      return false;
+    }
+    logEndLine(logFile);
+    logOpen = true;
+    return true;
+  }
+  for (uint16_t i = arcNextRunNo(); i <= RUN_NO_MAX; i++) {
+    char name[13];
+    snprintf_P(name, sizeof(name), PSTR("RUN%02u.CSV"), i);
+    if (!sdExists(name)) {
+      logFile = sdOpen(name, FILE_WRITE);
+      if (!logFile) {
+        setSdState(run.active ? SD_DEGRADED : SD_UNAVAILABLE);
         return false;
       }
-      logFile.println("ms;T1;U1;T2;U2;Tavg;Uavg;mask;step");
+      logFile.println(F("ms;T1;U1;T2;U2;Tavg;Uavg;mask;step;epoch"));
+      safeCopy(logFileName, sizeof(logFileName), name);
+      logFileRows = 0;
+      logFlush();
       logOpen = true;
       return true;
     }
@@ -936,93 +2085,395 @@ bool readNextStep(StepData &st) {
   return true;
 }
 
+// The EEPROM spill survives a reset, so it is not cleared here
 void resetLogQueue() {
-  logHead = 0;
-  logTail = 0;
-  logCount = 0;
-  droppedLogsCount = 0;
+  logQueue.clear();
+  logQueue.resetStats();
+  logDroppedCount = 0;
+  logSpilledCount = 0;
 }
 
-void queueLogRecord(const LogRecord &rec) {
-  if (logCount >= LOG_BACKLOG_CAP) {
-    logHead = (uint8_t)((logHead + 1) % LOG_BACKLOG_CAP);
-    logCount--;
-    droppedLogsCount++;
-  }
-  logQueue[logTail] = rec;
-  logTail = (uint8_t)((logTail + 1) % LOG_BACKLOG_CAP);
-  logCount++;
+void liveRingDropThrough(uint32_t lineIndex) {
+  while (!liveRing.empty() && liveRing.peek().lineIndex <= lineIndex) liveRing.drop();
 }
 
-bool popLogRecord(LogRecord &out) {
-  if (logCount == 0) return false;
-  out = logQueue[logHead];
-  logHead = (uint8_t)((logHead + 1) % LOG_BACKLOG_CAP);
-  logCount--;
-  return true;
+// Numbers a row for the run file and tees it to the live lane
+void enqueueLogRow(LogRecord rec) {
+  rec.lineIndex = ++logLineSeq;
+  if (logQueue.full()) {
+    // Oldest row goes to the EEPROM spill instead of being dropped
+    LogRecord oldest;
+    logQueue.pop(oldest);
+    if (spillPush(oldest)) logSpilledCount++;
+    else logDroppedCount++;
+  }
+  logQueue.push(rec);
+  liveRing.push(rec);
+  journalStepNote(rec);
 }
 
-void printScaled10(int16_t val) {
+void printScaled10(File &out, int16_t val) {
   bool neg = val < 0;
   uint16_t a = (uint16_t)(neg ? -val : val);
-  if (neg) logFile.print('-');
-  logFile.print((int)(a / 10));
-  logFile.print('.');
-  logFile.print((int)(a % 10));
+  if (neg) out.print('-');
+  out.print((int)(a / 10));
+  out.print('.');
+  out.print((int)(a % 10));
+}
+
+void printEpoch(Print &out, uint32_t epoch, uint16_t epochMs) {
+  out.print(epoch);
+  if (epoch == 0) return;
+  out.print('.');
+  if (epochMs < 100) out.print('0');
+  if (epochMs < 10) out.print('0');
+  out.print(epochMs);
+}
+
+bool writeLogRow(File &out, const LogRecord &rec) {
+  out.print(rec.ms);
+  out.print(';');
+  printScaled10(out, rec.t1_10);
+  out.print(';');
+  printScaled10(out, rec.h1_10);
+  out.print(';');
+  printScaled10(out, rec.t2_10);
+  out.print(';');
+  printScaled10(out, rec.h2_10);
+  out.print(';');
+  printScaled10(out, rec.tAvg_10);
+  out.print(';');
+  printScaled10(out, rec.hAvg_10);
+  out.print(';');
+  out.print(rec.mask);
+  out.print(';');
+  out.print(rec.step);
+  out.print(';');
+  printEpoch(out, rec.epoch, rec.epochMs);
+  out.println();
+  return (bool)out;
+}
+
+// Row n of a run file is always lineIndex n: a row that never reached the file (RAM
+// and spill both full, or unflushed at a reset) leaves a LOG_GAP_ROW line in its
+// place. Rows at or below rows are already in the file and are not written again.
+const char LOG_GAP_ROW = '-';
+
+bool writeLogRowAt(File &out, uint32_t &rows, const LogRecord &rec) {
+  while (rows + 1 < rec.lineIndex) {
+    out.println(LOG_GAP_ROW);
+    if (!out) return false;
+    rows++;
+  }
+  if (!writeLogRow(out, rec)) return false;
+  rows = rec.lineIndex;
+  return true;
 }
 
 bool writeLogRecord(const LogRecord &rec) {
   if (!logOpen || !logFile) return false;
-  logFile.print(rec.ms);
-  logFile.print(';');
-  printScaled10(rec.t1_10);
-  logFile.print(';');
-  printScaled10(rec.h1_10);
-  logFile.print(';');
-  printScaled10(rec.t2_10);
-  logFile.print(';');
-  printScaled10(rec.h2_10);
-  logFile.print(';');
-  printScaled10(rec.tAvg_10);
-  logFile.print(';');
-  printScaled10(rec.hAvg_10);
-  logFile.print(';');
-  logFile.print(rec.mask);
-  logFile.print(';');
-  logFile.println(rec.step);
-  return (bool)logFile;
+  if (rec.lineIndex <= logFileRows) return true;
+  if (!writeLogRowAt(logFile, logFileRows, rec)) return false;
+  journalSample(logFileName, rec);
+  return true;
+}
+
+void logFlush() {
+  logFile.flush();
+  logSyncedBytes = logFile.size();
+  logSyncedRows = logFileRows;
+}
+
+// ===== Log spill =====
+// Second backlog tier for SD outages: rows pushed out of the full RAM ring are
+// packed into spare EEPROM and written back to their run file, oldest first, once
+// the card returns. Slots are used round-robin, so wear spreads over the area, and
+// the contents survive a reset. Only rows of one run file are held at a time.
+// The area sits between the health store and the SD card profiles.
+// A slot holds line and time as offsets from the first spilled row and the step as
+// its index in the step table. It is staged in RAM and written a byte per pass as
+// the EEPROM becomes ready (3.3 ms per byte), its line offset last, so the logger
+// never waits on it and a reset mid-slot leaves the slot empty.
+struct SpillHeader {
+  uint16_t magic;
+  char runFile[13];
+  char expFile[13];       // experiment the step indexes refer to
+  uint32_t syncedBytes;   // runFile size and rows at its last flush before the spill
+  uint32_t syncedRows;
+  uint32_t baseLine;      // first spilled row of the episode
+  uint32_t baseMs;
+  uint32_t baseEpoch;     // 0 = clock unknown at the first row
+  uint16_t baseEpochMs;
+};
+struct SpillRecord {      // 20 bytes
+  uint32_t dMs;           // ms - baseMs
+  int16_t t1_10;
+  int16_t h1_10;
+  int16_t t2_10;
+  int16_t h2_10;
+  int16_t tAvg_10;
+  int16_t hAvg_10;
+  uint8_t mask;
+  uint8_t step;           // stepCache index, SPILL_STEP_NONE if not found
+  uint16_t dLine;         // lineIndex - baseLine; SPILL_EMPTY marks a free slot
+};
+
+static_assert(sizeof(SpillRecord) == 20, "SpillRecord must stay unpadded");
+
+const uint16_t SPILL_MAGIC = 0x5351; // "SQ"; older "SP" layouts are ignored
+const uint16_t SPILL_EMPTY = 0xFFFF;
+const uint8_t SPILL_STEP_NONE = 0xFF;
+const int SPILL_ADDR = (HEALTH_ADDR + (int)sizeof(HealthStore) + 31) & ~31;
+const int SPILL_END = SDP_ADDR;
+const uint8_t SPILL_SLOTS = (uint8_t)((SPILL_END - SPILL_ADDR - (int)sizeof(SpillHeader)) / (int)sizeof(SpillRecord));
+SpillHeader spillHdr = {};
+uint8_t spillHead = 0;
+uint8_t spillCount = 0;          // complete slots
+bool spillStaged = false;        // one more row being written behind them
+uint8_t spillStagePos = 0;
+SpillRecord spillStage;
+
+int spillSlotAddr(uint8_t slot) {
+  return SPILL_ADDR + (int)sizeof(SpillHeader) + (int)slot * (int)sizeof(SpillRecord);
+}
+
+uint8_t spillNextSlot(uint8_t slot) {
+  return (uint8_t)((slot + 1 < SPILL_SLOTS) ? slot + 1 : 0);
+}
+
+uint8_t spillSlotAfter(uint8_t n) {
+  uint8_t slot = spillHead;
+  for (uint8_t i = 0; i < n; i++) slot = spillNextSlot(slot);
+  return slot;
+}
+
+// Boot: rebuilds head/count from the slots; the oldest row has the lowest line offset
+void spillScan() {
+  spillCount = 0;
+  spillHead = 0;
+  spillStaged = false;
+  EEPROM.get(SPILL_ADDR, spillHdr);
+  if (spillHdr.magic != SPILL_MAGIC) {
+    memset(&spillHdr, 0, sizeof(spillHdr));
+    return;
+  }
+  spillHdr.runFile[sizeof(spillHdr.runFile) - 1] = '\0';
+  spillHdr.expFile[sizeof(spillHdr.expFile) - 1] = '\0';
+  uint16_t oldest = SPILL_EMPTY;
+  for (uint8_t i = 0; i < SPILL_SLOTS; i++) {
+    uint16_t line;
+    EEPROM.get(spillSlotAddr(i) + (int)offsetof(SpillRecord, dLine), line);
+    if (line == SPILL_EMPTY) continue;
+    spillCount++;
+    if (line < oldest) { oldest = line; spillHead = i; }
+  }
+  if (spillCount) {
+    Serial.print(F("SPILL ")); Serial.print(spillCount); Serial.print(F(" rows for ")); Serial.println(spillHdr.runFile);
+  }
+}
+
+// Writes staged bytes while the EEPROM is idle; never waits for it
+void spillWriteTick() {
+  if (!spillStaged) return;
+  const uint8_t *p = (const uint8_t*)&spillStage;
+  int addr = spillSlotAddr(spillSlotAfter(spillCount));
+  while (spillStagePos < sizeof(spillStage) && eeprom_is_ready()) {
+    EEPROM.update(addr + spillStagePos, p[spillStagePos]);
+    spillStagePos++;
+  }
+  if (spillStagePos < sizeof(spillStage)) return;
+  spillStaged = false;
+  spillCount++;
+}
+
+void spillStageFinish() {
+  while (spillStaged) spillWriteTick();
+}
+
+// Step table index of a logged label, searched back from the running step
+uint8_t spillStepIndex(const char *label) {
+  for (uint16_t i = min(stepCacheIndex, stepCacheCount); i-- > 0;) {
+    if (strcmp(stepCache[i].label, label) == 0) return i < SPILL_STEP_NONE ? (uint8_t)i : SPILL_STEP_NONE;
+  }
+  return SPILL_STEP_NONE;
+}
+
+bool spillPush(const LogRecord &rec) {
+  if (!logFileName[0]) return false;
+  spillStageFinish();
+  if (spillCount >= SPILL_SLOTS) return false;
+  bool fresh = spillCount == 0;
+  if (!fresh && (strcmp(spillHdr.runFile, logFileName) != 0 || rec.lineIndex - spillHdr.baseLine >= SPILL_EMPTY)) return false;
+  if (fresh || spillHdr.syncedRows != logSyncedRows) {
+    // Where the file stood, so the rows can be placed if the run ends before the drain
+    spillHdr.magic = SPILL_MAGIC;
+    safeCopy(spillHdr.runFile, sizeof(spillHdr.runFile), logFileName);
+    safeCopy(spillHdr.expFile, sizeof(spillHdr.expFile), currentFile);
+    spillHdr.syncedBytes = logSyncedBytes;
+    spillHdr.syncedRows = logSyncedRows;
+    if (fresh) {
+      spillHdr.baseLine = rec.lineIndex;
+      spillHdr.baseMs = rec.ms;
+      spillHdr.baseEpoch = rec.epoch;
+      spillHdr.baseEpochMs = rec.epochMs;
+    }
+    EEPROM.put(SPILL_ADDR, spillHdr);
+  }
+  SpillRecord &r = spillStage;
+  r.dMs = rec.ms - spillHdr.baseMs;
+  r.t1_10 = rec.t1_10;
+  r.h1_10 = rec.h1_10;
+  r.t2_10 = rec.t2_10;
+  r.h2_10 = rec.h2_10;
+  r.tAvg_10 = rec.tAvg_10;
+  r.hAvg_10 = rec.hAvg_10;
+  r.mask = rec.mask;
+  r.step = spillStepIndex(rec.step);
+  r.dLine = (uint16_t)(rec.lineIndex - spillHdr.baseLine);
+  spillStagePos = 0;
+  spillStaged = true;
+  spillWriteTick();
+  return true;
+}
+
+void spillPeek(LogRecord &rec) {
+  SpillRecord r;
+  EEPROM.get(spillSlotAddr(spillHead), r);
+  rec.lineIndex = spillHdr.baseLine + r.dLine;
+  rec.ms = spillHdr.baseMs + r.dMs;
+  rec.epoch = 0;
+  rec.epochMs = 0;
+  if (spillHdr.baseEpoch) {
+    uint32_t ms = spillHdr.baseEpochMs + r.dMs;
+    rec.epoch = spillHdr.baseEpoch + ms / 1000UL;
+    rec.epochMs = (uint16_t)(ms % 1000UL);
+  }
+  rec.t1_10 = r.t1_10;
+  rec.h1_10 = r.h1_10;
+  rec.t2_10 = r.t2_10;
+  rec.h2_10 = r.h2_10;
+  rec.tAvg_10 = r.tAvg_10;
+  rec.hAvg_10 = r.hAvg_10;
+  rec.mask = r.mask;
+  // The label comes back from the step table when the same experiment is loaded
+  if (r.step < stepCacheCount && strcmp(spillHdr.expFile, currentFile) == 0) {
+    safeCopy(rec.step, sizeof(rec.step), stepCache[r.step].label);
+  } else if (r.step != SPILL_STEP_NONE) {
+    snprintf_P(rec.step, sizeof(rec.step), PSTR("#%u"), (unsigned)r.step + 1);
+  } else {
+    safeCopy(rec.step, sizeof(rec.step), "?");
+  }
+}
+
+void spillDropHead() {
+  EEPROM.put(spillSlotAddr(spillHead) + (int)offsetof(SpillRecord, dLine), SPILL_EMPTY);
+  spillHead = spillNextSlot(spillHead);
+  spillCount--;
+}
+
+// Row number of the newest spilled row; call only with rows pending
+uint32_t spillLastLine() {
+  spillStageFinish();
+  uint16_t line;
+  EEPROM.get(spillSlotAddr(spillSlotAfter(spillCount - 1)) + (int)offsetof(SpillRecord, dLine), line);
+  return spillHdr.baseLine + line;
+}
+
+// Spilled rows still owed to the given run file
+uint8_t spillPendingFor(const char *runFile) {
+  uint8_t n = spillCount + (spillStaged ? 1 : 0);
+  return (n && strcmp(spillHdr.runFile, runFile) == 0) ? n : 0;
+}
+
+// Appends up to maxRows spilled rows to their run file: the open log when it is the
+// same file, otherwise a short-lived handle. false = the card write failed.
+bool spillDrain(uint8_t maxRows) {
+  spillStageFinish();
+  if (spillCount == 0) return true;
+  const char *spillRun = spillHdr.runFile;
+  bool useLog = logOpen && logFile && strcmp(spillRun, logFileName) == 0;
+  File other;
+  uint32_t otherRows = 0;
+  if (!useLog) {
+    if (!ensureSdReady(false)) return false;
+    otherRows = logRowsInFile(spillRun, spillHdr.syncedBytes, spillHdr.syncedRows);
+    other = sdOpen(spillRun, FILE_WRITE);
+    if (!other) return false;
+    logEndLine(other);
+  }
+  File &out = useLog ? logFile : other;
+  uint32_t &rows = useLog ? logFileRows : otherRows;
+  bool ok = true;
+  for (uint8_t i = 0; i < maxRows && spillCount > 0; i++) {
+    LogRecord rec;
+    spillPeek(rec);
+    if (rec.lineIndex > rows) {
+      if (!writeLogRowAt(out, rows, rec)) { ok = false; break; }
+      journalSample(spillRun, rec);
+    }
+    spillDropHead();
+  }
+  if (!useLog) other.close();
+  else if (ok) logFlush();
+  journalFlush();
+  return ok;
 }
 
 void processLogFlush() {
-  if (logCount == 0) return;
+  if (logQueue.empty() && spillCount == 0 && !spillStaged) return;
   unsigned long now = millis();
   if (now - lastFlushTryMs < LOG_FLUSH_INTERVAL_MS) return;
   lastFlushTryMs = now;
 
+  // Spilled rows are older than anything in RAM and go out first
+  if (spillCount > 0 || spillStaged) {
+    if (!logOpen && spillPendingFor(logFileName) && !openLogFile()) return;
+    if (!spillDrain(max(sdBurstRows(true), (uint8_t)1))) {
+      if (logOpen) { logFile.close(); logOpen = false; }
+      setSdState(run.active ? SD_DEGRADED : SD_UNAVAILABLE);
+      return;
+    }
+    if (spillCount > 0 || logQueue.empty()) return;
+  }
+
   if (!logOpen) {
     if (!openLogFile()) return;
   }
 
-  for (uint8_t i = 0; i < LOG_FLUSH_BURST && logCount > 0; i++) {
+  // A flush that is due goes first; on a card too slow for the budget it gets the pass alone
+  bool flushDue = logUnflushedRows >= sdFlushEvery() ||
+    (logUnflushedRows > 0 && now - logUnflushedSinceMs >= LOG_FLUSH_MAX_AGE_MS);
+  if (flushDue) {
+    uint8_t burst = sdBurstRows(true);
+    unsigned long t0 = millis();
+    logFlush();
+    journalFlush();
+    sdNoteFlush(millis() - t0);
+    logUnflushedRows = 0;
+    if (burst == 0) return;
+  }
+  uint8_t burst = sdBurstRows(false);
+  if (logUnflushedRows + burst > LOG_UNFLUSHED_MAX) burst = (uint8_t)(LOG_UNFLUSHED_MAX - logUnflushedRows);
+  for (uint8_t i = 0; i < burst; i++) {
     LogRecord rec;
-    if (!popLogRecord(rec)) break;
+    if (!logQueue.pop(rec)) break;
+    unsigned long t0 = micros();
     if (!writeLogRecord(rec)) {
-      queueLogRecord(rec);
+      logQueue.unpop(rec);
       if (logOpen) { logFile.close(); logOpen = false; }
       setSdState(run.active ? SD_DEGRADED : SD_UNAVAILABLE);
       return;
     }
-  }
-
-  if (++logFlushCounter >= LOG_FLUSH_EVERY) {
-    logFile.flush();
-    logFlushCounter = 0;
+    sdNoteWrite(micros() - t0);
+    if (logUnflushedRows++ == 0) logUnflushedSinceMs = millis();
   }
 }
 
 struct TelemetryRow {
   uint32_t lineIndex;
   uint32_t ms;
+  uint32_t epoch;
+  uint16_t epochMs;
   char t1[10];
   char u1[10];
   char t2[10];
@@ -1045,11 +2496,11 @@ struct EventUploadRow {
   uint16_t step;
 };
 
-bool appendFmt(char *buf, size_t cap, size_t &len, const char *fmt, ...) {
+bool appendFmt(char *buf, size_t cap, size_t &len, PGM_P fmt, ...) {
   if (len >= cap) return false;
   va_list ap;
   va_start(ap, fmt);
-  int n = vsnprintf(buf + len, cap - len, fmt, ap);
+  int n = vsnprintf_P(buf + len, cap - len, fmt, ap);
   va_end(ap);
   if (n < 0) return false;
   if ((size_t)n >= cap - len) return false;
@@ -1061,11 +2512,11 @@ void getRtcIso(char *out, size_t outSize) {
   if (!out || outSize == 0) return;
   if (rtcOk) {
     DateTime dt = rtc.now();
-    snprintf(out, outSize, "%04u-%02u-%02uT%02u:%02u:%02uZ",
+    snprintf_P(out, outSize, PSTR("%04u-%02u-%02uT%02u:%02u:%02uZ"),
       (unsigned)dt.year(), (unsigned)dt.month(), (unsigned)dt.day(),
       (unsigned)dt.hour(), (unsigned)dt.minute(), (unsigned)dt.second());
   } else {
-    snprintf(out, outSize, "1970-01-01T00:00:00Z");
+    snprintf_P(out, outSize, PSTR("1970-01-01T00:00:00Z"));
   }
 }
 
@@ -1127,18 +2578,30 @@ bool syncIndexLoad(const char *csvName, UploadCursor &cursor) {
   char ackName[13];
   ackNameFromCsv(csvName, ackName, sizeof(ackName));
   if (!ensureSdReady(false)) return false;
-  File ack = SD.open(ackName, FILE_READ);
-  if (!ack) return true;
-  char line[48];
-  size_t n = ack.readBytesUntil('\n', line, sizeof(line) - 1);
-  line[n] = '\0';
-  ack.close();
-  char *a = strtok(line, ",");
-  char *b = strtok(NULL, ",");
-  char *c = strtok(NULL, ",");
-  if (a) cursor.byteOffset = strtoul(a, NULL, 10);
-  if (b) cursor.lineIndex = strtoul(b, NULL, 10);
-  if (c) lastCloudSyncEpoch = strtoul(c, NULL, 10);
+  AckCacheEntry *e = ackCacheFind(csvName);
+  if (e) {
+    ackHits++;
+    cursor.byteOffset = e->byteOffset;
+    cursor.lineIndex = e->lineIndex;
+    if (e->syncEpoch) lastCloudSyncEpoch = e->syncEpoch;
+    return true;
+  }
+  File ack = sdOpen(ackName, FILE_READ);
+  uint32_t syncEpoch = 0;
+  if (ack) {
+    char line[48];
+    size_t n = ack.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[n] = '\0';
+    ack.close();
+    char *a = strtok(line, ",");
+    char *b = strtok(NULL, ",");
+    char *c = strtok(NULL, ",");
+    if (a) cursor.byteOffset = strtoul(a, NULL, 10);
+    if (b) cursor.lineIndex = strtoul(b, NULL, 10);
+    if (c) syncEpoch = strtoul(c, NULL, 10);
+    if (syncEpoch) lastCloudSyncEpoch = syncEpoch;
+  }
+  ackCacheStore(csvName, cursor.byteOffset, cursor.lineIndex, syncEpoch);
   return true;
 }
 
@@ -1146,28 +2609,37 @@ bool syncIndexSave(const UploadCursor &cursor) {
   if (!ensureSdReady(false)) return false;
   char ackName[13];
   ackNameFromCsv(cursor.runFile, ackName, sizeof(ackName));
-  if (SD.exists(ackName)) SD.remove(ackName);
-  File ack = SD.open(ackName, FILE_WRITE);
-  if (!ack) return false;
+  File ack = sdOpen(ackName, O_WRITE | O_CREAT | O_TRUNC);
+  if (!ack) {
+    ackCacheDrop(cursor.runFile);
+    return false;
+  }
   ack.print(cursor.byteOffset);
   ack.print(',');
   ack.print(cursor.lineIndex);
   ack.print(',');
   ack.println(lastCloudSyncEpoch);
   ack.close();
+  ackCacheStore(cursor.runFile, cursor.byteOffset, cursor.lineIndex, lastCloudSyncEpoch);
   return true;
 }
 
-bool parseTelemetryLine(const char *line, TelemetryRow &row) {
-  char tmp[96];
-  safeCopy(tmp, sizeof(tmp), line);
-  char *tok[9] = {0};
+// Tokenizes line in place
+bool parseTelemetryLine(char *line, TelemetryRow &row) {
+  char *tok[10] = {0};
   uint8_t n = 0;
-  char *p = strtok(tmp, ";");
-  while (p && n < 9) { tok[n++] = p; p = strtok(NULL, ";"); }
+  char *p = strtok(line, ";");
+  while (p && n < 10) { tok[n++] = p; p = strtok(NULL, ";"); }
   if (n < 9) return false;
   if (!isdigit(tok[0][0])) return false;
   row.ms = strtoul(tok[0], NULL, 10);
+  row.epoch = 0;
+  row.epochMs = 0;
+  if (n > 9) {
+    char *frac = NULL;
+    row.epoch = strtoul(tok[9], &frac, 10);
+    if (frac && *frac == '.') row.epochMs = (uint16_t)parseUint(frac + 1, 0);
+  }
   safeCopy(row.t1, sizeof(row.t1), tok[1]);
   safeCopy(row.u1, sizeof(row.u1), tok[2]);
   safeCopy(row.t2, sizeof(row.t2), tok[3]);
@@ -1179,46 +2651,56 @@ bool parseTelemetryLine(const char *line, TelemetryRow &row) {
   return true;
 }
 
-bool readTelemetryBatch(const char *runName, const UploadCursor &from, TelemetryRow *rows, uint8_t maxRows, UploadCursor &to, uint8_t &count) {
+// holes: lines counted but not sendable (gap rows, torn lines) and not yet acked;
+// the batch still goes out with its span so the server can close them
+bool readTelemetryBatch(const char *runName, const UploadCursor &from, TelemetryRow *rows, uint8_t maxRows, UploadCursor &to, uint8_t &count, uint8_t &holes) {
   count = 0;
+  holes = 0;
   to = from;
   if (!ensureSdReady(false)) return false;
-  File f = SD.open(runName, FILE_READ);
-  if (!f) return false;
+  File *fp = fhOpen(runName, false);
+  if (!fp) return false;
+  File &f = *fp;
   if (!f.seek(from.byteOffset)) {
-    f.close();
+    fhClose(runName);
     return false;
   }
   uint32_t offset = from.byteOffset;
   uint32_t lineIndex = from.lineIndex;
-  char line[96];
-  while (f.available() && count < maxRows) {
-    size_t n = f.readBytesUntil('\n', line, sizeof(line) - 1);
+  uint32_t skipThrough = (cmpIgnoreCase(ackSkipRun, runName) == 0) ? ackSkipThrough : 0;
+  uint16_t skipped = 0;
+  char *line = scratchAlloc(SCRATCH_LINE);
+  if (!line) return false;
+  while (f.available() && count < maxRows && skipped + holes < ACK_SKIP_SCAN_MAX) {
+    size_t n = f.readBytesUntil('\n', line, SCRATCH_LINE - 1);
     line[n] = '\0';
     while (n && (line[n - 1] == '\r' || line[n - 1] == '\n')) line[--n] = '\0';
     offset = f.position();
     if (n == 0) continue;
     if (strncmp(line, "ms;", 3) == 0) continue;
-    TelemetryRow r;
-    if (!parseTelemetryLine(line, r)) continue;
+    // Every other line is a row, so lineIndex matches writeLogRowAt(); gap rows and
+    // torn lines are counted but have nothing to send
     lineIndex++;
+    TelemetryRow r;
+    if (lineIndex <= skipThrough) { skipped++; continue; }
+    if (line[0] == LOG_GAP_ROW || !parseTelemetryLine(line, r)) { holes++; continue; }
     r.lineIndex = lineIndex;
     rows[count++] = r;
   }
+  if (skipThrough && lineIndex >= skipThrough) ackSkipRun[0] = '\0';
   uint32_t sizeNow = f.size();
-  f.close();
+  scratchRelease(line);
   to.byteOffset = offset;
   to.lineIndex = lineIndex;
   to.synced = (offset >= sizeNow) ? 1 : 0;
   return true;
 }
 
-bool parseEventLine(const char *line, EventUploadRow &row) {
-  char tmp[128];
-  safeCopy(tmp, sizeof(tmp), line);
+// Tokenizes line in place
+bool parseEventLine(char *line, EventUploadRow &row) {
   char *tok[8] = {0};
   uint8_t n = 0;
-  char *p = strtok(tmp, ";");
+  char *p = strtok(line, ";");
   while (p && n < 8) { tok[n++] = p; p = strtok(NULL, ";"); }
   if (n < 8) return false;
   if (!isdigit(tok[0][0])) return false;
@@ -1237,17 +2719,19 @@ bool readEventBatch(const UploadCursor &from, EventUploadRow *rows, uint8_t maxR
   count = 0;
   to = from;
   if (!ensureSdReady(false)) return false;
-  File f = SD.open("EVENTS.CSV", FILE_READ);
-  if (!f) return false;
+  File *fp = fhOpen("EVENTS.CSV", true);
+  if (!fp) return false;
+  File &f = *fp;
   if (!f.seek(from.byteOffset)) {
-    f.close();
+    fhClose("EVENTS.CSV");
     return false;
   }
   uint32_t offset = from.byteOffset;
   uint32_t lineIndex = from.lineIndex;
-  char line[128];
+  char *line = scratchAlloc(SCRATCH_LINE);
+  if (!line) return false;
   while (f.available() && count < maxRows) {
-    size_t n = f.readBytesUntil('\n', line, sizeof(line) - 1);
+    size_t n = f.readBytesUntil('\n', line, SCRATCH_LINE - 1);
     line[n] = '\0';
     while (n && (line[n - 1] == '\r' || line[n - 1] == '\n')) line[--n] = '\0';
     offset = f.position();
@@ -1260,16 +2744,626 @@ bool readEventBatch(const UploadCursor &from, EventUploadRow *rows, uint8_t maxR
     rows[count++] = r;
   }
   uint32_t sizeNow = f.size();
-  f.close();
+  scratchRelease(line);
   to.byteOffset = offset;
   to.lineIndex = lineIndex;
   to.synced = (offset >= sizeNow) ? 1 : 0;
   return true;
 }
 
+// ===== Run archive =====
+// Runs the backend has fully acknowledged (.ACK cursor at EOF) are appended to RUNS.ARC
+// and their CSV/.ACK pair removed, so the root keeps only the runs still being logged
+// or uploaded and its walks no longer grow with the chamber's history. RUNS.IDX holds
+// one ArchiveEntry per stored run; a copy of the entry also follows the run's bytes in
+// RUNS.ARC so a lost index can be rebuilt (tools/runarc.py). Run numbers continue after
+// the highest archived one, so a name is never reused while its copy is archived.
+// A record torn by a reset is padded out with zeros before the next append: entry
+// numbers stay record positions, and the filler (no magic) is skipped by readers.
+const char ARC_FILE[] = "RUNS.ARC";
+const char ARC_INDEX[] = "RUNS.IDX";
+const uint8_t ARC_MAGIC = 0xA7;
+
+struct ArchiveEntry {      // 36 bytes, little-endian, same layout on AVR and host
+  char name[13];
+  uint8_t magic;
+  uint16_t reserved;
+  uint32_t offset;         // first byte of the run in RUNS.ARC
+  uint32_t length;
+  uint32_t crc;            // CRC-32 (zlib) of the run bytes
+  uint32_t lines;          // including the CSV header
+  uint32_t epoch;          // when archived; 0 = clock not set
+};
+
+static_assert(sizeof(ArchiveEntry) == 36, "RUNS.IDX record layout is shared with tools/runarc.py");
+
+enum ArcJobKind : uint8_t { ARC_NONE, ARC_STORE, ARC_VERIFY, ARC_RESTORE, ARC_DUMP };
+struct ArcJob {
+  uint8_t kind;
+  File src;
+  File dst;                // STORE: RUNS.ARC, RESTORE: the recreated CSV
+  ArchiveEntry e;
+  uint32_t remaining;
+  uint32_t crc;
+  uint32_t lines;
+};
+ArcJob arcJob;
+char arcCandidate[13] = "";   // fully acknowledged run seen by the uploader's root walk
+bool arcIndexLoaded = false;
+uint16_t arcEntryCount = 0;
+uint16_t arcMaxRunNo = 0;
+uint16_t arcStoredCount = 0;
+uint16_t arcFailCount = 0;
+
+const uint32_t CRC32_NIBBLE[16] PROGMEM = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+// Start with 0xFFFFFFFF and invert the result, as zlib does
+uint32_t crc32Update(uint32_t crc, const uint8_t *p, uint16_t n) {
+  while (n--) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ pgm_read_dword(&CRC32_NIBBLE[crc & 15]);
+    crc = (crc >> 4) ^ pgm_read_dword(&CRC32_NIBBLE[crc & 15]);
+  }
+  return crc;
+}
+
+uint16_t arcRunNo(const char *name) {
+  return isRunCsvFile(name) ? (uint16_t)atoi(name + 3) : 0;
+}
+
+bool arcLoadIndex() {
+  if (arcIndexLoaded) return true;
+  if (!ensureSdReady(false)) return false;
+  arcEntryCount = 0;
+  arcMaxRunNo = 0;
+  File idx = sdOpen(ARC_INDEX, FILE_READ);
+  if (idx) {
+    ArchiveEntry e;
+    while (idx.read(&e, sizeof(e)) == (int)sizeof(e)) {
+      e.name[12] = '\0';
+      arcEntryCount++;
+      uint16_t no = arcRunNo(e.name);
+      if (no > arcMaxRunNo) arcMaxRunNo = no;
+    }
+    idx.close();
+  }
+  arcIndexLoaded = true;
+  return true;
+}
+
+uint16_t arcNextRunNo() {
+  arcLoadIndex();
+  return (uint16_t)(arcMaxRunNo + 1);
+}
+
+bool arcReadEntry(uint16_t i, ArchiveEntry &e) {
+  if (!arcLoadIndex() || i >= arcEntryCount) return false;
+  File idx = sdOpen(ARC_INDEX, FILE_READ);
+  if (!idx) return false;
+  bool ok = idx.seek((uint32_t)i * sizeof(e)) && idx.read(&e, sizeof(e)) == (int)sizeof(e);
+  idx.close();
+  e.name[12] = '\0';
+  return ok && e.magic == ARC_MAGIC;
+}
+
+// Entry number for "3" or "RUN05.CSV" (the newest copy of that name); -1 if none
+int16_t arcFind(const char *which, ArchiveEntry &e) {
+  if (!arcLoadIndex() || !which || !*which) return -1;
+  if (isdigit(which[0])) {
+    uint16_t i = parseUint(which, 0);
+    return arcReadEntry(i, e) ? (int16_t)i : -1;
+  }
+  File idx = sdOpen(ARC_INDEX, FILE_READ);
+  if (!idx) return -1;
+  int16_t found = -1;
+  ArchiveEntry cur;
+  for (uint16_t i = 0; i < arcEntryCount; i++) {
+    if (idx.read(&cur, sizeof(cur)) != (int)sizeof(cur)) break;
+    cur.name[12] = '\0';
+    if (cur.magic == ARC_MAGIC && cmpIgnoreCase(cur.name, which) == 0) {
+      e = cur;
+      found = (int16_t)i;
+    }
+  }
+  idx.close();
+  return found;
+}
+
+void arcAbort() {
+  if (arcJob.kind != ARC_NONE) {
+    arcJob.src.close();
+    if (arcJob.dst) arcJob.dst.close();
+  }
+  arcJob.kind = ARC_NONE;
+  arcIndexLoaded = false;   // the card may have been swapped
+}
+
+bool arcMayTake(const char *name) {
+  if (logFileName[0] && cmpIgnoreCase(name, logFileName) == 0 && (run.active || logOpen)) return false;
+  return spillPendingFor(name) == 0;
+}
+
+void arcRemoveOriginals(const char *run) {
+  char ackName[13];
+  ackNameFromCsv(run, ackName, sizeof(ackName));
+  fhClose(run);
+  ackCacheDrop(run);
+  sdRemove(run);
+  if (sdExists(ackName)) sdRemove(ackName);
+}
+
+bool arcBegin(uint8_t kind, File src, uint32_t length) {
+  if (!src) return false;
+  arcJob.kind = kind;
+  arcJob.src = src;
+  arcJob.remaining = length;
+  arcJob.crc = 0xFFFFFFFFUL;
+  arcJob.lines = 0;
+  return true;
+}
+
+// A copy already archived under the same name and length (reset before the originals
+// were removed, or a restored run that synced again) only has its bytes compared.
+bool arcStartStore(const char *run, bool verify) {
+  if (!arcLoadIndex() || arcEntryCount >= 0xFFFF) return false;
+  File src = sdOpen(run, FILE_READ);
+  if (!src) return false;
+  uint32_t len = src.size();
+  ArchiveEntry prev;
+  if (verify && arcFind(run, prev) >= 0 && prev.length == len) {
+    arcJob.e = prev;
+    arcJob.dst = File();
+    return arcBegin(ARC_VERIFY, src, len);
+  }
+  File dst = sdOpen(ARC_FILE, FILE_WRITE);
+  if (!dst) {
+    src.close();
+    return false;
+  }
+  memset(&arcJob.e, 0, sizeof(arcJob.e));
+  safeCopy(arcJob.e.name, sizeof(arcJob.e.name), run);
+  arcJob.e.magic = ARC_MAGIC;
+  arcJob.e.offset = dst.size();
+  arcJob.e.length = len;
+  arcJob.dst = dst;
+  return arcBegin(ARC_STORE, src, len);
+}
+
+File arcOpenAt(const ArchiveEntry &e) {
+  File src = sdOpen(ARC_FILE, FILE_READ);
+  if (src && (src.size() < e.offset + e.length || !src.seek(e.offset))) src.close();
+  return src;
+}
+
+bool arcStartDump(const char *which) {
+  if (arcJob.kind != ARC_NONE || dumpActive()) return false;
+  ArchiveEntry e;
+  int16_t i = arcFind(which, e);
+  if (i < 0) return false;
+  if (!arcBegin(ARC_DUMP, arcOpenAt(e), e.length)) return false;
+  arcJob.e = e;
+  arcJob.dst = File();
+  Serial.print(F("ARC BEGIN ")); Serial.print(i);
+  Serial.print(' '); Serial.print(e.name);
+  Serial.print(' '); Serial.print(e.length);
+  Serial.print(' '); Serial.println(e.crc, HEX);
+  return true;
+}
+
+// Writes the run back to the root without an .ACK; the uploader re-offers it and the
+// server ack skips the rows it already holds.
+bool arcStartRestore(const char *which) {
+  if (arcJob.kind != ARC_NONE) return false;
+  ArchiveEntry e;
+  if (arcFind(which, e) < 0 || sdExists(e.name)) return false;
+  File src = arcOpenAt(e);
+  if (!src) return false;
+  File dst = sdOpen(e.name, FILE_WRITE);
+  if (!dst) {
+    src.close();
+    return false;
+  }
+  arcJob.e = e;
+  arcJob.dst = dst;
+  return arcBegin(ARC_RESTORE, src, e.length);
+}
+
+void arcFinish(bool ok) {
+  ArchiveEntry &e = arcJob.e;
+  uint32_t crc = arcJob.crc ^ 0xFFFFFFFFUL;
+  uint8_t kind = arcJob.kind;
+  arcJob.src.close();
+  arcJob.kind = ARC_NONE;
+  if (kind == ARC_DUMP) {
+    Serial.print(F("\r\nARC END ")); Serial.print(crc, HEX);
+    Serial.println(ok && crc == e.crc ? F(" OK") : F(" BAD"));
+    return;
+  }
+  if (kind == ARC_VERIFY) {
+    if (ok && crc == e.crc) {
+      arcRemoveOriginals(e.name);
+      emitUiEvent(F("run_archived"), (int16_t)arcRunNo(e.name), 0);
+    } else if (!arcStartStore(e.name, false)) {
+      arcFailCount++;
+    }
+    return;
+  }
+  File &dst = arcJob.dst;
+  if (kind == ARC_RESTORE) {
+    dst.close();
+    if (!ok || crc != e.crc) {
+      sdRemove(e.name);
+      arcFailCount++;
+      Serial.print(F("ARC RESTORE FAIL ")); Serial.println(e.name);
+    } else {
+      Serial.print(F("ARC RESTORED ")); Serial.println(e.name);
+    }
+    return;
+  }
+  // STORE: bytes, then the trailer copy of the entry, then the index record. Anything
+  // short of the index record is ignored and stored again on the next pass.
+  if (ok) {
+    e.crc = crc;
+    e.lines = arcJob.lines;
+    uint16_t frac;
+    epochAtMs(millis(), e.epoch, frac);
+    dst.flush();
+    ok = dst.size() == e.offset + e.length && dst.write((const uint8_t*)&e, sizeof(e)) == sizeof(e);
+    dst.flush();
+  }
+  dst.close();
+  if (ok) {
+    File idx = sdOpen(ARC_INDEX, FILE_WRITE);
+    ok = idx;
+    if (ok) {
+      uint8_t torn = (uint8_t)(idx.size() % sizeof(e));
+      for (uint8_t i = torn; ok && torn && i < sizeof(e); i++) ok = idx.write((uint8_t)0) == 1;
+      if (ok) arcEntryCount = (uint16_t)(idx.size() / sizeof(e));
+      ok = ok && idx.write((const uint8_t*)&e, sizeof(e)) == sizeof(e);
+      idx.flush();
+      idx.close();
+    }
+  }
+  if (!ok) {
+    arcFailCount++;
+    arcIndexLoaded = false;   // recount in case the index took a partial record
+    return;
+  }
+  arcEntryCount++;
+  uint16_t no = arcRunNo(e.name);
+  if (no > arcMaxRunNo) arcMaxRunNo = no;
+  arcStoredCount++;
+  arcRemoveOriginals(e.name);
+  emitUiEvent(F("run_archived"), (int16_t)no, (int16_t)arcEntryCount);
+}
+
+// Copies a few chunks per pass within half the SD budget; the logger goes first.
+// A dump is paced by the free space in the serial TX buffer so it never blocks.
+void arcTick() {
+  if (arcJob.kind == ARC_NONE) {
+    if (!arcCandidate[0] || dumpActive()) return;
+    if (!sdOk || cloudBusy || !logQueue.empty() || spillCount > 0 || spillStaged) return;
+    char name[13];
+    safeCopy(name, sizeof(name), arcCandidate);
+    arcCandidate[0] = '\0';
+    if (arcMayTake(name) && !arcStartStore(name, true)) arcFailCount++;
+    return;
+  }
+  if (!sdOk) {
+    arcAbort();
+    return;
+  }
+  if (arcJob.kind != ARC_DUMP && (!logQueue.empty() || spillCount > 0 || spillStaged || dumpActive())) return;
+  uint8_t *buf = (uint8_t*)scratchAlloc(SCRATCH_LINE);
+  if (!buf) return;
+  uint16_t budgetMs = sdProfiles.budgetMs > 1 ? sdProfiles.budgetMs / 2 : 1;
+  unsigned long t0 = millis();
+  bool ok = true;
+  while (arcJob.remaining > 0 && millis() - t0 < budgetMs) {
+    uint16_t n = arcJob.remaining < SCRATCH_LINE ? (uint16_t)arcJob.remaining : SCRATCH_LINE;
+    if (arcJob.kind == ARC_DUMP) {
+      int room = Serial.availableForWrite();
+      if (room <= 0) break;
+      if (n > (uint16_t)room) n = (uint16_t)room;
+    }
+    if (arcJob.src.read(buf, n) != (int)n) {
+      ok = false;
+      break;
+    }
+    arcJob.crc = crc32Update(arcJob.crc, buf, n);
+    for (uint16_t i = 0; i < n; i++) if (buf[i] == '\n') arcJob.lines++;
+    if (arcJob.kind == ARC_DUMP) Serial.write(buf, n);
+    else if (arcJob.dst && arcJob.dst.write(buf, n) != n) {
+      ok = false;
+      break;
+    }
+    arcJob.remaining -= n;
+  }
+  scratchRelease((char*)buf);
+  if (!ok || arcJob.remaining == 0) arcFinish(ok);
+}
+
+void printArchive() {
+  arcLoadIndex();
+  Serial.print(F("ARC entries=")); Serial.print(arcEntryCount);
+  Serial.print(F(" next_run=")); Serial.print(arcMaxRunNo + 1);
+  Serial.print(F(" stored=")); Serial.print(arcStoredCount);
+  Serial.print(F(" fail=")); Serial.print(arcFailCount);
+  Serial.print(F(" job=")); Serial.println(arcJob.kind);
+  File idx = sdOpen(ARC_INDEX, FILE_READ);
+  if (!idx) return;
+  ArchiveEntry e;
+  for (uint16_t i = 0; i < arcEntryCount; i++) {
+    if (idx.read(&e, sizeof(e)) != (int)sizeof(e)) break;
+    if (e.magic != ARC_MAGIC) continue;
+    e.name[12] = '\0';
+    Serial.print(i); Serial.print(' '); Serial.print(e.name);
+    Serial.print(F(" off=")); Serial.print(e.offset);
+    Serial.print(F(" len=")); Serial.print(e.length);
+    Serial.print(F(" lines=")); Serial.print(e.lines);
+    Serial.print(F(" crc=")); Serial.print(e.crc, HEX);
+    Serial.print(F(" epoch=")); Serial.println(e.epoch);
+  }
+  idx.close();
+}
+
+// ===== Serial dump =====
+// CFG DUMP <file> [fromLine] streams a root file over USB in binary frames
+//   0xD5 | len | offset (u32) | data[len] | crc16 (XMODEM, over len..data)
+// between a "DUMP BEGIN <name> <size> <offset> <line>" line and a zero-length frame
+// followed by "DUMP END <crc32> <bytes>". Text printed by other code can only fall
+// between frames. Each loop pass sends whole frames for up to DUMP_SLICE_MS, so the
+// UART stays busy while logging and the heater still run every pass. fromLine skips
+// that many lines first (resume after a broken transfer). tools/serial_dump.cpp is
+// the host side; CFG BAUD raises the rate for it.
+const uint8_t DUMP_SOF = 0xD5;
+const uint8_t DUMP_HDR = 6;
+const uint8_t DUMP_SLICE_MS = 25;
+const unsigned long SERIAL_BAUD_DEFAULT = 115200UL;
+const unsigned long SERIAL_BAUD_IDLE_MS = 120000UL;   // back to the default when the host goes quiet
+
+enum DumpPhase : uint8_t { DUMP_IDLE, DUMP_SEEK, DUMP_SEND };
+struct SerialDump {
+  uint8_t phase;
+  File f;
+  char name[13];
+  uint32_t size;          // snapshot at start; a growing log is sent up to here
+  uint32_t offset;
+  uint32_t startOffset;
+  uint32_t skipLines;
+  uint32_t lines;         // lines passed while seeking
+  uint32_t crc;
+};
+SerialDump dump = {};
+unsigned long serialBaud = SERIAL_BAUD_DEFAULT;
+unsigned long lastSerialRxMs = 0;
+
+bool dumpActive() {
+  return dump.phase != DUMP_IDLE;
+}
+
+void dumpStop(const __FlashStringHelper *why) {
+  if (dump.phase == DUMP_IDLE) return;
+  dump.f.close();
+  dump.phase = DUMP_IDLE;
+  if (why) {
+    Serial.print(F("\r\nDUMP ERR ")); Serial.println(why);
+  }
+}
+
+bool dumpStart(const char *name, uint32_t fromLine) {
+  if (dumpActive() || arcJob.kind == ARC_DUMP) return false;
+  if (arcJob.kind != ARC_NONE && cmpIgnoreCase(arcJob.e.name, name) == 0) return false;
+  if (!ensureSdReady(false)) return false;
+  File f = sdOpen(name, FILE_READ);
+  if (!f) return false;
+  if (f.isDirectory()) {
+    f.close();
+    return false;
+  }
+  dump.f = f;
+  safeCopy(dump.name, sizeof(dump.name), name);
+  dump.size = f.size();
+  dump.offset = 0;
+  dump.skipLines = fromLine;
+  dump.lines = 0;
+  dump.crc = 0xFFFFFFFFUL;
+  dump.phase = fromLine ? DUMP_SEEK : DUMP_SEND;
+  if (dump.phase == DUMP_SEND) {
+    dump.startOffset = 0;
+    Serial.print(F("DUMP BEGIN ")); Serial.print(dump.name);
+    Serial.print(' '); Serial.print(dump.size);
+    Serial.println(F(" 0 0"));
+  }
+  return true;
+}
+
+// Counts newlines from the current offset; false once the start point is found
+bool dumpSeekChunk(uint8_t *buf) {
+  uint16_t n = dump.size - dump.offset < SCRATCH_LINE ? (uint16_t)(dump.size - dump.offset) : SCRATCH_LINE;
+  if (n > 0 && dump.f.read(buf, n) != (int)n) {
+    dumpStop(F("read"));
+    return false;
+  }
+  uint16_t i = 0;
+  while (i < n && dump.lines < dump.skipLines) {
+    if (buf[i++] == '\n') dump.lines++;
+  }
+  dump.offset += i;
+  if (dump.lines < dump.skipLines && dump.offset < dump.size) return true;
+  if (!dump.f.seek(dump.offset)) {
+    dumpStop(F("seek"));
+    return false;
+  }
+  dump.startOffset = dump.offset;
+  dump.phase = DUMP_SEND;
+  Serial.print(F("DUMP BEGIN ")); Serial.print(dump.name);
+  Serial.print(' '); Serial.print(dump.size);
+  Serial.print(' '); Serial.print(dump.offset);
+  Serial.print(' '); Serial.println(dump.lines);
+  return false;
+}
+
+// One frame; a zero-length frame closes the transfer. false when done or failed.
+bool dumpSendFrame(uint8_t *frame) {
+  uint32_t left = dump.size - dump.offset;
+  uint8_t n = left < SCRATCH_LINE ? (uint8_t)left : (uint8_t)SCRATCH_LINE;
+  uint8_t *data = frame + DUMP_HDR;
+  if (n > 0 && dump.f.read(data, n) != (int)n) {
+    dumpStop(F("read"));
+    return false;
+  }
+  frame[0] = DUMP_SOF;
+  frame[1] = n;
+  memcpy(frame + 2, &dump.offset, sizeof(dump.offset));
+  uint16_t crc = 0;
+  for (uint8_t i = 1; i < DUMP_HDR + n; i++) crc = _crc_xmodem_update(crc, frame[i]);
+  frame[DUMP_HDR + n] = (uint8_t)crc;
+  frame[DUMP_HDR + n + 1] = (uint8_t)(crc >> 8);
+  Serial.write(frame, DUMP_HDR + n + 2);
+  dump.crc = crc32Update(dump.crc, data, n);
+  dump.offset += n;
+  if (n > 0) return true;
+  Serial.print(F("\r\nDUMP END ")); Serial.print(dump.crc ^ 0xFFFFFFFFUL, HEX);
+  Serial.print(' '); Serial.println(dump.offset - dump.startOffset);
+  dump.f.close();
+  dump.phase = DUMP_IDLE;
+  return false;
+}
+
+void dumpTick() {
+  if (serialBaud != SERIAL_BAUD_DEFAULT && !dumpActive() && millis() - lastSerialRxMs > SERIAL_BAUD_IDLE_MS) {
+    Serial.flush();
+    Serial.begin(SERIAL_BAUD_DEFAULT);
+    serialBaud = SERIAL_BAUD_DEFAULT;
+  }
+  if (!dumpActive()) return;
+  if (!sdOk) {
+    dumpStop(F("sd"));
+    return;
+  }
+  uint8_t *buf = (uint8_t*)scratchAlloc(SCRATCH_LINE + DUMP_HDR + 2);
+  if (!buf) return;
+  unsigned long t0 = millis();
+  bool more = true;
+  while (more && millis() - t0 < DUMP_SLICE_MS) {
+    more = dump.phase == DUMP_SEEK ? dumpSeekChunk(buf) || dump.phase == DUMP_SEND : dumpSendFrame(buf);
+  }
+  scratchRelease((char*)buf);
+}
+
+void dumpList() {
+  if (!ensureSdReady(false)) return;
+  File root = sdOpen("/");
+  if (!root) return;
+  while (true) {
+    File f = root.openNextFile();
+    if (!f) break;
+    if (!f.isDirectory()) {
+      Serial.print(F("FILE ")); Serial.print(f.name());
+      Serial.print(' '); Serial.println(f.size());
+    }
+    f.close();
+  }
+  root.close();
+  Serial.println(F("FILE END"));
+}
+
+// The reply goes out at the old rate; the host switches once it has read it
+bool setSerialBaud(unsigned long baud) {
+  if (baud < 9600UL || baud > 1000000UL || dumpActive()) return false;
+  Serial.print(F("BAUD ")); Serial.println(baud);
+  Serial.flush();
+  Serial.begin(baud);
+  serialBaud = baud;
+  lastSerialRxMs = millis();
+  return true;
+}
+
+// ===== Live stream =====
+// CFG STREAM ON (or STREAM=1 in CONFIG.CSV) sends one 34-byte frame per sensor read
+// and per relay change over USB for tools/live_monitor.cpp:
+//   0xD6 | kind | seq u16 | LiveFrame (28 B) | crc16 XMODEM over kind..payload
+// A frame is only queued when the TX buffer has room for all of it, so the stream
+// never blocks the loop; frames that do not fit are counted and seq shows the gap.
+// Text output lands between frames. Paused while a CFG DUMP is running.
+const uint8_t LIVE_SOF = 0xD6;
+enum LiveKind : uint8_t { LIVE_SAMPLE = 1, LIVE_RELAY = 2 };
+const int16_t LIVE_NAN = INT16_MIN;
+const uint8_t LIVE_RUN_ACTIVE = 0x01, LIVE_RUN_PAUSED = 0x02, LIVE_DHT1_OK = 0x04, LIVE_DHT2_OK = 0x08;
+
+struct LiveFrame {
+  uint32_t ms;
+  uint32_t epoch;
+  int16_t t1_10, h1_10, t2_10, h2_10, tAvg_10, hAvg_10;   // LIVE_NAN before the first read
+  uint16_t step;            // run.currentStep, 1-based; 0 outside a run
+  uint8_t mask;
+  uint8_t heater;
+  uint8_t flags;            // LIVE_*
+  uint8_t reserved;
+  int16_t slope100;         // Tavg slope, 0.01 C/min
+};
+static_assert(sizeof(LiveFrame) == 28, "LiveFrame layout is shared with tools/live_monitor.cpp");
+
+uint16_t streamSeq = 0;
+uint32_t streamSent = 0;
+uint32_t streamDropped = 0;
+
+int16_t liveScaled10(float v) {
+  return isnan(v) ? LIVE_NAN : (int16_t)(v * 10.0f);
+}
+
+void streamFrame(uint8_t kind) {
+  if (!streamEnabled || dumpActive()) return;
+  const uint8_t total = 4 + sizeof(LiveFrame) + 2;
+  uint16_t seq = streamSeq++;
+  if (Serial.availableForWrite() < total) {
+    streamDropped++;
+    return;
+  }
+  LiveFrame lf;
+  uint8_t buf[total];
+  buf[0] = LIVE_SOF;
+  buf[1] = kind;
+  buf[2] = (uint8_t)seq;
+  buf[3] = (uint8_t)(seq >> 8);
+  uint16_t ems;
+  lf.ms = millis();
+  epochAtMs(lf.ms, lf.epoch, ems);
+  lf.t1_10 = liveScaled10(t1);
+  lf.h1_10 = liveScaled10(h1);
+  lf.t2_10 = liveScaled10(t2);
+  lf.h2_10 = liveScaled10(h2);
+  lf.tAvg_10 = liveScaled10(tAvg);
+  lf.hAvg_10 = liveScaled10(hAvg);
+  lf.step = run.active ? run.currentStep : 0;
+  lf.mask = relayMask;
+  lf.heater = heaterOn ? 1 : 0;
+  lf.flags = (run.active ? LIVE_RUN_ACTIVE : 0) | (run.paused ? LIVE_RUN_PAUSED : 0) |
+             (dht1Ok ? LIVE_DHT1_OK : 0) | (dht2Ok ? LIVE_DHT2_OK : 0);
+  lf.reserved = 0;
+  lf.slope100 = (int16_t)constrain(tSlopeCPerMin * 100.0f, -32767.0f, 32767.0f);
+  memcpy(buf + 4, &lf, sizeof(lf));
+  uint16_t crc = 0;
+  for (uint8_t i = 1; i < total - 2; i++) crc = _crc_xmodem_update(crc, buf[i]);
+  buf[total - 2] = (uint8_t)crc;
+  buf[total - 1] = (uint8_t)(crc >> 8);
+  Serial.write(buf, total);
+  streamSent++;
+}
+
+void printStream() {
+  Serial.print(F("STREAM=")); Serial.print(streamEnabled ? 1 : 0);
+  Serial.print(F(" SENT=")); Serial.print(streamSent);
+  Serial.print(F(" DROPPED=")); Serial.println(streamDropped);
+}
+
 bool findPendingRunForUpload(char *runNameOut, UploadCursor &cursorOut) {
   if (!ensureSdReady(false)) return false;
-  File root = SD.open("/");
+  File root = sdOpen("/");
   if (!root) return false;
   bool found = false;
   char candidate[13] = "";
@@ -1290,6 +3384,8 @@ bool findPendingRunForUpload(char *runNameOut, UploadCursor &cursorOut) {
             cursorOut = c;
             found = true;
           }
+        } else if (fileSize > 0 && !arcCandidate[0] && arcMayTake(runName)) {
+          safeCopy(arcCandidate, sizeof(arcCandidate), runName);
         }
       }
     }
@@ -1301,293 +3397,1160 @@ bool findPendingRunForUpload(char *runNameOut, UploadCursor &cursorOut) {
   return true;
 }
 
-void makeEndpointPath(bool isEvent, char *out, size_t outSize) {
+void makeEndpointPath(const char *route, char *out, size_t outSize) {
   char base[40];
   safeCopy(base, sizeof(base), cloudCfg.apiPath);
   if (base[0] == '\0') safeCopy(base, sizeof(base), "/v1");
   size_t l = strlen(base);
   bool hasSlash = (l > 0 && base[l - 1] == '/');
-  snprintf(out, outSize, "%s%s%s", base, hasSlash ? "" : "/", isEvent ? "events/batch" : "telemetry/batch");
+  snprintf_P(out, outSize, PSTR("%s%s%s"), base, hasSlash ? "" : "/", route);
 }
 
-bool buildTelemetryJson(const char *runName, const TelemetryRow *rows, uint8_t count, char *out, size_t outSize) {
+// span (backfill only, spanTo 0 = none): the file lines the batch covers; lines in it
+// without a record are gap rows the server must not wait for
+bool buildTelemetryJson(const char *runName, const TelemetryRow *rows, uint8_t count, uint32_t spanFrom, uint32_t spanTo, char *out, size_t outSize) {
   size_t len = 0;
-  if (!appendFmt(out, outSize, len, "{\"device_id\":\"%s\",\"records\":[", cloudCfg.deviceId)) return false;
+  if (!appendFmt(out, outSize, len, PSTR("{\"device_id\":\"%s\","), cloudCfg.deviceId)) return false;
+  if (spanTo && !appendFmt(out, outSize, len, PSTR("\"run_file\":\"%s\",\"span\":[%lu,%lu],"),
+    runName, (unsigned long)spanFrom, (unsigned long)spanTo)) return false;
+  if (!appendFmt(out, outSize, len, PSTR("\"records\":["))) return false;
   char iso[24];
   getRtcIso(iso, sizeof(iso));
   for (uint8_t i = 0; i < count; i++) {
     const TelemetryRow &r = rows[i];
-    if (i) if (!appendFmt(out, outSize, len, ",")) return false;
+    if (i) if (!appendFmt(out, outSize, len, PSTR(","))) return false;
     if (!appendFmt(out, outSize, len,
-      "{\"run_file\":\"%s\",\"line_index\":%lu,\"rtc_iso\":\"%s\",\"ms\":%lu,\"t1\":%s,\"u1\":%s,\"t2\":%s,\"u2\":%s,\"tavg\":%s,\"uavg\":%s,\"mask\":%u,\"step\":\"%s\",\"sd_state\":\"%s\",\"rtc_state\":\"%s\",\"run_state\":\"%s\"}",
-      runName, (unsigned long)r.lineIndex, iso, (unsigned long)r.ms,
+      PSTR("{\"run_file\":\"%s\",\"line_index\":%lu,\"rtc_iso\":\"%s\",\"ms\":%lu,\"epoch\":%lu,\"ems\":%u,\"t1\":%s,\"u1\":%s,\"t2\":%s,\"u2\":%s,\"tavg\":%s,\"uavg\":%s,\"mask\":%u,\"step\":\"%s\",\"sd_state\":\"%s\",\"rtc_state\":\"%s\",\"run_state\":\"%s\"}"),
+      runName, (unsigned long)r.lineIndex, iso, (unsigned long)r.ms, (unsigned long)r.epoch, (unsigned)r.epochMs,
       r.t1, r.u1, r.t2, r.u2, r.tavg, r.uavg, (unsigned)r.mask, r.step,
       sdStateTxt(), rtcStateTxt(), runStateTxt())) return false;
   }
-  if (!appendFmt(out, outSize, len, "]}")) return false;
+  if (!appendFmt(out, outSize, len, PSTR("]}"))) return false;
+  return true;
+}
+
+// Columnar batch: per-batch constants once, a column list, and line_index/ms/epoch sent
+// as deltas from the previous row (the first row is absolute). ms and epoch deltas are
+// signed: millis() restarts inside one run file after a reset.
+bool buildTelemetryColumnarJson(const char *runName, const TelemetryRow *rows, uint8_t count, uint32_t spanFrom, uint32_t spanTo, char *out, size_t outSize) {
+  size_t len = 0;
+  bool live = spanTo == 0;
+  char iso[24];
+  getRtcIso(iso, sizeof(iso));
+  if (!appendFmt(out, outSize, len, PSTR("{"))) return false;
+  if (spanTo && !appendFmt(out, outSize, len, PSTR("\"span\":[%lu,%lu],"), (unsigned long)spanFrom, (unsigned long)spanTo)) return false;
+  if (!appendFmt(out, outSize, len,
+    PSTR("\"device_id\":\"%s\",\"fmt\":\"col1\",\"lane\":\"%s\",\"run_file\":\"%s\",\"rtc_iso\":\"%s\",\"sd_state\":\"%s\",\"rtc_state\":\"%s\",\"run_state\":\"%s\","
+    "\"cols\":[\"line_index\",\"ms\",\"epoch\",\"ems\",\"t1\",\"u1\",\"t2\",\"u2\",\"tavg\",\"uavg\",\"mask\",\"step\"],\"delta\":[\"line_index\",\"ms\",\"epoch\"],\"rows\":["),
+    cloudCfg.deviceId, live ? "live" : "sd", runName, iso, sdStateTxt(), rtcStateTxt(), runStateTxt())) return false;
+  uint32_t prevLine = 0;
+  uint32_t prevMs = 0;
+  uint32_t prevEpoch = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    const TelemetryRow &r = rows[i];
+    if (i) if (!appendFmt(out, outSize, len, PSTR(","))) return false;
+    if (!appendFmt(out, outSize, len, PSTR("[%lu,%ld,%ld,%u,%s,%s,%s,%s,%s,%s,%u,\"%s\"]"),
+      (unsigned long)(r.lineIndex - prevLine), (long)(r.ms - prevMs),
+      (long)(r.epoch - prevEpoch), (unsigned)r.epochMs,
+      r.t1, r.u1, r.t2, r.u2, r.tavg, r.uavg, (unsigned)r.mask, r.step)) return false;
+    prevLine = r.lineIndex;
+    prevMs = r.ms;
+    prevEpoch = r.epoch;
+  }
+  if (!appendFmt(out, outSize, len, PSTR("]}"))) return false;
   return true;
 }
 
 bool buildEventJson(const EventUploadRow *rows, uint8_t count, char *out, size_t outSize) {
   size_t len = 0;
-  if (!appendFmt(out, outSize, len, "{\"device_id\":\"%s\",\"records\":[", cloudCfg.deviceId)) return false;
+  if (!appendFmt(out, outSize, len, PSTR("{\"device_id\":\"%s\",\"records\":["), cloudCfg.deviceId)) return false;
   for (uint8_t i = 0; i < count; i++) {
     const EventUploadRow &r = rows[i];
-    if (i) if (!appendFmt(out, outSize, len, ",")) return false;
+    if (i) if (!appendFmt(out, outSize, len, PSTR(","))) return false;
     if (!appendFmt(out, outSize, len,
-      "{\"line_index\":%lu,\"rtc_iso\":\"%s\",\"event_type\":\"%s\",\"screen\":\"%s\",\"arg0\":%d,\"arg1\":%d,\"run_file\":\"%s\",\"current_step\":%u}",
+      PSTR("{\"line_index\":%lu,\"rtc_iso\":\"%s\",\"event_type\":\"%s\",\"screen\":\"%s\",\"arg0\":%d,\"arg1\":%d,\"run_file\":\"%s\",\"current_step\":%u}"),
       (unsigned long)r.lineIndex, r.rtcIso, r.eventType, r.screenName, (int)r.arg0, (int)r.arg1, r.runFile, (unsigned)r.step)) return false;
   }
-  if (!appendFmt(out, outSize, len, "]}")) return false;
+  if (!appendFmt(out, outSize, len, PSTR("]}"))) return false;
   return true;
 }
 
-int parseHttpCodeFromWindow() {
-  const char *p = strstr(espRxWindow, "HTTP/1.1 ");
-  if (!p) p = strstr(espRxWindow, "HTTP/1.0 ");
-  if (!p) return -1;
-  return atoi(p + 9);
+int parseHttpCodeFromWindow() {
+  const char *p = strstr(espRxWindow, "HTTP/1.1 ");
+  if (!p) p = strstr(espRxWindow, "HTTP/1.0 ");
+  if (!p) return -1;
+  return atoi(p + 9);
+}
+
+// Reads "<key><digits>" from the RX window (from `from`, before `end` if given)
+// once the number is terminated
+bool windowUintField(const char *key, long &out, const char *from = espRxWindow, const char *end = NULL) {
+  const char *p = strstr(from, key);
+  if (!p || (end && p > end)) return false;
+  p += strlen(key);
+  while (*p == ' ') p++;
+  if (!isdigit(*p)) return false;
+  const char *e = p;
+  while (isdigit(*e)) e++;
+  if (*e == '\0') return false;
+  out = atol(p);
+  return true;
+}
+
+void parseCloudControlFromWindow() {
+  long v;
+  if (windowUintField("\"max_batch\":", v)) cloudHintBatch = v;
+  if (windowUintField("\"tick_ms\":", v)) cloudHintTickMs = v;
+  if (windowUintField("\"retry_after_s\":", v)) cloudHintRetryS = v;
+  // acks: [{"run_file":"RUNxx.CSV","contiguous":N[,"gap_to":G]}, ...]; only ours counts
+  if (activeRunUpload[0]) {
+    char needle[32];
+    snprintf_P(needle, sizeof(needle), PSTR("\"run_file\":\"%s\""), activeRunUpload);
+    const char *a = strstr(espRxWindow, needle);
+    const char *e = a ? strchr(a, '}') : NULL;
+    if (e) {
+      if (windowUintField("\"contiguous\":", v, a, e)) cloudAckContiguous = v;
+      if (windowUintField("\"gap_to\":", v, a, e)) cloudAckGapTo = v;
+    }
+  }
+  if (windowUintField("Retry-After:", v) || windowUintField("retry-after:", v)) cloudHintRetryS = v;
+}
+
+void applyCloudControlHints(bool ok) {
+  if (cloudHintBatch > 0) {
+    cloudBatchLimit = (uint8_t)((cloudHintBatch < CLOUD_BATCH_MAX) ? cloudHintBatch : CLOUD_BATCH_MAX);
+  }
+  if (cloudHintTickMs > 0) {
+    unsigned long t = (unsigned long)cloudHintTickMs;
+    if (t < CLOUD_TICK_MIN_MS) t = CLOUD_TICK_MIN_MS;
+    if (t > CLOUD_TICK_MAX_MS) t = CLOUD_TICK_MAX_MS;
+    cloudTickMs = t;
+  }
+  if (ok) {
+    cloudTickGapMs = cloudTickMs;
+    return;
+  }
+  bool throttled = (cloudJobHttpCode == 429 || cloudJobHttpCode == 503);
+  if (throttled && cloudHintRetryS >= 0) {
+    unsigned long ms = (unsigned long)cloudHintRetryS * 1000UL;
+    cloudTickGapMs = (ms < CLOUD_RETRY_AFTER_MAX_MS) ? ms : CLOUD_RETRY_AFTER_MAX_MS;
+    if (cloudTickGapMs < cloudTickMs) cloudTickGapMs = cloudTickMs;
+    cloudBackoffMs = 1000UL;
+  } else {
+    cloudTickGapMs = (cloudBackoffMs > cloudTickMs) ? cloudBackoffMs : cloudTickMs;
+    // Throttled without a hint: also halve the batch until the server says otherwise
+    if (throttled) {
+      uint8_t lim = cloudBatchLimit ? cloudBatchLimit : CLOUD_BATCH_MAX;
+      cloudBatchLimit = (lim > 1) ? (uint8_t)(lim / 2) : 1;
+    }
+  }
+}
+
+void clearCloudJobFlags() {
+  cloudBusy = false;
+  cloudPayloadLen = 0;
+  cloudHttpLen = 0;
+  cloudPath[0] = '\0';
+}
+
+void uploadAnchorNote(const char *runName, const UploadCursor &from) {
+  if (cmpIgnoreCase(uploadAnchorRun, runName) != 0) {
+    uploadAnchors.clear();
+    safeCopy(uploadAnchorRun, sizeof(uploadAnchorRun), runName);
+  }
+  UploadAnchor a = { from.lineIndex, from.byteOffset };
+  uploadAnchors.push(a);
+}
+
+bool ackFullFor(const char *runName) {
+  return ackFullRun[0] && (cmpIgnoreCase(ackFullRun, "ALL") == 0 || cmpIgnoreCase(ackFullRun, runName) == 0);
+}
+
+// Reconciles the local cursor with the server's highest contiguous line_index:
+// ahead -> skip rows it already holds; behind with a bounded gap -> seek back to the
+// newest job start at or below the gap and re-send from there. A gap older than the
+// remembered job starts is only reported; CFG RESYNC re-offers the whole run.
+void applyServerAck() {
+  if (cloudAckContiguous < 0) return;
+  UploadCursor &cur = cloudNextCursor;
+  if (ackFullFor(cur.runFile)) {
+    if (cur.synced && cmpIgnoreCase(ackFullRun, cur.runFile) == 0) ackFullRun[0] = '\0';
+    return;
+  }
+  uint32_t acked = (uint32_t)cloudAckContiguous;
+  if (acked == cur.lineIndex) return;
+  if (acked > cur.lineIndex) {
+    safeCopy(ackSkipRun, sizeof(ackSkipRun), cur.runFile);
+    ackSkipThrough = acked;
+    return;
+  }
+  int16_t gapTo = (int16_t)min((uint32_t)(cloudAckGapTo < 0 ? 0 : cloudAckGapTo), 32767UL);
+  if (cloudAckGapTo <= (long)acked || cmpIgnoreCase(uploadAnchorRun, cur.runFile) != 0) {
+    emitUiEvent(F("ack_gap"), (int16_t)min(acked, 32767UL), gapTo);
+    return;
+  }
+  const UploadAnchor *best = NULL;
+  for (uint8_t i = 0; i < uploadAnchors.count(); i++) {
+    const UploadAnchor &a = uploadAnchors.peek(i);
+    if (a.lineIndex <= acked && (!best || a.lineIndex > best->lineIndex)) best = &a;
+  }
+  emitUiEvent(best ? F("ack_resend") : F("ack_gap"), (int16_t)min(acked, 32767UL), gapTo);
+  if (!best) return;
+  cur.byteOffset = best->byteOffset;
+  cur.lineIndex = best->lineIndex;
+  cur.synced = 0;
+  safeCopy(ackSkipRun, sizeof(ackSkipRun), cur.runFile);
+  ackSkipThrough = acked;
+}
+
+void netMarkDown() {
+  if (netState == NET_ONLINE) netStats.drops++;
+  if (netWasOnline && netDownSinceMs == 0) netDownSinceMs = millis() | 1UL;
+}
+
+void cloudJobFinish(bool ok) {
+  cloudLastJobDone = true;
+  cloudLastJobOk = ok;
+  netStats.lastHttpCode = cloudJobHttpCode;
+  if (ok) {
+    netStats.sent++;
+    cloudBackoffMs = 1000;
+    if (cloudJobIsLive) liveRingDropThrough(cloudLiveThrough);
+    if (cloudHasCursorUpdate && !cloudJobIsEvent) applyServerAck();
+    if (cloudHasCursorUpdate) {
+      if (rtcOk) lastCloudSyncEpoch = rtc.now().unixtime();
+      syncIndexSave(cloudNextCursor);
+      journalJobCommitted();
+    }
+  } else {
+    netStats.failed++;
+    netStats.retried++;
+    cloudBackoffMs = (cloudBackoffMs < 60000UL) ? (cloudBackoffMs * 2UL) : 60000UL;
+    if (cloudBackoffMs < 1000UL) cloudBackoffMs = 1000UL;
+    if (cloudJobHttpCode < 0) {
+      netMarkDown();
+      netState = NET_ERROR;
+      lastNetAttemptMs = millis();
+    }
+  }
+  applyCloudControlHints(ok);
+  lastCloudTickMs = millis();
+  atEnqueue(atCmd("AT+CIPCLOSE", "OK", 1000, AT_FAIL_ERROR, AT_GROUP_NONE, AT_STAT_CLOSE, NULL));
+  clearCloudJobFlags();
+}
+
+// Streams the request head; with a ByteCounter it only measures it, so no buffer is staged
+size_t writeCloudHttpHeader(Print &out) {
+  size_t n = out.print(F("POST "));
+  n += out.print(cloudPath);
+  n += out.print(F(" HTTP/1.1\r\nHost: "));
+  n += out.print(cloudCfg.apiHost);
+  n += out.print(F("\r\nUser-Agent: MegaESP/1.0\r\nConnection: close\r\nContent-Type: application/json\r\nX-Device-Id: "));
+  n += out.print(cloudCfg.deviceId);
+  n += out.print(F("\r\nX-Api-Token: "));
+  n += out.print(cloudCfg.apiToken);
+  n += out.print(F("\r\nContent-Length: "));
+  n += out.print((unsigned)cloudPayloadLen);
+  n += out.print(F("\r\n\r\n"));
+  return n;
+}
+
+void buildCipStartCmd(char *out, size_t outSize) {
+  snprintf_P(out, outSize, PSTR("AT+CIPSTART=\"SSL\",\"%s\",443"), cloudCfg.apiHost);
+}
+
+void buildCipSendCmd(char *out, size_t outSize) {
+  snprintf_P(out, outSize, PSTR("AT+CIPSEND=%u"), (unsigned)cloudHttpLen);
+}
+
+void writeCloudHttpRequest() {
+  writeCloudHttpHeader(Serial1);
+  Serial1.write((const uint8_t*)cloudPayload, cloudPayloadLen);
+}
+
+void pollCloudHttpResponse() {
+  int code = parseHttpCodeFromWindow();
+  if (code > 0) cloudJobHttpCode = code;
+  parseCloudControlFromWindow();
+}
+
+void cloudHttpStageDone(AtResult res) {
+  if (res == AT_OK) return;
+  cloudJobHttpCode = -1;
+  cloudJobFinish(false);
+}
+
+// The server closes the connection; a timeout still settles on whatever status arrived
+void cloudHttpResponseDone(AtResult res) {
+  (void)res;
+  bool ok = (cloudJobHttpCode >= 200 && cloudJobHttpCode < 300);
+  // Backend deployed before the columnar route: the rows go again as telemetry/batch
+  if (cloudJobHttpCode == 404 && cloudColumnar && strstr(cloudPath, "telemetry/columnar")) {
+    cloudColumnar = false;
+    emitUiEvent(F("columnar_off"), 404, 0);
+  }
+  cloudJobFinish(ok);
+}
+
+bool startCloudHttpJob(const char *path, const char *payload, bool isEvent, const UploadCursor &nextCursor, const char *fileName) {
+  if (cloudBusy || netState != NET_ONLINE) return false;
+  if (atFreeSlots() < 4) return false;
+  safeCopy(cloudPath, sizeof(cloudPath), path);
+  if (payload != cloudPayload) safeCopy(cloudPayload, sizeof(cloudPayload), payload);
+  cloudPayloadLen = (uint16_t)strlen(cloudPayload);
+  cloudJobIsEvent = isEvent;
+  cloudJobIsLive = false;
+  cloudJobHttpCode = -1;
+  cloudHintBatch = -1;
+  cloudHintTickMs = -1;
+  cloudHintRetryS = -1;
+  cloudAckContiguous = -1;
+  cloudAckGapTo = -1;
+  cloudHasCursorUpdate = true;
+  cloudNextCursor = nextCursor;
+  safeCopy(activeRunUpload, sizeof(activeRunUpload), fileName ? fileName : "");
+  ByteCounter head;
+  cloudHttpLen = (uint16_t)(writeCloudHttpHeader(head) + cloudPayloadLen);
+  cloudBusy = true;
+
+  AtCommand c = atCmd(NULL, "OK", 7000, AT_FAIL_ERROR_OR_FAIL, AT_GROUP_HTTP, AT_STAT_CONNECT, cloudHttpStageDone);
+  c.build = buildCipStartCmd;
+  c.okAlt = "ALREADY CONNECTED";
+  atEnqueue(c);
+  c = atCmd(NULL, ">", 4000, AT_FAIL_ERROR, AT_GROUP_HTTP, AT_STAT_SEND, cloudHttpStageDone);
+  c.build = buildCipSendCmd;
+  atEnqueue(c);
+  c = atCmd(NULL, "SEND OK", 5000, AT_FAIL_ERROR_OR_FAIL, AT_GROUP_HTTP, AT_STAT_PAYLOAD, cloudHttpStageDone);
+  c.write = writeCloudHttpRequest;
+  atEnqueue(c);
+  c = atCmd(NULL, "CLOSED", 9000, AT_FAIL_NONE, AT_GROUP_HTTP, AT_STAT_RESPONSE, cloudHttpResponseDone);
+  c.poll = pollCloudHttpResponse;
+  atEnqueue(c);
+  return true;
+}
+
+void netMarkOnline() {
+  unsigned long now = millis();
+  unsigned long tierMs = now - netTierStartMs;
+  netStats.lastTierMs[netRecoverTier] = (uint16_t)min(tierMs, 65535UL);
+  if (netDownSinceMs != 0) {
+    netStats.recoveredBy[netRecoverTier]++;
+    unsigned long downMs = now - netDownSinceMs;
+    netStats.recoverMs[netStats.recoverHead] = (uint16_t)min(downMs, 65535UL);
+    netStats.recoverHead = (uint8_t)((netStats.recoverHead + 1) % NET_RECOVER_SAMPLES);
+    if (netStats.recoverCount < NET_RECOVER_SAMPLES) netStats.recoverCount++;
+    netDownSinceMs = 0;
+  }
+  netState = NET_ONLINE;
+  netWasOnline = true;
+  netRecoverTier = NET_TIER_STATUS;
+  wifiJoinQueued = false;
+}
+
+uint16_t netRecoverMedianMs() {
+  uint8_t n = netStats.recoverCount;
+  if (n == 0) return 0;
+  uint16_t v[NET_RECOVER_SAMPLES];
+  for (uint8_t i = 0; i < n; i++) {
+    uint16_t x = netStats.recoverMs[i];
+    uint8_t k = i;
+    while (k > 0 && v[k - 1] > x) {
+      v[k] = v[k - 1];
+      k--;
+    }
+    v[k] = x;
+  }
+  return v[n / 2];
+}
+
+void forceNetReconnect() {
+  netMarkDown();
+  netState = NET_CONNECTING;
+  atDropGroup(AT_GROUP_WIFI);
+  wifiJoinQueued = false;
+  netRecoverTier = NET_TIER_STATUS;
+  lastNetAttemptMs = millis();
+}
+
+void wifiJoinFailed() {
+  netState = NET_ERROR;
+  lastNetAttemptMs = millis();
+  wifiJoinQueued = false;
+  netRecoverTier = NET_TIER_STATUS;
+}
+
+// Copies the next quoted field starting at or after p; returns the position after it
+const char *copyQuoted(const char *p, char *out, size_t outSize) {
+  if (outSize) out[0] = '\0';
+  p = strchr(p, '"');
+  if (!p) return NULL;
+  const char *e = strchr(p + 1, '"');
+  if (!e) return NULL;
+  size_t n = (size_t)(e - p - 1);
+  if (n >= outSize) n = outSize - 1;
+  memcpy(out, p + 1, n);
+  out[n] = '\0';
+  return e + 1;
+}
+
+// +CWJAP:"<ssid>","<bssid>",<channel>,<rssi>  (answer to AT+CWJAP?)
+void pollCwjapStatus() {
+  const char *p = strstr(espRxWindow, "+CWJAP:");
+  if (!p || wifiLinkSeen) return;
+  char ssid[33];
+  char bssid[18];
+  p = copyQuoted(p + 7, ssid, sizeof(ssid));
+  if (!p) return;
+  p = copyQuoted(p, bssid, sizeof(bssid));
+  if (!p || *p != ',' || !isdigit((unsigned char)p[1])) return;
+  if (strcmp(ssid, cloudCfg.ssid) != 0) return;
+  wifiLinkSeen = true;
+  safeCopy(wifiCachedBssid, sizeof(wifiCachedBssid), bssid);
+  wifiCachedChannel = (uint8_t)atoi(p + 1);
+}
+
+bool queueWifiTier(uint8_t tier);
+
+void wifiEscalate() {
+  unsigned long now = millis();
+  netStats.lastTierMs[netRecoverTier] = (uint16_t)min(now - netTierStartMs, 65535UL);
+  if (netRecoverTier == NET_TIER_STATUS) {
+    netRecoverTier = wifiCachedBssid[0] ? NET_TIER_FAST : NET_TIER_FULL;
+  } else if (netRecoverTier == NET_TIER_FAST) {
+    netRecoverTier = NET_TIER_FULL;
+  } else {
+    wifiJoinFailed();
+    return;
+  }
+  if (!queueWifiTier(netRecoverTier)) wifiJoinFailed();
+}
+
+void wifiJoinStageDone(AtResult res) {
+  if (res != AT_OK) wifiEscalate();
+}
+
+void wifiJoinFinalDone(AtResult res) {
+  if (res != AT_OK) {
+    wifiEscalate();
+    return;
+  }
+  netMarkOnline();
+}
+
+void wifiStatusDone(AtResult res) {
+  if (res == AT_OK && wifiLinkSeen) return; // CIPMUX follows in the same group
+  atDropGroup(AT_GROUP_WIFI);
+  wifiEscalate();
+}
+
+void wifiAutoConnDone(AtResult res) {
+  if (res == AT_OK) wifiAutoConnSet = true;
+}
+
+void buildCwjapCmd(char *out, size_t outSize) {
+  if (cloudCfg.pass[0]) {
+    snprintf_P(out, outSize, PSTR("AT+CWJAP=\"%s\",\"%s\""), cloudCfg.ssid, cloudCfg.pass);
+  } else {
+    snprintf_P(out, outSize, PSTR("AT+CWJAP=\"%s\""), cloudCfg.ssid);
+  }
+}
+
+// Joining a known BSSID skips the scan for the strongest AP with that SSID
+void buildCwjapBssidCmd(char *out, size_t outSize) {
+  snprintf_P(out, outSize, PSTR("AT+CWJAP=\"%s\",\"%s\",\"%s\""), cloudCfg.ssid, cloudCfg.pass, wifiCachedBssid);
+}
+
+AtCommand wifiStatusQuery(AtDoneFn done) {
+  AtCommand c = atCmd("AT+CWJAP?", "OK", 2000, AT_FAIL_ERROR, AT_GROUP_WIFI, AT_STAT_STATUS, done);
+  c.poll = pollCwjapStatus;
+  return c;
+}
+
+// Tiers: link still up (query only), rejoin the cached BSSID, full join from scratch
+bool queueWifiTier(uint8_t tier) {
+  netTierStartMs = millis();
+  wifiLinkSeen = false;
+  if (tier == NET_TIER_STATUS) {
+    if (atFreeSlots() < 2) return false;
+    atEnqueue(wifiStatusQuery(wifiStatusDone));
+    atEnqueue(atCmd("AT+CIPMUX=0", "OK", 2000, AT_FAIL_ERROR, AT_GROUP_WIFI, AT_STAT_BASIC, wifiJoinFinalDone));
+    return true;
+  }
+  if (tier == NET_TIER_FAST) {
+    if (atFreeSlots() < 2) return false;
+    AtCommand c = atCmd(NULL, "OK", 8000, AT_FAIL_ERROR_OR_FAIL, AT_GROUP_WIFI, AT_STAT_FAST_JOIN, wifiJoinStageDone);
+    c.build = buildCwjapBssidCmd;
+    c.okAlt = "WIFI GOT IP";
+    atEnqueue(c);
+    atEnqueue(atCmd("AT+CIPMUX=0", "OK", 3000, AT_FAIL_ERROR, AT_GROUP_WIFI, AT_STAT_BASIC, wifiJoinFinalDone));
+    return true;
+  }
+  if (atFreeSlots() < 7) return false;
+  atEnqueue(atCmd("AT", "OK", 2000, AT_FAIL_NONE, AT_GROUP_WIFI, AT_STAT_BASIC, wifiJoinStageDone));
+  atEnqueue(atCmd("ATE0", "OK", 2000, AT_FAIL_ERROR, AT_GROUP_WIFI, AT_STAT_BASIC, wifiJoinStageDone));
+  atEnqueue(atCmd("AT+CWMODE=1", "OK", 2000, AT_FAIL_ERROR, AT_GROUP_WIFI, AT_STAT_BASIC, wifiJoinStageDone));
+  // Lets the radio rejoin on its own after an AP drop or ESP reset; optional on old firmware
+  if (!wifiAutoConnSet) atEnqueue(atCmd("AT+CWAUTOCONN=1", "OK", 1000, AT_FAIL_ERROR, AT_GROUP_NONE, AT_STAT_BASIC, wifiAutoConnDone));
+  AtCommand c = atCmd(NULL, "OK", 15000, AT_FAIL_ERROR_OR_FAIL, AT_GROUP_WIFI, AT_STAT_JOIN, wifiJoinStageDone);
+  c.build = buildCwjapCmd;
+  c.okAlt = "WIFI GOT IP";
+  atEnqueue(c);
+  // Refreshes the cached BSSID/channel for the next fast rejoin
+  AtCommand q = wifiStatusQuery(NULL);
+  q.group = AT_GROUP_NONE;
+  atEnqueue(q);
+  atEnqueue(atCmd("AT+CIPMUX=0", "OK", 3000, AT_FAIL_ERROR, AT_GROUP_WIFI, AT_STAT_BASIC, wifiJoinFinalDone));
+  return true;
+}
+
+void wifiAtManager() {
+  atEngineTick();
+  if (!cloudCfg.enabled || !cloudConfigValid()) {
+    netState = NET_OFF;
+    netWasOnline = false;
+    netDownSinceMs = 0;
+    if (wifiJoinQueued) {
+      atDropGroup(AT_GROUP_WIFI);
+      wifiJoinQueued = false;
+    }
+    return;
+  }
+
+  unsigned long now = millis();
+  if (netState == NET_ERROR) {
+    if (now - lastNetAttemptMs < cloudBackoffMs) return;
+    netState = NET_CONNECTING;
+  }
+  if (netState == NET_OFF) netState = NET_CONNECTING;
+
+  if (netState != NET_CONNECTING || wifiJoinQueued) return;
+  netRecoverTier = NET_TIER_STATUS;
+  wifiJoinQueued = queueWifiTier(netRecoverTier);
+}
+
+// ===== SNTP =====
+// "+CIPSNTPTIME:Thu Oct 18 12:34:56 2026"; the ESP reports 1970 until it has synced
+bool parseSntpTime(uint32_t &epoch) {
+  const char *p = strstr(espRxWindow, "+CIPSNTPTIME:");
+  if (!p) return false;
+  char mon[4];
+  unsigned d, hh, mi, ss, y;
+  if (sscanf(p + 13, "%*s %3s %u %u:%u:%u %u", mon, &d, &hh, &mi, &ss, &y) != 6) return false;
+  const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  const char *m = strstr(months, mon);
+  if (!m || strlen(mon) != 3 || y < 2024 || y > 2099) return false;
+  DateTime dt((uint16_t)y, (uint8_t)((m - months) / 3 + 1), (uint8_t)d, (uint8_t)hh, (uint8_t)mi, (uint8_t)ss);
+  epoch = dt.unixtime();
+  return true;
+}
+
+void sntpCfgDone(AtResult res) {
+  if (res == AT_OK) sntpConfigured = true;
+}
+
+// Sets the RTC (and the anchor) when it is off by SNTP_CORRECT_THRESHOLD_S or more;
+// every sync logs the measured drift.
+void sntpTimeDone(AtResult res) {
+  sntpQueued = false;
+  uint32_t sntpEpoch;
+  if (res != AT_OK || !parseSntpTime(sntpEpoch)) {
+    if (res == AT_OK && sntpSynced) sntpConfigured = false; // ESP restarted and lost the config
+    return;
+  }
+  unsigned long now = millis();
+  sntpSynced = true;
+  lastSntpSyncMs = now;
+  uint32_t sec;
+  uint16_t frac;
+  bool had = epochAtMs(now, sec, frac);
+  long drift = had ? (long)sntpEpoch - (long)sec : 0;
+  bool correct = !had || rtcLostPowerOrInvalid || labs(drift) >= SNTP_CORRECT_THRESHOLD_S;
+  if (correct) {
+    if (rtcOk) {
+      rtc.adjust(DateTime(sntpEpoch));
+      rtcLostPowerOrInvalid = false;
+    }
+    rtcAnchorSet(sntpEpoch, now);
+    rtcAnchorRequest(false); // refine the sub-second phase from the RTC edge
+  }
+  emitUiEvent(correct ? F("rtc_set") : F("rtc_drift"), (int16_t)constrain(drift, -32767L, 32767L), had ? 1 : 0);
+}
+
+void sntpTick() {
+  if (netState != NET_ONLINE || cloudBusy || sntpQueued) return;
+  unsigned long now = millis();
+  unsigned long period = sntpSynced ? SNTP_SYNC_PERIOD_MS : SNTP_RETRY_MS;
+  if (lastSntpTryMs != 0 && now - lastSntpTryMs < period) return;
+  if (atFreeSlots() < 2) return;
+  lastSntpTryMs = now;
+  if (!sntpConfigured) {
+    atEnqueue(atCmd("AT+CIPSNTPCFG=1,0,\"pool.ntp.org\"", "OK", 2000, AT_FAIL_ERROR, AT_GROUP_NONE, AT_STAT_BASIC, sntpCfgDone));
+  }
+  atEnqueue(atCmd("AT+CIPSNTPTIME?", "OK", 2000, AT_FAIL_ERROR, AT_GROUP_NONE, AT_STAT_BASIC, sntpTimeDone));
+  sntpQueued = true;
+}
+
+void emitUiEvent(const __FlashStringHelper *eventType, int16_t arg0, int16_t arg1) {
+  if (!ensureSdReady(false)) return;
+  File *fp = fhOpen("EVENTS.CSV", true);
+  if (!fp) return;
+  File &f = *fp;
+  if (f.size() == 0) {
+    f.println(F("ms;rtc_iso;event;screen;arg0;arg1;run_file;step"));
+  }
+  char iso[24];
+  getRtcIso(iso, sizeof(iso));
+  f.print(millis());
+  f.print(';');
+  f.print(iso);
+  f.print(';');
+  if (eventType) f.print(eventType);
+  else f.print(F("evt"));
+  f.print(';');
+  f.print(screenName(screen));
+  f.print(';');
+  f.print(arg0);
+  f.print(';');
+  f.print(arg1);
+  f.print(';');
+  f.print(currentFile);
+  f.print(';');
+  // A failed write means the card went away under the cached handle; reopen next time
+  if (f.println(run.currentStep) == 0) fhClose("EVENTS.CSV");
+  else f.flush();
+  journalEvent(eventType, arg0, arg1);
+}
+
+// Drops the local .ACK so a run is re-offered to the backend; the server ack then
+// skips whatever it already holds. Used to seed a newly provisioned backend.
+uint8_t resyncRunUploads(const char *which) {
+  if (!ensureSdReady(false)) return 0;
+  bool all = cmpIgnoreCase(which, "ALL") == 0;
+  uint8_t n = 0;
+  char ackName[13];
+  if (!all) {
+    ackNameFromCsv(which, ackName, sizeof(ackName));
+    ackCacheDrop(which);
+    if (sdExists(ackName) && sdRemove(ackName)) n++;
+    return n;
+  }
+  File root = sdOpen("/");
+  if (!root) return 0;
+  while (true) {
+    File f = root.openNextFile();
+    if (!f) break;
+    if (!f.isDirectory() && isRunCsvFile(f.name())) {
+      ackNameFromCsv(f.name(), ackName, sizeof(ackName));
+      ackCacheDrop(f.name());
+      f.close();
+      if (sdExists(ackName) && sdRemove(ackName)) n++;
+      continue;
+    }
+    f.close();
+  }
+  root.close();
+  return n;
+}
+
+void fmtScaled10(char *out, size_t outSize, int16_t val) {
+  bool neg = val < 0;
+  uint16_t a = (uint16_t)(neg ? -val : val);
+  snprintf_P(out, outSize, PSTR("%s%u.%u"), neg ? "-" : "", (unsigned)(a / 10), (unsigned)(a % 10));
+}
+
+// ===== Journal =====
+// Optional (JOURNAL=1 in CONFIG.CSV): every sample, event, step summary, run start/end
+// and a periodic health snapshot is also appended to JOURNAL.BIN as a framed record
+//   0xA5 | type | len | seq (u32) | payload | crc8
+// with one sequence across all types. The uploader then sends mixed batches in seq
+// order with one seek and one cursor (JOURNAL.ACK) per job, instead of the per-run
+// CSV and EVENTS.CSV lanes. The CSV files are still written for local export, and
+// tools/journal.py rebuilds them from the journal. Switch modes with the upload
+// backlog drained: in journal mode the CSV lanes are not uploaded.
+const char JOURNAL_FILE[] = "JOURNAL.BIN";
+const uint8_t JOURNAL_SYNC = 0xA5;
+const uint8_t JOURNAL_HDR = 7;
+const uint8_t JOURNAL_PAYLOAD_MAX = 40;
+const uint16_t JOURNAL_RESYNC_MAX = 256;          // garbage bytes skipped per upload job
+const unsigned long JOURNAL_HEALTH_MS = 900000UL;
+
+enum JournalType : uint8_t { J_SAMPLE = 1, J_EVENT, J_STEP, J_HEALTH, J_RUN };
+enum JournalRunKind : uint8_t { JRUN_START, JRUN_STOP, JRUN_DONE };
+
+// Payloads are little-endian and naturally aligned, so the AVR and host layouts match
+struct JSample {           // 40 bytes
+  uint32_t lineIndex;
+  uint32_t ms;
+  uint32_t epoch;
+  uint16_t runNo;
+  uint16_t epochMs;
+  int16_t t1_10, h1_10, t2_10, h2_10, tAvg_10, hAvg_10;
+  uint8_t mask;
+  uint8_t heater;
+  char step[10];
+};
+struct JEvent {            // 32 bytes
+  uint32_t ms;
+  uint32_t epoch;
+  int16_t arg0;
+  int16_t arg1;
+  uint16_t runNo;
+  uint16_t step;
+  char type[15];
+  uint8_t screen;
+};
+struct JStep {             // 24 bytes
+  uint32_t epoch;          // step end; 0 = clock not set
+  uint32_t plannedMs;
+  uint32_t actualMs;
+  uint16_t runNo;
+  uint16_t stepIndex;
+  uint16_t samples;
+  int16_t tAvgMean_10;
+  int16_t hAvgMean_10;
+  uint8_t mask;
+  uint8_t heaterPct;       // share of the step's samples with the heater on
+};
+struct JHealth {           // 24 bytes
+  uint32_t epoch;
+  uint32_t uptimeS;
+  uint16_t freeMin;
+  uint16_t boots;
+  uint16_t wdtResets;
+  uint16_t netDrops;
+  uint16_t logDropped;
+  uint16_t sdWalksLastMin;
+  uint8_t sdState;
+  uint8_t netState;
+  uint8_t spill;
+  uint8_t reserved;
+};
+struct JRun {              // 12 bytes
+  uint32_t lines;
+  uint32_t epoch;
+  uint16_t runNo;
+  uint8_t kind;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(JSample) == 40 && sizeof(JEvent) == 32 && sizeof(JStep) == 24 &&
+  sizeof(JHealth) == 24 && sizeof(JRun) == 12, "journal payload layout is shared with tools/journal.py");
+
+uint32_t journalSeq = 0;
+bool journalSeqKnown = false;
+uint16_t journalUnflushed = 0;
+uint32_t journalWritten = 0;
+uint16_t journalFailCount = 0;
+unsigned long journalLastHealthMs = 0;
+uint16_t journalClosedRunNo = 0;      // run closed by the batch in flight
+uint32_t journalClosedLines = 0;
+
+struct JournalStepAcc {
+  bool open;
+  uint16_t stepIndex;
+  uint8_t mask;
+  uint32_t plannedMs;
+  uint64_t startMs;
+  int32_t sumT;
+  int32_t sumH;
+  uint16_t n;
+  uint16_t heaterN;
+};
+JournalStepAcc journalStep = {};
+
+uint8_t crc8Update(uint8_t crc, const uint8_t *p, uint8_t n) {
+  while (n--) {
+    crc ^= *p++;
+    for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+// Heater state as logged: its relay bit in the sample's mask
+uint8_t journalHeaterOf(uint8_t mask) {
+  uint8_t hb = thermoCfg.heaterRelayBit > 3 ? 2 : thermoCfg.heaterRelayBit;
+  return (mask >> hb) & 1;
+}
+
+uint16_t journalRunNo(const char *runFile) {
+  return (runFile && runFile[0]) ? (uint16_t)atoi(runFile + 3) : 0;
+}
+
+// Checks a frame in buf; n = bytes available. Returns the frame length, 0 if it is
+// not a valid frame, or -1 if it may be valid but is not complete yet.
+int8_t journalFrameAt(const uint8_t *buf, uint8_t n) {
+  if (n < 1 || buf[0] != JOURNAL_SYNC) return 0;
+  if (n < JOURNAL_HDR) return -1;
+  uint8_t len = buf[2];
+  if (buf[1] < J_SAMPLE || buf[1] > J_RUN || len > JOURNAL_PAYLOAD_MAX) return 0;
+  uint8_t total = (uint8_t)(JOURNAL_HDR + len + 1);
+  if (n < total) return -1;
+  return crc8Update(0, buf + 1, (uint8_t)(total - 2)) == buf[total - 1] ? (int8_t)total : 0;
+}
+
+uint32_t journalFrameSeq(const uint8_t *frame) {
+  uint32_t seq;
+  memcpy(&seq, frame + 3, sizeof(seq));
+  return seq;
+}
+
+void journalReset() {
+  journalSeqKnown = false;
+  journalUnflushed = 0;
+}
+
+// The last sequence number is in the last complete frame. A torn write leaves less
+// than one frame after it, so two frames' worth of tail is enough; new frames go after
+// the torn bytes and readers skip them. If even that finds nothing, the sequence
+// restarts above anything the file can hold past the upload cursor (a jump, never a
+// repeat) instead of walking the file: that walk can outlast the watchdog.
+bool journalLoadSeq(File &f) {
+  if (journalSeqKnown) return true;
+  uint32_t size = f.size();
+  journalSeq = 0;
+  if (size > 0) {
+    uint8_t buf[2 * (JOURNAL_HDR + JOURNAL_PAYLOAD_MAX + 1)];
+    uint8_t n = (uint8_t)min(size, (uint32_t)sizeof(buf));
+    if (!f.seek(size - n) || f.read(buf, n) != (int)n) return false;
+    int16_t lastEnd = -1;
+    for (uint8_t i = 0; i + JOURNAL_HDR < n; i++) {
+      int8_t fl = journalFrameAt(buf + i, (uint8_t)(n - i));
+      if (fl > 0 && i + fl > lastEnd) {
+        lastEnd = i + fl;
+        journalSeq = journalFrameSeq(buf + i);
+      }
+    }
+    if (lastEnd < 0) {
+      UploadCursor c;
+      syncIndexLoad(JOURNAL_FILE, c);
+      uint32_t tail = size > c.byteOffset ? size - c.byteOffset : 0;
+      journalSeq = c.lineIndex + tail / (JOURNAL_HDR + 1);
+    }
+  }
+  journalSeqKnown = true;
+  return true;
+}
+
+void journalAppend(uint8_t type, const void *payload, uint8_t len) {
+  if (!journalEnabled || !sdOk) return;
+  File *fp = fhOpen(JOURNAL_FILE, true);
+  if (!fp || !journalLoadSeq(*fp)) {
+    journalFailCount++;
+    return;
+  }
+  uint8_t frame[JOURNAL_HDR + JOURNAL_PAYLOAD_MAX + 1];
+  uint32_t seq = journalSeq + 1;
+  frame[0] = JOURNAL_SYNC;
+  frame[1] = type;
+  frame[2] = len;
+  memcpy(frame + 3, &seq, sizeof(seq));
+  memcpy(frame + JOURNAL_HDR, payload, len);
+  uint8_t total = (uint8_t)(JOURNAL_HDR + len + 1);
+  frame[total - 1] = crc8Update(0, frame + 1, (uint8_t)(total - 2));
+  if (fp->write(frame, total) != total) {
+    // The card went away under the cached handle; the tail is re-read on reopen
+    fhClose(JOURNAL_FILE);
+    journalReset();
+    journalFailCount++;
+    return;
+  }
+  journalSeq = seq;
+  journalWritten++;
+  journalUnflushed++;
+}
+
+// Samples ride the log file's flush cadence; everything else is flushed at once
+void journalFlush() {
+  if (!journalUnflushed || !sdOk) return;
+  File *fp = fhOpen(JOURNAL_FILE, true);
+  if (fp) fp->flush();
+  journalUnflushed = 0;
+}
+
+void journalSample(const char *runFile, const LogRecord &rec) {
+  if (!journalEnabled) return;
+  JSample s;
+  s.lineIndex = rec.lineIndex;
+  s.ms = rec.ms;
+  s.epoch = rec.epoch;
+  s.runNo = journalRunNo(runFile);
+  s.epochMs = rec.epochMs;
+  s.t1_10 = rec.t1_10;
+  s.h1_10 = rec.h1_10;
+  s.t2_10 = rec.t2_10;
+  s.h2_10 = rec.h2_10;
+  s.tAvg_10 = rec.tAvg_10;
+  s.hAvg_10 = rec.hAvg_10;
+  s.mask = rec.mask;
+  s.heater = journalHeaterOf(rec.mask);
+  memcpy(s.step, rec.step, sizeof(s.step));
+  s.step[sizeof(s.step) - 1] = '\0';
+  journalAppend(J_SAMPLE, &s, sizeof(s));
+}
+
+void journalEvent(const __FlashStringHelper *type, int16_t arg0, int16_t arg1) {
+  if (!journalEnabled) return;
+  JEvent e;
+  memset(&e, 0, sizeof(e));
+  e.ms = millis();
+  uint16_t frac;
+  epochAtMs(e.ms, e.epoch, frac);
+  e.arg0 = arg0;
+  e.arg1 = arg1;
+  e.runNo = journalRunNo(logFileName);
+  e.step = run.currentStep;
+  if (type) strncpy_P(e.type, (PGM_P)type, sizeof(e.type) - 1);
+  e.screen = (uint8_t)screen;
+  journalAppend(J_EVENT, &e, sizeof(e));
+  journalFlush();
+}
+
+void journalStepNote(const LogRecord &rec) {
+  if (!journalEnabled || !journalStep.open) return;
+  journalStep.sumT += rec.tAvg_10;
+  journalStep.sumH += rec.hAvg_10;
+  if (journalStep.n < 65535) journalStep.n++;
+  if (journalHeaterOf(rec.mask) && journalStep.heaterN < 65535) journalStep.heaterN++;
+}
+
+void journalStepEnd() {
+  if (!journalStep.open) return;
+  journalStep.open = false;
+  if (!journalEnabled) return;
+  JStep s;
+  uint16_t frac;
+  epochAtMs(millis(), s.epoch, frac);
+  s.plannedMs = journalStep.plannedMs;
+  uint64_t took = monoMs() - journalStep.startMs;
+  s.actualMs = took > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)took;
+  s.runNo = journalRunNo(logFileName);
+  s.stepIndex = journalStep.stepIndex;
+  s.samples = journalStep.n;
+  s.tAvgMean_10 = journalStep.n ? (int16_t)(journalStep.sumT / journalStep.n) : 0;
+  s.hAvgMean_10 = journalStep.n ? (int16_t)(journalStep.sumH / journalStep.n) : 0;
+  s.mask = journalStep.mask;
+  s.heaterPct = journalStep.n ? (uint8_t)((uint32_t)journalStep.heaterN * 100UL / journalStep.n) : 0;
+  journalAppend(J_STEP, &s, sizeof(s));
+  journalFlush();
 }
 
-void clearCloudJobFlags() {
-  cloudBusy = false;
-  cloudJobState = 0;
-  cloudPayloadLen = 0;
-  cloudHttpLen = 0;
-  cloudPath[0] = '\0';
+void journalStepBegin(uint16_t stepIndex, uint8_t mask, uint64_t plannedMs) {
+  journalStepEnd();
+  if (!journalEnabled) return;
+  memset(&journalStep, 0, sizeof(journalStep));
+  journalStep.open = true;
+  journalStep.stepIndex = stepIndex;
+  journalStep.mask = mask;
+  journalStep.plannedMs = plannedMs > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)plannedMs;
+  journalStep.startMs = monoMs();
 }
 
-void cloudJobFinish(bool ok) {
-  cloudLastJobDone = true;
-  cloudLastJobOk = ok;
-  netStats.lastHttpCode = cloudJobHttpCode;
-  if (ok) {
-    netStats.sent++;
-    cloudBackoffMs = 1000;
-    if (cloudHasCursorUpdate) {
-      if (rtcOk) lastCloudSyncEpoch = rtc.now().unixtime();
-      syncIndexSave(cloudNextCursor);
-    }
-  } else {
-    netStats.failed++;
-    netStats.retried++;
-    cloudBackoffMs = (cloudBackoffMs < 60000UL) ? (cloudBackoffMs * 2UL) : 60000UL;
-    if (cloudBackoffMs < 1000UL) cloudBackoffMs = 1000UL;
-    if (cloudJobHttpCode < 0) {
-      netState = NET_ERROR;
-      lastNetAttemptMs = millis();
-    }
-  }
-  Serial1.print("AT+CIPCLOSE\r\n");
-  clearCloudJobFlags();
+void journalRun(uint8_t kind) {
+  if (kind != JRUN_START) journalStepEnd();
+  if (!journalEnabled) return;
+  JRun r;
+  memset(&r, 0, sizeof(r));
+  r.lines = logLineSeq;
+  uint16_t frac;
+  epochAtMs(millis(), r.epoch, frac);
+  r.runNo = journalRunNo(logFileName);
+  r.kind = kind;
+  journalAppend(J_RUN, &r, sizeof(r));
+  journalFlush();
 }
 
-bool startCloudHttpJob(const char *path, const char *payload, bool isEvent, const UploadCursor &nextCursor, const char *fileName) {
-  if (cloudBusy || netState != NET_ONLINE) return false;
-  safeCopy(cloudPath, sizeof(cloudPath), path);
-  safeCopy(cloudPayload, sizeof(cloudPayload), payload);
-  cloudPayloadLen = (uint16_t)strlen(cloudPayload);
-  cloudJobIsEvent = isEvent;
-  cloudJobHttpCode = -1;
-  cloudHasCursorUpdate = true;
-  cloudNextCursor = nextCursor;
-  safeCopy(activeRunUpload, sizeof(activeRunUpload), fileName ? fileName : "");
-  char header[360];
-  int h = snprintf(header, sizeof(header),
-    "POST %s HTTP/1.1\r\n"
-    "Host: %s\r\n"
-    "User-Agent: MegaESP/1.0\r\n"
-    "Connection: close\r\n"
-    "Content-Type: application/json\r\n"
-    "X-Device-Id: %s\r\n"
-    "X-Api-Token: %s\r\n"
-    "Content-Length: %u\r\n\r\n",
-    cloudPath, cloudCfg.apiHost, cloudCfg.deviceId, cloudCfg.apiToken, (unsigned)cloudPayloadLen);
-  if (h <= 0 || h >= (int)sizeof(header)) return false;
-  cloudHttpLen = (uint16_t)((uint16_t)h + cloudPayloadLen);
-  cloudBusy = true;
-  cloudJobState = 1;
-  cloudJobStartedMs = millis();
-  cloudJobDeadlineMs = millis() + 7000UL;
-  clearEspRxWindow();
-  return true;
+void journalHealth() {
+  JHealth h;
+  memset(&h, 0, sizeof(h));
+  uint16_t frac;
+  epochAtMs(millis(), h.epoch, frac);
+  h.uptimeS = millis() / 1000UL;
+  h.freeMin = stackFreeMin();
+  h.boots = health.boots;
+  h.wdtResets = health.wdtResets;
+  h.netDrops = netStats.drops;
+  h.logDropped = logDroppedCount;
+  h.sdWalksLastMin = sdWalksLastMin;
+  h.sdState = (uint8_t)sdState;
+  h.netState = (uint8_t)netState;
+  h.spill = spillCount;
+  journalAppend(J_HEALTH, &h, sizeof(h));
+  journalFlush();
 }
 
-void cloudHttpJobTick() {
-  if (!cloudBusy) return;
-  while (Serial1.available()) appendEspRx((char)Serial1.read());
-  unsigned long now = millis();
-  if (cloudJobState == 1) {
-    char cmd[120];
-    snprintf(cmd, sizeof(cmd), "AT+CIPSTART=\"SSL\",\"%s\",443", cloudCfg.apiHost);
-    espSendCmd(cmd);
-    cloudJobState = 2;
-    cloudJobDeadlineMs = now + 7000UL;
-  } else if (cloudJobState == 2) {
-    if (espHas("OK") || espHas("CONNECT") || espHas("ALREADY CONNECTED")) {
-      char cmd[24];
-      snprintf(cmd, sizeof(cmd), "AT+CIPSEND=%u", (unsigned)cloudHttpLen);
-      espSendCmd(cmd);
-      cloudJobState = 3;
-      cloudJobDeadlineMs = now + 4000UL;
-    } else if (espHas("ERROR") || espHas("FAIL") || now > cloudJobDeadlineMs) {
-      cloudJobHttpCode = -1;
-      cloudJobFinish(false);
-    }
-  } else if (cloudJobState == 3) {
-    if (espHas(">")) {
-      clearEspRxWindow();
-      char header[360];
-      int h = snprintf(header, sizeof(header),
-        "POST %s HTTP/1.1\r\n"
-        "Host: %s\r\n"
-        "User-Agent: MegaESP/1.0\r\n"
-        "Connection: close\r\n"
-        "Content-Type: application/json\r\n"
-        "X-Device-Id: %s\r\n"
-        "X-Api-Token: %s\r\n"
-        "Content-Length: %u\r\n\r\n",
-        cloudPath, cloudCfg.apiHost, cloudCfg.deviceId, cloudCfg.apiToken, (unsigned)cloudPayloadLen);
-      if (h <= 0 || h >= (int)sizeof(header)) {
-        cloudJobHttpCode = -1;
-        cloudJobFinish(false);
-        return;
-      }
-      Serial1.write((const uint8_t*)header, (size_t)h);
-      Serial1.write((const uint8_t*)cloudPayload, cloudPayloadLen);
-      cloudJobState = 4;
-      cloudJobDeadlineMs = now + 5000UL;
-    } else if (espHas("ERROR") || now > cloudJobDeadlineMs) {
-      cloudJobHttpCode = -1;
-      cloudJobFinish(false);
-    }
-  } else if (cloudJobState == 4) {
-    if (espHas("SEND OK")) {
-      cloudJobState = 5;
-      cloudJobDeadlineMs = now + 9000UL;
-    } else if (espHas("ERROR") || espHas("FAIL") || now > cloudJobDeadlineMs) {
-      cloudJobHttpCode = -1;
-      cloudJobFinish(false);
-    }
-  } else if (cloudJobState == 5) {
-    int code = parseHttpCodeFromWindow();
-    if (code > 0) cloudJobHttpCode = code;
-    if (espHas("CLOSED") || now > cloudJobDeadlineMs) {
-      bool ok = (cloudJobHttpCode >= 200 && cloudJobHttpCode < 300);
-      cloudJobFinish(ok);
-    }
-  }
+void journalTick() {
+  if (!journalEnabled || !sdOk) return;
+  if (journalLastHealthMs != 0 && millis() - journalLastHealthMs < JOURNAL_HEALTH_MS) return;
+  journalLastHealthMs = millis() | 1UL;
+  journalHealth();
 }
 
-void forceNetReconnect() {
-  netState = NET_CONNECTING;
-  wifiStage = 0;
-  wifiStageMs = 0;
-  lastNetAttemptMs = millis();
-  clearEspRxWindow();
+void journalRunFile(uint16_t runNo, char *out, size_t outSize) {
+  if (runNo) snprintf_P(out, outSize, PSTR("RUN%02u.CSV"), runNo);
+  else out[0] = '\0';
 }
 
-void wifiAtManager() {
-  while (Serial1.available()) appendEspRx((char)Serial1.read());
-  if (cloudBusy) {
-    cloudHttpJobTick();
+// One record as a JSON object; the keys match the telemetry and event batches
+bool appendJournalJson(char *out, size_t outSize, size_t &len, const uint8_t *frame) {
+  uint8_t type = frame[1];
+  uint32_t seq = journalFrameSeq(frame);
+  const uint8_t *p = frame + JOURNAL_HDR;
+  char run[13];
+  char a[8], b[8], c[8], d[8], e[8], f[8];
+  if (type == J_SAMPLE) {
+    JSample s;
+    memcpy(&s, p, sizeof(s));
+    journalRunFile(s.runNo, run, sizeof(run));
+    fmtScaled10(a, sizeof(a), s.t1_10);
+    fmtScaled10(b, sizeof(b), s.h1_10);
+    fmtScaled10(c, sizeof(c), s.t2_10);
+    fmtScaled10(d, sizeof(d), s.h2_10);
+    fmtScaled10(e, sizeof(e), s.tAvg_10);
+    fmtScaled10(f, sizeof(f), s.hAvg_10);
+    return appendFmt(out, outSize, len,
+      PSTR("{\"seq\":%lu,\"type\":\"sample\",\"run_file\":\"%s\",\"line_index\":%lu,\"ms\":%lu,\"epoch\":%lu,\"ems\":%u,\"t1\":%s,\"u1\":%s,\"t2\":%s,\"u2\":%s,\"tavg\":%s,\"uavg\":%s,\"mask\":%u,\"heater\":%u,\"step\":\"%s\"}"),
+      (unsigned long)seq, run, (unsigned long)s.lineIndex, (unsigned long)s.ms, (unsigned long)s.epoch, (unsigned)s.epochMs,
+      a, b, c, d, e, f, (unsigned)s.mask, (unsigned)s.heater, s.step);
   }
-  if (!cloudCfg.enabled || !cloudConfigValid()) {
-    netState = NET_OFF;
-    wifiStage = 0;
-    return;
+  if (type == J_EVENT) {
+    JEvent ev;
+    memcpy(&ev, p, sizeof(ev));
+    ev.type[sizeof(ev.type) - 1] = '\0';
+    journalRunFile(ev.runNo, run, sizeof(run));
+    return appendFmt(out, outSize, len,
+      PSTR("{\"seq\":%lu,\"type\":\"event\",\"event_type\":\"%s\",\"ms\":%lu,\"epoch\":%lu,\"screen\":\"%s\",\"arg0\":%d,\"arg1\":%d,\"run_file\":\"%s\",\"current_step\":%u}"),
+      (unsigned long)seq, ev.type, (unsigned long)ev.ms, (unsigned long)ev.epoch, screenName((UiScreen)ev.screen),
+      (int)ev.arg0, (int)ev.arg1, run, (unsigned)ev.step);
   }
-
-  unsigned long now = millis();
-  if (netState == NET_ERROR) {
-    if (now - lastNetAttemptMs < cloudBackoffMs) return;
-    netState = NET_CONNECTING;
-    wifiStage = 0;
+  if (type == J_STEP) {
+    JStep s;
+    memcpy(&s, p, sizeof(s));
+    journalRunFile(s.runNo, run, sizeof(run));
+    fmtScaled10(a, sizeof(a), s.tAvgMean_10);
+    fmtScaled10(b, sizeof(b), s.hAvgMean_10);
+    return appendFmt(out, outSize, len,
+      PSTR("{\"seq\":%lu,\"type\":\"step\",\"epoch\":%lu,\"run_file\":\"%s\",\"step_index\":%u,\"mask\":%u,\"planned_ms\":%lu,\"actual_ms\":%lu,\"samples\":%u,\"tavg\":%s,\"uavg\":%s,\"heater_pct\":%u}"),
+      (unsigned long)seq, (unsigned long)s.epoch, run, (unsigned)s.stepIndex, (unsigned)s.mask, (unsigned long)s.plannedMs, (unsigned long)s.actualMs,
+      (unsigned)s.samples, a, b, (unsigned)s.heaterPct);
   }
-  if (netState == NET_OFF) {
-    netState = NET_CONNECTING;
-    wifiStage = 0;
-  }
-
-  if (netState != NET_CONNECTING) return;
-  if (wifiStage == 0) {
-    espSendCmd("AT");
-    wifiStage = 1;
-    wifiStageMs = now;
-  } else if (wifiStage == 1) {
-    if (espHas("OK")) {
-      espSendCmd("ATE0");
-      wifiStage = 2;
-      wifiStageMs = now;
-    } else if (now - wifiStageMs > 2000UL) {
-      netState = NET_ERROR; lastNetAttemptMs = now;
-    }
-  } else if (wifiStage == 2) {
-    if (espHas("OK")) {
-      espSendCmd("AT+CWMODE=1");
-      wifiStage = 3;
-      wifiStageMs = now;
-    } else if (espHas("ERROR") || now - wifiStageMs > 2000UL) {
-      netState = NET_ERROR; lastNetAttemptMs = now;
-    }
-  } else if (wifiStage == 3) {
-    if (espHas("OK")) {
-      char cmd[136];
-      if (cloudCfg.pass[0]) {
-        snprintf(cmd, sizeof(cmd), "AT+CWJAP=\"%s\",\"%s\"", cloudCfg.ssid, cloudCfg.pass);
-      } else {
-        snprintf(cmd, sizeof(cmd), "AT+CWJAP=\"%s\"", cloudCfg.ssid);
-      }
-      espSendCmd(cmd);
-      wifiStage = 4;
-      wifiStageMs = now;
-    } else if (espHas("ERROR") || now - wifiStageMs > 2000UL) {
-      netState = NET_ERROR; lastNetAttemptMs = now;
+  if (type == J_HEALTH) {
+    JHealth h;
+    memcpy(&h, p, sizeof(h));
+    return appendFmt(out, outSize, len,
+      PSTR("{\"seq\":%lu,\"type\":\"health\",\"epoch\":%lu,\"uptime_s\":%lu,\"free_min\":%u,\"boots\":%u,\"wdt_resets\":%u,\"net_drops\":%u,\"log_dropped\":%u,\"sd_walks\":%u,\"sd_state\":%u,\"net_state\":%u,\"spill\":%u}"),
+      (unsigned long)seq, (unsigned long)h.epoch, (unsigned long)h.uptimeS, (unsigned)h.freeMin, (unsigned)h.boots, (unsigned)h.wdtResets,
+      (unsigned)h.netDrops, (unsigned)h.logDropped, (unsigned)h.sdWalksLastMin, (unsigned)h.sdState, (unsigned)h.netState, (unsigned)h.spill);
+  }
+  JRun r;
+  memcpy(&r, p, sizeof(r));
+  journalRunFile(r.runNo, run, sizeof(run));
+  return appendFmt(out, outSize, len,
+    PSTR("{\"seq\":%lu,\"type\":\"run\",\"run_file\":\"%s\",\"kind\":\"%s\",\"lines\":%lu,\"epoch\":%lu}"),
+    (unsigned long)seq, run, r.kind == JRUN_START ? "start" : (r.kind == JRUN_STOP ? "stop" : "done"),
+    (unsigned long)r.lines, (unsigned long)r.epoch);
+}
+
+// Reads frames from the cursor into a journal/batch payload until maxRecs, the payload
+// size or the end of a run. Damaged bytes are skipped by hunting for the next frame.
+bool buildJournalJson(const UploadCursor &from, uint8_t maxRecs, char *out, size_t outSize, UploadCursor &to, uint8_t &count) {
+  count = 0;
+  to = from;
+  journalClosedRunNo = 0;
+  if (!ensureSdReady(false)) return false;
+  File *fp = fhOpen(JOURNAL_FILE, true);
+  if (!fp) return false;
+  File &f = *fp;
+  uint32_t size = f.size();
+  uint32_t pos = from.byteOffset;
+  uint16_t skipped = 0;
+  size_t len = 0;
+  size_t cap = outSize - 2;   // room for the closing "]}"
+  if (!appendFmt(out, cap, len, PSTR("{\"device_id\":\"%s\",\"fmt\":\"jrnl1\",\"records\":["), cloudCfg.deviceId)) return false;
+  uint8_t frame[JOURNAL_HDR + JOURNAL_PAYLOAD_MAX + 1];
+  while (pos < size && count < maxRecs && skipped < JOURNAL_RESYNC_MAX) {
+    uint8_t got = (uint8_t)min(size - pos, (uint32_t)sizeof(frame));
+    if (!f.seek(pos) || f.read(frame, got) != (int)got) {
+      fhClose(JOURNAL_FILE);
+      return false;
     }
-  } else if (wifiStage == 4) {
-    if (espHas("WIFI GOT IP") || espHas("OK")) {
-      espSendCmd("AT+CIPMUX=0");
-      wifiStage = 5;
-      wifiStageMs = now;
-    } else if (espHas("FAIL") || espHas("ERROR") || now - wifiStageMs > 15000UL) {
-      netState = NET_ERROR; lastNetAttemptMs = now;
+    int8_t fl = journalFrameAt(frame, got);
+    if (fl < 0) break;      // still being written
+    if (fl == 0) {
+      pos++;
+      skipped++;
+      continue;
     }
-  } else if (wifiStage == 5) {
-    if (espHas("OK")) {
-      netState = NET_ONLINE;
-      wifiStage = 0;
-      clearEspRxWindow();
-    } else if (espHas("ERROR") || now - wifiStageMs > 3000UL) {
-      netState = NET_ERROR; lastNetAttemptMs = now;
+    size_t mark = len;
+    if ((count && !appendFmt(out, cap, len, PSTR(","))) || !appendJournalJson(out, cap, len, frame)) {
+      len = mark;
+      break;
+    }
+    pos += (uint8_t)fl;
+    to.lineIndex = journalFrameSeq(frame);
+    count++;
+    if (frame[1] == J_RUN) {
+      JRun r;
+      memcpy(&r, frame + JOURNAL_HDR, sizeof(r));
+      if (r.kind != JRUN_START) {
+        journalClosedRunNo = r.runNo;
+        journalClosedLines = r.lines;
+        break;
+      }
     }
   }
+  out[len] = '\0';
+  to.byteOffset = pos;
+  to.synced = (pos >= size) ? 1 : 0;
+  return appendFmt(out, outSize, len, PSTR("]}"));
 }
 
-void emitUiEvent(const char *eventType, int16_t arg0, int16_t arg1) {
-  if (!ensureSdReady(false)) return;
-  File f = SD.open("EVENTS.CSV", FILE_WRITE);
-  if (!f) return;
-  if (f.size() == 0) {
-    f.println("ms;rtc_iso;event;screen;arg0;arg1;run_file;step");
+bool startJournalUploadJob() {
+  UploadCursor from;
+  UploadCursor to;
+  if (!syncIndexLoad(JOURNAL_FILE, from)) return false;
+  uint8_t limit = cloudBatchLimit ? cloudBatchLimit : CLOUD_BATCH_MAX;
+  uint8_t count = 0;
+  if (!buildJournalJson(from, limit, cloudPayload, sizeof(cloudPayload), to, count)) return false;
+  if (count == 0) {
+    // Only damaged bytes were skipped: persist the advanced cursor
+    if (to.byteOffset != from.byteOffset) syncIndexSave(to);
+    return false;
   }
-  char iso[24];
-  getRtcIso(iso, sizeof(iso));
-  f.print(millis());
-  f.print(';');
-  f.print(iso);
-  f.print(';');
-  f.print(eventType ? eventType : "evt");
-  f.print(';');
-  f.print(screenName(screen));
-  f.print(';');
-  f.print(arg0);
-  f.print(';');
-  f.print(arg1);
-  f.print(';');
-  f.print(currentFile);
-  f.print(';');
-  f.println(run.currentStep);
+  char endpoint[48];
+  makeEndpointPath("journal/batch", endpoint, sizeof(endpoint));
+  if (!startCloudHttpJob(endpoint, cloudPayload, true, to, JOURNAL_FILE)) return false;
+  netStats.pendingLines = count;
+  return true;
+}
+
+// The server has every record of a closed run: its CSV counts as synced and goes to
+// the archiver like a run uploaded through the CSV lane.
+void journalJobCommitted() {
+  if (!journalClosedRunNo) return;
+  char name[13];
+  journalRunFile(journalClosedRunNo, name, sizeof(name));
+  journalClosedRunNo = 0;
+  if (!arcMayTake(name)) return;
+  File f = sdOpen(name, FILE_READ);
+  if (!f) return;
+  UploadCursor c = {};
+  safeCopy(c.runFile, sizeof(c.runFile), name);
+  c.byteOffset = f.size();
+  c.lineIndex = journalClosedLines;
+  c.synced = 1;
   f.close();
+  if (syncIndexSave(c) && !arcCandidate[0]) safeCopy(arcCandidate, sizeof(arcCandidate), name);
+}
+
+void printJournal() {
+  UploadCursor c;
+  syncIndexLoad(JOURNAL_FILE, c);
+  Serial.print(F("JOURNAL=")); Serial.print(journalEnabled ? 1 : 0);
+  Serial.print(F(" SEQ=")); Serial.print(journalSeq);
+  Serial.print(F(" ACKED_SEQ=")); Serial.print(c.lineIndex);
+  Serial.print(F(" ACKED_BYTES=")); Serial.print(c.byteOffset);
+  Serial.print(F(" WRITTEN=")); Serial.print(journalWritten);
+  Serial.print(F(" FAIL=")); Serial.println(journalFailCount);
 }
 
 void printCfgStatus() {
@@ -1600,6 +4563,22 @@ void printCfgStatus() {
   Serial.print(F("API_TOKEN=")); Serial.println(cloudCfg.apiToken[0] ? "***" : "");
   Serial.print(F("DEVICE_ID=")); Serial.println(cloudCfg.deviceId);
   Serial.print(F("NET_STATE=")); Serial.println(netStateTxt());
+  Serial.print(F("UPLOAD_TICK_MS=")); Serial.println(cloudTickMs);
+  Serial.print(F("UPLOAD_BATCH=")); Serial.println(cloudBatchLimit ? cloudBatchLimit : CLOUD_BATCH_MAX);
+  uint32_t ep;
+  uint16_t epMs;
+  Serial.print(F("EPOCH=")); epochAtMs(millis(), ep, epMs); printEpoch(Serial, ep, epMs); Serial.println();
+  Serial.print(F("SNTP=")); Serial.println(sntpSynced ? F("synced") : F("pending"));
+  Serial.print(F("AP_BSSID=")); Serial.print(wifiCachedBssid); Serial.print(F(" CH=")); Serial.println(wifiCachedChannel);
+  Serial.print(F("NET_DROPS=")); Serial.println(netStats.drops);
+  Serial.print(F("RECOVER status/fast/full=")); Serial.print(netStats.recoveredBy[NET_TIER_STATUS]);
+  Serial.print('/'); Serial.print(netStats.recoveredBy[NET_TIER_FAST]);
+  Serial.print('/'); Serial.println(netStats.recoveredBy[NET_TIER_FULL]);
+  Serial.print(F("RECOVER_LAST_MS status/fast/full=")); Serial.print(netStats.lastTierMs[NET_TIER_STATUS]);
+  Serial.print('/'); Serial.print(netStats.lastTierMs[NET_TIER_FAST]);
+  Serial.print('/'); Serial.println(netStats.lastTierMs[NET_TIER_FULL]);
+  Serial.print(F("RECOVER_MEDIAN_MS=")); Serial.print(netRecoverMedianMs());
+  Serial.print(F(" n=")); Serial.println(netStats.recoverCount);
 }
 
 void handleCfgCommand(char *line) {
@@ -1609,7 +4588,7 @@ void handleCfgCommand(char *line) {
   p += 3;
   p = trimInPlace(p);
   if (!*p) {
-    Serial.println(F("CFG commands: WIFI_SSID/WIFI_PASS/API_HOST/API_PATH/API_TOKEN/DEVICE_ID/WIFI_ENABLE/SHOW/SAVE/TEST"));
+    Serial.println(F("CFG commands: WIFI_SSID/WIFI_PASS/API_HOST/API_PATH/API_TOKEN/DEVICE_ID/WIFI_ENABLE/SHOW/SAVE/TEST/RESYNC/ATSTAT/HEALTH/MEM/SDSTAT/SD_BUDGET_MS/ARC/JOURNAL/DUMP/BAUD/STREAM"));
     return;
   }
   char *space = strchr(p, ' ');
@@ -1633,6 +4612,68 @@ void handleCfgCommand(char *line) {
   } else if (cmpIgnoreCase(key, "TEST") == 0) {
     forceNetReconnect();
     Serial.println(F("CFG test reconnect"));
+  } else if (cmpIgnoreCase(key, "ATSTAT") == 0) {
+    printAtStats();
+  } else if (cmpIgnoreCase(key, "HEALTH") == 0) {
+    printHealth();
+  } else if (cmpIgnoreCase(key, "MEM") == 0) {
+    printMemStats();
+  } else if (cmpIgnoreCase(key, "SDSTAT") == 0) {
+    printSdStats();
+    printSdProfile();
+  } else if (cmpIgnoreCase(key, "SD_BUDGET_MS") == 0) {
+    uint16_t v = parseUint(p, 0);
+    if (v >= 5 && v <= 500) {
+      sdProfiles.budgetMs = v;
+      sdProfileSave();
+      Serial.println(F("OK"));
+    } else {
+      Serial.println(F("SD_BUDGET_MS 5..500"));
+    }
+  } else if (cmpIgnoreCase(key, "JOURNAL") == 0) {
+    printJournal();
+  } else if (cmpIgnoreCase(key, "STREAM") == 0) {
+    if (cmpIgnoreCase(p, "ON") == 0) streamEnabled = true;
+    else if (cmpIgnoreCase(p, "OFF") == 0) streamEnabled = false;
+    printStream();
+  } else if (cmpIgnoreCase(key, "DUMP") == 0) {
+    char *arg = strchr(p, ' ');
+    if (arg) *arg++ = '\0';
+    if (!*p) {
+      Serial.println(F("CFG DUMP <file> [fromLine] | LIST | ABORT"));
+    } else if (cmpIgnoreCase(p, "LIST") == 0) {
+      dumpList();
+    } else if (cmpIgnoreCase(p, "ABORT") == 0) {
+      dumpStop(F("aborted"));
+    } else if (!dumpStart(p, arg ? strtoul(arg, NULL, 10) : 0)) {
+      Serial.println(F("DUMP ERR busy or no such file"));
+    }
+  } else if (cmpIgnoreCase(key, "BAUD") == 0) {
+    if (!setSerialBaud(strtoul(p, NULL, 10))) Serial.println(F("BAUD 9600..1000000, not during a dump"));
+  } else if (cmpIgnoreCase(key, "ARC") == 0) {
+    char *arg = strchr(p, ' ');
+    if (arg) *arg++ = '\0';
+    if (!*p || cmpIgnoreCase(p, "LIST") == 0) {
+      printArchive();
+    } else if (cmpIgnoreCase(p, "GET") == 0 && arg) {
+      if (!arcStartDump(trimInPlace(arg))) Serial.println(F("ARC GET failed (busy or unknown run)"));
+    } else if (cmpIgnoreCase(p, "RESTORE") == 0 && arg) {
+      if (arcStartRestore(trimInPlace(arg))) Serial.println(F("ARC RESTORE started"));
+      else Serial.println(F("ARC RESTORE failed (busy, unknown run or file exists)"));
+    } else {
+      Serial.println(F("CFG ARC [LIST|GET <n|RUNxx.CSV>|RESTORE <n|RUNxx.CSV>]"));
+    }
+  } else if (cmpIgnoreCase(key, "RESYNC") == 0) {
+    char *arg = strchr(p, ' ');
+    if (arg) *arg++ = '\0';
+    if (!*p) {
+      Serial.println(F("CFG RESYNC <RUNxx.CSV|ALL> [FULL]"));
+    } else {
+      // FULL: re-send every row even if the server acks it (backend restored or replaced)
+      if (arg && cmpIgnoreCase(trimInPlace(arg), "FULL") == 0) safeCopy(ackFullRun, sizeof(ackFullRun), p);
+      if (cmpIgnoreCase(p, "ALL") == 0 || cmpIgnoreCase(p, ackSkipRun) == 0) ackSkipRun[0] = '\0';
+      Serial.print(F("RESYNC cleared ")); Serial.println(resyncRunUploads(p));
+    }
   } else if (cmpIgnoreCase(key, "WIFI_SSID") == 0) {
     safeCopy(cloudCfg.ssid, sizeof(cloudCfg.ssid), p);
     Serial.println(F("OK"));
@@ -1661,6 +4702,7 @@ void handleCfgCommand(char *line) {
 
 void processSerialCommands() {
   while (Serial.available()) {
+    lastSerialRxMs = millis();
     char c = (char)Serial.read();
     if (c == '\r' || c == '\n') {
       if (serialCmdLen > 0) {
@@ -1676,63 +4718,132 @@ void processSerialCommands() {
   }
 }
 
+void logRecordToRow(const LogRecord &rec, TelemetryRow &row) {
+  row.lineIndex = rec.lineIndex;
+  row.ms = rec.ms;
+  row.epoch = rec.epoch;
+  row.epochMs = rec.epochMs;
+  fmtScaled10(row.t1, sizeof(row.t1), rec.t1_10);
+  fmtScaled10(row.u1, sizeof(row.u1), rec.h1_10);
+  fmtScaled10(row.t2, sizeof(row.t2), rec.t2_10);
+  fmtScaled10(row.u2, sizeof(row.u2), rec.h2_10);
+  fmtScaled10(row.tavg, sizeof(row.tavg), rec.tAvg_10);
+  fmtScaled10(row.uavg, sizeof(row.uavg), rec.hAvg_10);
+  row.mask = rec.mask;
+  safeCopy(row.step, sizeof(row.step), rec.step);
+}
+
+// Sends the live ring straight from RAM; the backfill later re-sends the same
+// (run_file, line_index) rows from SD and the ingest side overwrites them.
+bool startLiveUploadJob() {
+  if (liveRing.empty()) return false;
+  TelemetryRow rows[LIVE_RING_CAP];
+  uint8_t n = liveRing.count();
+  for (uint8_t i = 0; i < n; i++) logRecordToRow(liveRing.peek(i), rows[i]);
+  const char *runName = logFileName[0] ? logFileName : currentFile;
+  uint8_t limit = cloudBatchLimit ? cloudBatchLimit : CLOUD_BATCH_MAX;
+  // Drop the oldest rows first if the server limit or payload is tight
+  for (uint8_t count = (n < limit) ? n : limit; count > 0; count--) {
+    const TelemetryRow *first = rows + (n - count);
+    bool built = cloudColumnar
+      ? buildTelemetryColumnarJson(runName, first, count, 0, 0, cloudPayload, sizeof(cloudPayload))
+      : buildTelemetryJson(runName, first, count, 0, 0, cloudPayload, sizeof(cloudPayload));
+    if (!built) continue;
+    char endpoint[48];
+    makeEndpointPath(cloudColumnar ? "telemetry/columnar" : "telemetry/batch", endpoint, sizeof(endpoint));
+    UploadCursor none = {};
+    if (!startCloudHttpJob(endpoint, cloudPayload, false, none, runName)) return false;
+    cloudHasCursorUpdate = false;
+    cloudJobIsLive = true;
+    cloudLiveThrough = rows[n - 1].lineIndex;
+    cloudLastJobLive = true;
+    return true;
+  }
+  return false;
+}
+
 void cloudUploaderTick() {
   if (!cloudCfg.enabled || !cloudConfigValid()) return;
   if (netState != NET_ONLINE) return;
   if (cloudBusy) return;
-  if (millis() - lastCloudTickMs < CLOUD_TICK_MS) return;
+  if (millis() - lastCloudTickMs < cloudTickGapMs) return;
   lastCloudTickMs = millis();
+  uint8_t batchMax = cloudBatchLimit ? cloudBatchLimit : CLOUD_BATCH_MAX;
+
+  // Live lane first, but never twice in a row so the backfill keeps draining
+  if (!cloudLastJobLive && startLiveUploadJob()) return;
+  cloudLastJobLive = false;
+
+  if (journalEnabled) {
+    if (!startJournalUploadJob()) startLiveUploadJob();
+    return;
+  }
 
   char runName[13];
   UploadCursor from;
   UploadCursor to;
   TelemetryRow rows[CLOUD_BATCH_MAX];
   uint8_t count = 0;
+  uint8_t holes = 0;
   if (findPendingRunForUpload(runName, from)) {
-    if (readTelemetryBatch(runName, from, rows, CLOUD_BATCH_MAX, to, count) && count > 0) {
-      if (buildTelemetryJson(runName, rows, count, cloudPayload, sizeof(cloudPayload))) {
-        char endpoint[48];
-        makeEndpointPath(false, endpoint, sizeof(endpoint));
-        if (startCloudHttpJob(endpoint, cloudPayload, false, to, runName)) {
-          netStats.pendingLines = count;
-          return;
-        }
+    // Shrink the batch until it fits the payload buffer; the cursor follows the rows sent
+    for (uint8_t maxRows = batchMax; maxRows > 0; maxRows--) {
+      if (!readTelemetryBatch(runName, from, rows, maxRows, to, count, holes) || (count == 0 && holes == 0)) break;
+      bool built = cloudColumnar
+        ? buildTelemetryColumnarJson(runName, rows, count, from.lineIndex + 1, to.lineIndex, cloudPayload, sizeof(cloudPayload))
+        : buildTelemetryJson(runName, rows, count, from.lineIndex + 1, to.lineIndex, cloudPayload, sizeof(cloudPayload));
+      if (!built) continue;
+      char endpoint[48];
+      makeEndpointPath(cloudColumnar ? "telemetry/columnar" : "telemetry/batch", endpoint, sizeof(endpoint));
+      if (startCloudHttpJob(endpoint, cloudPayload, false, to, runName)) {
+        cloudJobFromLine = from.lineIndex;
+        uploadAnchorNote(runName, from);
+        netStats.pendingLines = count;
+        return;
       }
+      break;
     }
+    // Only acked rows were skipped: persist the advanced cursor
+    if (count == 0 && holes == 0 && to.byteOffset != from.byteOffset) syncIndexSave(to);
   }
 
   UploadCursor evFrom;
   UploadCursor evTo;
   syncIndexLoad("EVENTS.CSV", evFrom);
-  EventUploadRow eRows[CLOUD_BATCH_MAX];
+  EventUploadRow eRows[CLOUD_EVENT_BATCH_MAX];
   uint8_t eCount = 0;
-  if (readEventBatch(evFrom, eRows, CLOUD_BATCH_MAX, evTo, eCount) && eCount > 0) {
+  if (readEventBatch(evFrom, eRows, CLOUD_EVENT_BATCH_MAX, evTo, eCount) && eCount > 0) {
     if (buildEventJson(eRows, eCount, cloudPayload, sizeof(cloudPayload))) {
       char endpoint[48];
-      makeEndpointPath(true, endpoint, sizeof(endpoint));
+      makeEndpointPath("events/batch", endpoint, sizeof(endpoint));
       if (startCloudHttpJob(endpoint, cloudPayload, true, evTo, "EVENTS.CSV")) {
         netStats.pendingLines = eCount;
+        return;
       }
     }
   }
+
+  // Nothing to backfill: the live lane may use this slot as well
+  startLiveUploadJob();
 }
 
 void showWifiStatus() {
   lcd.clear();
   char l0[17], l1[17];
-  snprintf(l0, sizeof(l0), "WF:%s HC:%d", netStateTxt(), netStats.lastHttpCode);
-  snprintf(l1, sizeof(l1), "P:%lu S:%lu F:%lu", (unsigned long)netStats.pendingLines, (unsigned long)netStats.sent, (unsigned long)netStats.failed);
+  snprintf_P(l0, sizeof(l0), PSTR("WF:%s HC:%d"), netStateTxt(), netStats.lastHttpCode);
+  snprintf_P(l1, sizeof(l1), PSTR("P:%lu S:%lu F:%lu"), (unsigned long)netStats.pendingLines, (unsigned long)netStats.sent, (unsigned long)netStats.failed);
   print16(0, 0, l0);
   print16(0, 1, l1);
 }
 
 // ===== Relay control =====
 void applyRelayMask(uint8_t mask) {
+  uint8_t prev = relayMask;
   relayMask = mask & 0x0F;
-  for (byte i = 0; i < 4; i++) {
-    bool on = relayMask & (1 << i);
-    digitalWrite(RELAY_PINS[i], RELAY_ACTIVE_LOW ? !on : on);
-  }
+  uint16_t t0 = (uint16_t)micros();
+  Relays::write(relayMask);
+  relayWriteUs = (uint16_t)micros() - t0;
+  if (relayMask != prev) streamFrame(LIVE_RELAY);
 }
 
 void updateThermostat(uint16_t tmin10, uint16_t tmax10, uint8_t baseMask) {
@@ -1820,7 +4931,13 @@ bool readDhtWithRetries(DHT &dht, float &tOut, float &hOut) {
   return false;
 }
 
+bool sensorsWarm() {
+  if (!dhtWarm && millis() - dhtWarmStartMs >= DHT_WARMUP_MS) dhtWarm = true;
+  return dhtWarm;
+}
+
 void readSensors() {
+  if (!sensorsWarm()) return;
   unsigned long now = millis();
   unsigned long period = haveValid ? DHT_PERIOD_MS : DHT_FAIL_RETRY_MS;
   if (now - lastReadMs < period) return;
@@ -1846,15 +4963,152 @@ void readSensors() {
   hAvg = (h1 + h2) * 0.5f;
   haveValid = true;
   lastValidSensorMs = now;
+  streamFrame(LIVE_SAMPLE);
+  if (isnan(slopeRefT)) {
+    slopeRefT = tAvg;
+    slopeRefMs = now;
+  } else if (now - slopeRefMs >= SLOPE_BASE_MS) {
+    tSlopeCPerMin = (tAvg - slopeRefT) * 60000.0f / (float)(now - slopeRefMs);
+    slopeRefT = tAvg;
+    slopeRefMs = now;
+  }
+}
+
+// ===== Swinging-door compression =====
+// Keeps a sample only when T1/U1/T2/U2 leave the corridor around the line from the
+// last kept row, or when mask/step change. Dropped rows are recoverable by linear
+// interpolation between kept rows within LOG_DB_T / LOG_DB_H.
+LogRecord sdtAnchor;
+LogRecord sdtHeld;
+bool sdtHasAnchor = false;
+bool sdtHasHeld = false;
+float sdtHi[4];
+float sdtLo[4];
+uint32_t sdtSeenCount = 0;
+uint32_t sdtKeptCount = 0;
+
+bool sdtEnabled() {
+  return meta.logDbT10 > 0 || meta.logDbH10 > 0;
+}
+
+int16_t sdtValue(const LogRecord &r, uint8_t ch) {
+  if (ch == 0) return r.t1_10;
+  if (ch == 1) return r.h1_10;
+  if (ch == 2) return r.t2_10;
+  return r.h2_10;
+}
+
+void sdtReset() {
+  sdtHasAnchor = false;
+  sdtHasHeld = false;
+  sdtSeenCount = 0;
+  sdtKeptCount = 0;
+}
+
+void sdtKeep(const LogRecord &rec) {
+  enqueueLogRow(rec);
+  sdtKeptCount++;
+  sdtAnchor = rec;
+  sdtHasAnchor = true;
+  sdtHasHeld = false;
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    sdtHi[ch] = INFINITY;
+    sdtLo[ch] = -INFINITY;
+  }
+}
+
+// A candidate is accepted only if the line anchor->candidate passes within tolerance of
+// every held-back point; returns false (without narrowing) once the door closes.
+// Channels with a 0 tolerance do not hold the door: only T or only U can be set.
+bool sdtDoorOpen(const LogRecord &rec) {
+  float dt = (float)(rec.ms - sdtAnchor.ms);
+  if (dt <= 0.0f) return false;
+  float hi[4], lo[4];
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    uint16_t tol10 = (ch & 1) ? meta.logDbH10 : meta.logDbT10;
+    if (tol10 == 0) {
+      hi[ch] = INFINITY;
+      lo[ch] = -INFINITY;
+      continue;
+    }
+    float tol = (float)tol10;
+    float dv = (float)(sdtValue(rec, ch) - sdtValue(sdtAnchor, ch));
+    float slope = dv / dt;
+    if (slope > sdtHi[ch] || slope < sdtLo[ch]) return false;
+    hi[ch] = min(sdtHi[ch], (dv + tol) / dt);
+    lo[ch] = max(sdtLo[ch], (dv - tol) / dt);
+  }
+  for (uint8_t ch = 0; ch < 4; ch++) {
+    sdtHi[ch] = hi[ch];
+    sdtLo[ch] = lo[ch];
+  }
+  return true;
+}
+
+void compressAndQueue(const LogRecord &rec) {
+  if (!sdtEnabled()) {
+    enqueueLogRow(rec);
+    return;
+  }
+  sdtSeenCount++;
+  if (!sdtHasAnchor) {
+    sdtKeep(rec);
+    return;
+  }
+  if (rec.mask != sdtAnchor.mask || strcmp(rec.step, sdtAnchor.step) != 0) {
+    if (sdtHasHeld) {
+      enqueueLogRow(sdtHeld);
+      sdtKeptCount++;
+    }
+    sdtKeep(rec);
+    return;
+  }
+  bool gap = meta.logMaxGapS > 0 && rec.ms - sdtAnchor.ms > (uint32_t)meta.logMaxGapS * 1000UL;
+  if (!gap && sdtDoorOpen(rec)) {
+    sdtHeld = rec;
+    sdtHasHeld = true;
+    return;
+  }
+  // Door closed (or gap reached): archive the last point that still fit and restart from it
+  if (!sdtHasHeld) {
+    sdtKeep(rec);
+    return;
+  }
+  LogRecord held = sdtHeld;
+  sdtKeep(held);
+  if (sdtDoorOpen(rec)) {
+    sdtHeld = rec;
+    sdtHasHeld = true;
+  } else {
+    sdtKeep(rec);
+  }
+}
+
+void sdtFlush() {
+  if (!sdtHasHeld) return;
+  LogRecord held = sdtHeld;
+  sdtKeep(held);
+}
+
+unsigned long currentLogPeriodMs() {
+  unsigned long fastMs = meta.logFastMs ? meta.logFastMs : LOG_PERIOD_MS;
+  unsigned long slowMs = meta.logSlowS ? (unsigned long)meta.logSlowS * 1000UL : LOG_PERIOD_MS;
+  if (slowMs < fastMs) slowMs = fastMs;
+  if (meta.logFastWindowS > 0 && monoMs() - stepStartMs < (uint64_t)meta.logFastWindowS * 1000UL) return fastMs;
+  if (meta.logSlope10 > 0 && fabs(tSlopeCPerMin) * 10.0f >= (float)meta.logSlope10) return fastMs;
+  return slowMs;
 }
 
 void logSample(const StepData &st) {
   if (!haveValid) return;
   unsigned long now = millis();
-  if (now - lastLogMs < LOG_PERIOD_MS) return;
+  // Relay transitions are always logged; otherwise the period follows the step window and slope
+  if (relayMask == lastLoggedMask && now - lastLogMs < currentLogPeriodMs()) return;
   lastLogMs = now;
+  lastLoggedMask = relayMask;
   LogRecord rec;
   rec.ms = millis();
+  epochAtMs(rec.ms, rec.epoch, rec.epochMs);
   rec.t1_10 = (int16_t)(t1 * 10.0f);
   rec.h1_10 = (int16_t)(h1 * 10.0f);
   rec.t2_10 = (int16_t)(t2 * 10.0f);
@@ -1862,74 +5116,83 @@ void logSample(const StepData &st) {
   rec.tAvg_10 = (int16_t)(tAvg * 10.0f);
   rec.hAvg_10 = (int16_t)(hAvg * 10.0f);
   rec.mask = relayMask;
+  rec.lineIndex = 0;
   safeCopy(rec.step, sizeof(rec.step), st.label);
-  queueLogRecord(rec);
+  compressAndQueue(rec);
 }
 
 // ===== UI =====
 void showMenu() {
   char line0[17];
   char line1[17];
-  snprintf(line0, sizeof(line0), "%-16s", MENU_ITEMS[menuIndex]);
+  char item[16];
+  strncpy_P(item, MENU_ITEMS[menuIndex], sizeof(item));
+  snprintf_P(line0, sizeof(line0), PSTR("%-16s"), item);
   print16(0, 0, line0);
   const char *sdTxt = "FAIL";
   if (sdState == SD_READY) sdTxt = "OK  ";
   else if (sdState == SD_DEGRADED) sdTxt = "DEG ";
   const char *rtcTxt = "FAIL";
   if (rtcOk) rtcTxt = rtcLostPowerOrInvalid ? "SET " : "OK  ";
-  snprintf(line1, sizeof(line1), "SD:%s RTC:%s", sdTxt, rtcTxt);
+  snprintf_P(line1, sizeof(line1), PSTR("SD:%s RTC:%s"), sdTxt, rtcTxt);
   print16(0, 1, line1);
 }
 
 void showExpList() {
   lcd.clear();
   if (sdFileCount == 0) {
-    print16(0, 0, "Sem exp no SD  ");
-    print16(0, 1, "                ");
+    print16(0, 0, F("Sem exp no SD  "));
+    print16(0, 1, F("                "));
     return;
   }
   char line0[17];
-  snprintf(line0, sizeof(line0), "%2u/%-2u %-8s", expFileIndex + 1, sdFileCount, expFiles[expFileIndex]);
+  snprintf_P(line0, sizeof(line0), PSTR("%2u/%-2u %-8s"), expFileIndex + 1, sdFileCount, expFiles[expFileIndex]);
   print16(0, 0, line0);
-  print16(0, 1, "SD             ");
+  print16(0, 1, F("SD             "));
 }
 
 void showIntList() {
   lcd.clear();
   if (INTERNAL_COUNT == 0) {
-    print16(0, 0, "Sem interno    ");
-    print16(0, 1, "                ");
+    print16(0, 0, F("Sem interno    "));
+    print16(0, 1, F("                "));
     return;
   }
   char line0[17];
-  snprintf(line0, sizeof(line0), "%2u/%-2u %-8s", intFileIndex + 1, INTERNAL_COUNT, INTERNAL_EXPS[intFileIndex].name);
+  char name[13];
+  strncpy_P(name, INTERNAL_EXPS[intFileIndex].name, sizeof(name));
+  snprintf_P(line0, sizeof(line0), PSTR("%2u/%-2u %-8s"), intFileIndex + 1, INTERNAL_COUNT, name);
   print16(0, 0, line0);
-  print16(0, 1, "Interno        ");
+  print16(0, 1, F("Interno        "));
 }
 
 void showServiceMenu() {
   lcd.clear();
   char line0[17];
-  snprintf(line0, sizeof(line0), "%2u/%-2u %-10s", serviceIndex + 1, NSERVICE, SERVICE_ITEMS[serviceIndex]);
+  char item[16];
+  strncpy_P(item, SERVICE_ITEMS[serviceIndex], sizeof(item));
+  snprintf_P(line0, sizeof(line0), PSTR("%2u/%-2u %-10s"), serviceIndex + 1, NSERVICE, item);
   print16(0, 0, line0);
-  print16(0, 1, "OK=Entrar Back ");
+  print16(0, 1, F("OK=Entrar Back "));
 }
 
 void showConfigMenu() {
   lcd.clear();
   char line0[17];
-  snprintf(line0, sizeof(line0), "%2u/%-2u %-10s", configIndex + 1, NCONFIG, CONFIG_ITEMS[configIndex]);
+  char item[16];
+  strncpy_P(item, CONFIG_ITEMS[configIndex], sizeof(item));
+  snprintf_P(line0, sizeof(line0), PSTR("%2u/%-2u %-10s"), configIndex + 1, NCONFIG, item);
   print16(0, 0, line0);
   char line1[17];
-  snprintf(line1, sizeof(line1), "INT:%us       ", thermoCfg.minOnSec);
+  snprintf_P(line1, sizeof(line1), PSTR("INT:%us       "), thermoCfg.minOnSec);
   print16(0, 1, line1);
 }
 
 void showHeaterIntervalConfig() {
   lcd.clear();
   char line0[17], line1[17];
-  snprintf(line0, sizeof(line0), "Aqec INT %4us", heaterIntervalEdit);
-  snprintf(line1, sizeof(line1), "OK=Salvar Back ");
+  snprintf_P(line0, sizeof(line0), PSTR("Aqec INT %4us"), heaterIntervalEdit);
+  snprintf_P(line1, sizeof(line1), PSTR("OK=Salvar Back "));
   print16(0, 0, line0);
   print16(0, 1, line1);
 }
@@ -1937,15 +5200,15 @@ void showHeaterIntervalConfig() {
 void showTimeSet() {
   lcd.clear();
   if (!rtcOk) {
-    print16(0, 0, "RTC FAIL       ");
-    print16(0, 1, "Back menu      ");
+    print16(0, 0, F("RTC FAIL       "));
+    print16(0, 1, F("Back menu      "));
     return;
   }
 
   static const char *FIELD_NAME[] = {"Y", "M", "D", "h", "m", "s"};
   char line0[17], line1[17];
-  snprintf(line0, sizeof(line0), "%04u-%02u-%02u", timeSet.year, timeSet.month, timeSet.day);
-  snprintf(line1, sizeof(line1), "%02u:%02u:%02u F:%s", timeSet.hour, timeSet.minute, timeSet.second, FIELD_NAME[timeSet.field]);
+  snprintf_P(line0, sizeof(line0), PSTR("%04u-%02u-%02u"), timeSet.year, timeSet.month, timeSet.day);
+  snprintf_P(line1, sizeof(line1), PSTR("%02u:%02u:%02u F:%s"), timeSet.hour, timeSet.minute, timeSet.second, FIELD_NAME[timeSet.field]);
   print16(0, 0, line0);
   print16(0, 1, line1);
 }
@@ -1956,22 +5219,22 @@ void showSensorTest(bool cfgPage) {
   if (!cfgPage) {
     if (dht1Ok && haveValid) {
       fmtFloat1(a, t1); fmtFloat1(b, h1);
-      snprintf(l0, sizeof(l0), "1OK T%s U%s", a, b);
+      snprintf_P(l0, sizeof(l0), PSTR("1OK T%s U%s"), a, b);
     } else {
-      snprintf(l0, sizeof(l0), "1ERR sem leitura");
+      snprintf_P(l0, sizeof(l0), PSTR("1ERR sem leitura"));
     }
     if (!USE_DHT2) {
       unsigned long age = haveValid ? ((millis() - lastValidSensorMs) / 1000UL) : 0;
-      snprintf(l1, sizeof(l1), "2OFF Age:%lus", age);
+      snprintf_P(l1, sizeof(l1), PSTR("2OFF Age:%lus"), age);
     } else if (dht2Ok && haveValid) {
       fmtFloat1(c, t2); fmtFloat1(d, h2);
-      snprintf(l1, sizeof(l1), "2OK T%s U%s", c, d);
+      snprintf_P(l1, sizeof(l1), PSTR("2OK T%s U%s"), c, d);
     } else {
-      snprintf(l1, sizeof(l1), "2ERR sem leitura");
+      snprintf_P(l1, sizeof(l1), PSTR("2ERR sem leitura"));
     }
   } else {
-    snprintf(l0, sizeof(l0), "On%us Off%us", thermoCfg.minOnSec, thermoCfg.minOffSec);
-    snprintf(l1, sizeof(l1), "H%u M%us D%u", thermoCfg.heaterRelayBit, thermoCfg.safetyMaxSecOn, droppedLogsCount);
+    snprintf_P(l0, sizeof(l0), PSTR("On%us Off%us"), thermoCfg.minOnSec, thermoCfg.minOffSec);
+    snprintf_P(l1, sizeof(l1), PSTR("H%u M%us D%u"), thermoCfg.heaterRelayBit, thermoCfg.safetyMaxSecOn, logDroppedCount);
   }
   print16(0, 0, l0);
   print16(0, 1, l1);
@@ -1986,12 +5249,42 @@ void showRelayTest() {
   maskToChars(relayTestMask, maskTxt);
   char l0[17], l1[17];
   bool on = (relayTestMask & (1 << relayTestSelected)) != 0;
-  snprintf(l0, sizeof(l0), "Sel R%u:%s", relayTestSelected + 1, on ? "ON " : "OFF");
-  snprintf(l1, sizeof(l1), "Mask %s", maskTxt);
+  snprintf_P(l0, sizeof(l0), PSTR("Sel R%u:%s"), relayTestSelected + 1, on ? "ON " : "OFF");
+  snprintf_P(l1, sizeof(l1), PSTR("Mask %s"), maskTxt);
   print16(0, 0, l0);
   print16(0, 1, l1);
 }
 
+uint64_t runElapsedMs() {
+  return monoMs() - run.expStartMs - run.totalPauseMs;
+}
+
+void noteStepSkew(uint64_t actualMs, uint64_t plannedMs) {
+  int64_t d = (int64_t)actualMs - (int64_t)plannedMs;
+  stepSkewMs = (long)constrain(d, (int64_t)-2000000000L, (int64_t)2000000000L);
+  if (stepSkewMs > stepSkewMaxMs) stepSkewMaxMs = stepSkewMs;
+  if (stepSkewMs >= STEP_SKEW_LATE_MS) stepLateCount++;
+  if (labs(stepSkewMs) >= STEP_SKEW_EVENT_MS) {
+    emitUiEvent(F("step_skew"), (int16_t)min(run.currentStep + 1, 32767), (int16_t)constrain(stepSkewMs / 10L, -32767L, 32767L));
+  }
+}
+
+// Run summary: worst start lateness (10 ms units) and steps started >= 100 ms late
+void emitScheduleSkew() {
+  emitUiEvent(F("sched_skew"), (int16_t)constrain(stepSkewMaxMs / 10L, -32767L, 32767L), (int16_t)min(stepLateCount, (uint16_t)32767));
+}
+
+// hh:mm:ss below a day, then Nd hh:mm
+void fmtRunTime(char *out, size_t outSize, uint64_t ms) {
+  uint32_t sec = (uint32_t)(ms / 1000ULL);
+  uint32_t days = sec / 86400UL;
+  uint8_t hh = (uint8_t)((sec / 3600UL) % 24);
+  uint8_t mm = (uint8_t)((sec / 60UL) % 60);
+  uint8_t ss = (uint8_t)(sec % 60);
+  if (days == 0) snprintf_P(out, outSize, PSTR("%02u:%02u:%02u"), hh, mm, ss);
+  else snprintf_P(out, outSize, PSTR("%lud%02u:%02u"), (unsigned long)days, hh, mm);
+}
+
 void drawRunning(const StepData &st) {
   static unsigned long lastPageMs = 0;
   static bool showTempPage = true;
@@ -2000,20 +5293,18 @@ void drawRunning(const StepData &st) {
     showTempPage = !showTempPage;
   }
   char line0[17], line1[17], a[8], b[8], c[8], d[8];
-  uint32_t expSec = (millis() - run.expStartMs - run.totalPauseMs) / 1000UL;
-  uint8_t hh = (expSec / 3600UL) % 24;
-  uint8_t mm = (expSec / 60UL) % 60;
-  uint8_t ss = expSec % 60;
+  char elapsed[10];
+  fmtRunTime(elapsed, sizeof(elapsed), runElapsedMs());
   char sdMark = (sdState == SD_READY) ? ' ' : '!';
-  snprintf(line0, sizeof(line0), "S%s%c%02u:%02u:%02u", st.label, sdMark, hh, mm, ss);
+  snprintf_P(line0, sizeof(line0), PSTR("S%s%c%s"), st.label, sdMark, elapsed);
   if (!haveValid) {
-    snprintf(line1, sizeof(line1), "Sem leitura   ");
+    snprintf_P(line1, sizeof(line1), PSTR("Sem leitura   "));
   } else if (showTempPage) {
     fmtFloat1(a, t1); fmtFloat1(b, t2);
-    snprintf(line1, sizeof(line1), "1T%s 2T%s", a, b);
+    snprintf_P(line1, sizeof(line1), PSTR("1T%s 2T%s"), a, b);
   } else {
     fmtFloat1(c, h1); fmtFloat1(d, h2);
-    snprintf(line1, sizeof(line1), "1U%s 2U%s", c, d);
+    snprintf_P(line1, sizeof(line1), PSTR("1U%s 2U%s"), c, d);
   }
   if (noticeActive()) {
     print16(0, 0, noticeLine0);
@@ -2024,24 +5315,153 @@ void drawRunning(const StepData &st) {
   }
 }
 
+// ===== Run checkpoint =====
+uint16_t ckptChecksum(const RunCheckpoint &ck) {
+  const uint8_t *p = (const uint8_t*)&ck;
+  uint16_t sum = 0x5A5A;
+  for (size_t i = 0; i < sizeof(RunCheckpoint) - sizeof(uint16_t); i++) sum = (uint16_t)((sum << 1 | sum >> 15) + p[i]);
+  return sum;
+}
+
+int ckptSlotAddr(uint8_t slot) {
+  return CKPT_ADDR + (int)slot * (int)sizeof(RunCheckpoint);
+}
+
+// Finds the newest valid slot; the next write goes to the one after it
+bool loadCheckpoint(RunCheckpoint &out) {
+  bool found = false;
+  for (uint8_t i = 0; i < CKPT_SLOTS; i++) {
+    RunCheckpoint ck;
+    EEPROM.get(ckptSlotAddr(i), ck);
+    if (ck.checksum != ckptChecksum(ck) || ck.seq == 0xFFFFFFFFUL) continue;
+    if (!found || ck.seq > out.seq) {
+      out = ck;
+      ckptSlot = (uint8_t)((i + 1) % CKPT_SLOTS);
+      found = true;
+    }
+  }
+  ckptSeq = found ? out.seq : 0;
+  return found;
+}
+
+uint64_t runElapsedMsAtCheckpoint() {
+  uint64_t now = (run.paused && run.pausedAt) ? run.pausedAt : monoMs();
+  return now - run.expStartMs - run.totalPauseMs;
+}
+
+RunCheckpoint ckptStage;
+bool ckptStaged = false;
+uint8_t ckptStageSlot = 0;
+uint8_t ckptStagePos = 0;
+
+// Writes staged bytes while the EEPROM is idle, as spillWriteTick(). A reset part way
+// leaves the slot failing its checksum, so resume takes the previous one.
+void ckptWriteTick() {
+  if (!ckptStaged) return;
+  const uint8_t *p = (const uint8_t*)&ckptStage;
+  int addr = ckptSlotAddr(ckptStageSlot);
+  while (ckptStagePos < sizeof(ckptStage) && eeprom_is_ready()) {
+    EEPROM.update(addr + ckptStagePos, p[ckptStagePos]);
+    ckptStagePos++;
+  }
+  if (ckptStagePos >= sizeof(ckptStage)) ckptStaged = false;
+}
+
+void saveCheckpoint() {
+  while (ckptStaged) ckptWriteTick();
+  RunCheckpoint &ck = ckptStage;
+  memset(&ck, 0, sizeof(ck));
+  ck.seq = ++ckptSeq;
+  ck.active = run.active ? 1 : 0;
+  if (run.active) {
+    ck.paused = run.paused ? 1 : 0;
+    ck.waitRetrieval = run.waitRetrieval ? 1 : 0;
+    ck.source = (uint8_t)currentSource;
+    ck.internalIndex = currentInternalIndex;
+    ck.retrievalIndex = run.retrievalIndex;
+    ck.heaterOn = heaterOn ? 1 : 0;
+    ck.currentStep = run.currentStep;
+    ck.runMs = runElapsedMsAtCheckpoint();
+    ck.stepPlanEndMs = stepPlanEndMs;
+    safeCopy(ck.expFile, sizeof(ck.expFile), currentFile);
+    safeCopy(ck.logFile, sizeof(ck.logFile), logFileName);
+    // Flushed rows only: unflushed and RAM rows may never reach the card; resume
+    // recounts past this point in the real file and re-adds spilled rows
+    ck.logBytes = logSyncedBytes;
+    ck.logRows = logSyncedRows;
+    uint16_t frac;
+    epochAtMs(millis(), ck.epoch, frac);
+  }
+  ck.checksum = ckptChecksum(ck);
+  ckptStageSlot = ckptSlot;
+  ckptStagePos = 0;
+  ckptStaged = true;
+  ckptWriteTick();
+  ckptSlot = (uint8_t)((ckptSlot + 1) % CKPT_SLOTS);
+  lastCkptMs = millis();
+  ckptDirty = false;
+}
+
+void clearCheckpoint() {
+  saveCheckpoint(); // run.active is already false
+}
+
+void checkpointTick() {
+  if (!run.active) return;
+  unsigned long gap = millis() - lastCkptMs;
+  if ((ckptDirty && gap >= CKPT_MIN_GAP_MS) || gap >= CKPT_PERIOD_MS) saveCheckpoint();
+}
+
 // ===== Run control =====
-bool startExperiment() {
-  if (!openRunFile()) return false;
+void flushPendingLogs() {
+  sdtFlush();
+  // Whatever cannot reach the card now is parked in the spill, behind older spilled rows
+  bool cardOk = logOpen && spillDrain(SPILL_SLOTS);
+  LogRecord rec;
+  while (logQueue.pop(rec)) {
+    if (cardOk && writeLogRecord(rec)) continue;
+    cardOk = false;
+    if (spillPush(rec)) logSpilledCount++;
+    else logDroppedCount++;
+  }
+  if (logSpilledCount || logDroppedCount) {
+    emitUiEvent(F("log_spill"), (int16_t)min(logSpilledCount, 32767UL), (int16_t)min(logDroppedCount, (uint16_t)32767));
+  }
+  sdProfileSave();
+  if (sdtEnabled() && sdtKeptCount > 0) {
+    uint32_t ratio10 = sdtSeenCount * 10UL / sdtKeptCount;
+    emitUiEvent(F("log_cmp"), (int16_t)min(sdtKeptCount, 32767UL), (int16_t)min(ratio10, 32767UL));
+  }
+}
+
+void resetRunRuntime() {
   run.active = true;
   run.paused = false;
   run.waitRetrieval = false;
   run.stepCount = meta.stepCount;
   run.currentStep = 0;
   run.retrievalIndex = 0;
-  run.expStartMs = millis();
+  run.expStartMs = monoMs();
   run.totalPauseMs = 0;
   run.pausedAt = 0;
   stepActive = false;
   stepDone = false;
+  stepPlanEndMs = 0;
+  stepSkewMs = 0;
+  stepSkewMaxMs = 0;
+  stepLateCount = 0;
   lastLogMs = 0;
+  lastLoggedMask = 0xFF;
   lastFlushTryMs = 0;
-  logFlushCounter = 0;
+  logUnflushedRows = 0;
   resetLogQueue();
+  sdtReset();
+  logLineSeq = 0;
+  logFileRows = 0;
+  logSyncedBytes = 0;
+  logSyncedRows = 0;
+  logFileName[0] = '\0';
+  liveRing.clear();
   sdDisconnectNotice = false;
   sdReconnectNotice = false;
   noticeUntilMs = 0;
@@ -2049,12 +5469,19 @@ bool startExperiment() {
   unsigned long offMs = (unsigned long)thermoCfg.minOffSec * 1000UL;
   heaterStateChangedMs = millis() - offMs;
   heaterOnSinceMs = heaterStateChangedMs;
+}
+
+bool startExperiment() {
+  if (!openRunFile()) return false;
+  resetRunRuntime();
   if (currentSource == SRC_SD) {
     if (!openLogFile()) setSdState(SD_DEGRADED);
   } else {
     logOpen = false;
   }
-  emitUiEvent("run_start", run.stepCount, 0);
+  emitUiEvent(F("run_start"), run.stepCount, 0);
+  journalRun(JRUN_START);
+  saveCheckpoint();
   return true;
 }
 
@@ -2063,89 +5490,161 @@ void stopExperiment(const char *msg) {
   stepActive = false;
   stepDone = false;
   if (runFile) runFile.close();
-  if (logOpen) { logFile.close(); logOpen = false; }
-  emitUiEvent("run_stop", run.currentStep, 0);
+  flushPendingLogs();
+  if (logOpen) { logFlush(); logFile.close(); logOpen = false; }
+  clearCheckpoint();
+  emitScheduleSkew();
+  emitUiEvent(F("run_stop"), run.currentStep, 0);
+  journalRun(JRUN_STOP);
   lcd.clear();
-  print16(0, 0, "Parado");
+  print16(0, 0, F("Parado"));
   if (msg) print16(0, 1, msg);
 }
 
 void finishExperiment() {
-  uint32_t expSec = (millis() - run.expStartMs - run.totalPauseMs) / 1000UL;
-  uint8_t hh = (expSec / 3600UL) % 24;
-  uint8_t mm = (expSec / 60UL) % 60;
-  uint8_t ss = expSec % 60;
   char timebuf[12];
-  snprintf(timebuf, sizeof(timebuf), "%02u:%02u:%02u", hh, mm, ss);
+  fmtRunTime(timebuf, sizeof(timebuf), runElapsedMs());
 
   run.active = false;
   stepActive = false;
   stepDone = false;
   if (runFile) runFile.close();
-  if (logOpen) { logFile.close(); logOpen = false; }
-  emitUiEvent("run_done", run.currentStep, 0);
+  flushPendingLogs();
+  if (logOpen) { logFlush(); logFile.close(); logOpen = false; }
+  clearCheckpoint();
+  emitScheduleSkew();
+  emitUiEvent(F("run_done"), run.currentStep, 0);
+  journalRun(JRUN_DONE);
 
   lcd.clear();
-  print16(0, 0, "Exp finished");
+  print16(0, 0, F("Exp finished"));
   for (uint8_t i = 0; i < 3; i++) {
     print16(0, 1, timebuf);
     delay(500);
-    print16(0, 1, "                ");
+    print16(0, 1, F("                "));
     delay(500);
   }
   screen = SCREEN_MENU;
   showMenu();
 }
 
+uint32_t countLinesFrom(const char *name, uint32_t offset) {
+  File f = sdOpen(name, FILE_READ);
+  if (!f) return 0;
+  uint32_t lines = 0;
+  if (f.seek(offset)) {
+    uint8_t buf[32];
+    int n;
+    while ((n = f.read(buf, sizeof(buf))) > 0) {
+      for (int i = 0; i < n; i++) if (buf[i] == '\n') lines++;
+    }
+  }
+  f.close();
+  return lines;
+}
+
+// Continues a run interrupted by a reset: same program, same RUNxx.CSV (appended),
+// same step with its original deadline. The outage is treated like a pause.
+bool resumeFromCheckpoint() {
+  RunCheckpoint ck;
+  if (!loadCheckpoint(ck) || !ck.active) return false;
+  bool ok = (ck.source == SRC_INT) ? loadExperimentInternal(ck.internalIndex) : loadExperiment(ck.expFile);
+  if (!ok || ck.currentStep > stepCacheCount) {
+    clearCheckpoint();
+    return false;
+  }
+  openRunFile();
+  resetRunRuntime();
+  run.currentStep = ck.currentStep;
+  run.retrievalIndex = ck.retrievalIndex;
+  run.expStartMs = monoMs() - ck.runMs;
+  stepCacheIndex = ck.currentStep;
+  stepPlanEndMs = ck.stepPlanEndMs;
+  resumeStepPending = ck.currentStep > 0;
+  heaterOn = ck.heaterOn != 0;
+  heaterStateChangedMs = millis();
+  heaterOnSinceMs = heaterStateChangedMs;
+  safeCopy(logFileName, sizeof(logFileName), ck.logFile);
+  logSyncedBytes = ck.logBytes;
+  logSyncedRows = ck.logRows;
+  logFileRows = ck.logRows;
+  if (logFileName[0] && ensureSdReady(false) && sdExists(logFileName)) {
+    if (!openLogFile()) setSdState(SD_DEGRADED);
+  }
+  // Next row follows what reached the card and what still waits in the spill
+  logLineSeq = logFileRows;
+  if (spillPendingFor(logFileName)) logLineSeq = max(logLineSeq, spillLastLine());
+  if (ck.paused || ck.waitRetrieval) {
+    run.paused = true;
+    run.waitRetrieval = ck.waitRetrieval != 0;
+    run.pausedAt = monoMs();
+  }
+
+  long outageS = -1;
+  if (ck.epoch && rtcOk && !rtcLostPowerOrInvalid) {
+    uint32_t nowEpoch = rtc.now().unixtime();
+    if (nowEpoch >= ck.epoch) outageS = (long)(nowEpoch - ck.epoch);
+  }
+  emitUiEvent(F("run_resume"), (int16_t)min(outageS, 32767L), (int16_t)min(ck.currentStep, (uint16_t)32767));
+  Serial.print(F("RESUME ")); Serial.print(ck.expFile); Serial.print(F(" step ")); Serial.print(ck.currentStep);
+  Serial.print(F(" outage_s ")); Serial.println(outageS);
+  saveCheckpoint();
+  return true;
+}
+
 // ===== Buttons =====
-void handleButtons(StepData &st) {
-  bool eU = edge(bU), eD = edge(bD), eO = edge(bO), eB = edge(bB);
+// UP/DOWN step on press and keep stepping while held; OK/BACK act on press only
+void handleButtonEvent(const BtnEvent &ev, StepData &st) {
+  bool nav = ev.kind == BTN_PRESS || ev.kind == BTN_LONG || ev.kind == BTN_REPEAT;
+  bool eU = nav && ev.button == BTN_UP, eD = nav && ev.button == BTN_DOWN;
+  bool eO = ev.kind == BTN_PRESS && ev.button == BTN_OK;
+  bool eB = ev.kind == BTN_PRESS && ev.button == BTN_BACK;
   if (screen == SCREEN_MENU) {
-    if (eU && pressed(bU)) { menuIndex = (menuIndex + NITEMS - 1) % NITEMS; showMenu(); }
-    if (eD && pressed(bD)) { menuIndex = (menuIndex + 1) % NITEMS; showMenu(); }
-    if (eO && pressed(bO)) {
+    if (eU) { menuIndex = (menuIndex + NITEMS - 1) % NITEMS; showMenu(); }
+    if (eD) { menuIndex = (menuIndex + 1) % NITEMS; showMenu(); }
+    if (eO) {
       if (menuIndex == 0) { scanExperimentFiles(); expFileIndex = 0; screen = SCREEN_EXP_LIST; showExpList(); }
       else if (menuIndex == 1) { intFileIndex = 0; screen = SCREEN_INT_LIST; showIntList(); }
       else if (menuIndex == 2 && !run.active) { serviceIndex = 0; screen = SCREEN_SERVICE_MENU; showServiceMenu(); }
       else if (menuIndex == 3 && !run.active) { loadTimeSetFromRtc(); screen = SCREEN_TIME_SET; showTimeSet(); }
     }
   } else if (screen == SCREEN_EXP_LIST) {
-    if (sdFileCount == 0) { if (eB && pressed(bB)) { screen = SCREEN_MENU; showMenu(); } return; }
-    if (eU && pressed(bU)) { expFileIndex = (expFileIndex + sdFileCount - 1) % sdFileCount; showExpList(); }
-    if (eD && pressed(bD)) { expFileIndex = (expFileIndex + 1) % sdFileCount; showExpList(); }
-    if (eO && pressed(bO)) {
+    if (sdFileCount == 0) { if (eB) { screen = SCREEN_MENU; showMenu(); } return; }
+    if (eU) { expFileIndex = (expFileIndex + sdFileCount - 1) % sdFileCount; showExpList(); }
+    if (eD) { expFileIndex = (expFileIndex + 1) % sdFileCount; showExpList(); }
+    if (eO) {
       bool ok = loadExperiment(expFiles[expFileIndex]);
       if (ok) {
         screen = SCREEN_RUNNING;
         if (!startExperiment()) {
-          lcd.clear(); print16(0, 0, "Falha abrir"); delay(700);
+          lcd.clear(); print16(0, 0, F("Falha abrir")); delay(700);
           screen = SCREEN_MENU; showMenu();
         }
       } else {
-        lcd.clear(); print16(0, 0, "Falha exp"); delay(700); showExpList();
+        lcd.clear(); print16(0, 0, F("Falha exp")); delay(700); showExpList();
       }
     }
-    if (eB && pressed(bB)) { screen = SCREEN_MENU; showMenu(); }
+    if (eB) { screen = SCREEN_MENU; showMenu(); }
   } else if (screen == SCREEN_INT_LIST) {
-    if (INTERNAL_COUNT == 0) { if (eB && pressed(bB)) { screen = SCREEN_MENU; showMenu(); } return; }
-    if (eU && pressed(bU)) { intFileIndex = (intFileIndex + INTERNAL_COUNT - 1) % INTERNAL_COUNT; showIntList(); }
-    if (eD && pressed(bD)) { intFileIndex = (intFileIndex + 1) % INTERNAL_COUNT; showIntList(); }
-    if (eO && pressed(bO)) {
+    if (INTERNAL_COUNT == 0) { if (eB) { screen = SCREEN_MENU; showMenu(); } return; }
+    if (eU) { intFileIndex = (intFileIndex + INTERNAL_COUNT - 1) % INTERNAL_COUNT; showIntList(); }
+    if (eD) { intFileIndex = (intFileIndex + 1) % INTERNAL_COUNT; showIntList(); }
+    if (eO) {
       if (loadExperimentInternal(intFileIndex)) {
         screen = SCREEN_RUNNING;
         if (!startExperiment()) {
-          lcd.clear(); print16(0, 0, "Falha abrir"); delay(700);
+          lcd.clear(); print16(0, 0, F("Falha abrir")); delay(700);
           screen = SCREEN_MENU; showMenu();
         }
       } else {
-        lcd.clear(); print16(0, 0, "Falha exp"); delay(700); showIntList();
+        lcd.clear(); print16(0, 0, F("Falha exp")); delay(700); showIntList();
       }
     }
-    if (eB && pressed(bB)) { screen = SCREEN_MENU; showMenu(); }
+    if (eB) { screen = SCREEN_MENU; showMenu(); }
   } else if (screen == SCREEN_SERVICE_MENU) {
-    if (eU && pressed(bU)) { serviceIndex = (serviceIndex + NSERVICE - 1) % NSERVICE; showServiceMenu(); }
-    if (eD && pressed(bD)) { serviceIndex = (serviceIndex + 1) % NSERVICE; showServiceMenu(); }
-    if (eO && pressed(bO)) {
+    if (eU) { serviceIndex = (serviceIndex + NSERVICE - 1) % NSERVICE; showServiceMenu(); }
+    if (eD) { serviceIndex = (serviceIndex + 1) % NSERVICE; showServiceMenu(); }
+    if (eO) {
       if (serviceIndex == 0) {
         sensorCfgPage = false;
         screen = SCREEN_SENSOR_TEST;
@@ -2166,46 +5665,46 @@ void handleButtons(StepData &st) {
       } else if (serviceIndex == 4) {
         loadThermoConfigChain();
         lcd.clear();
-        print16(0, 0, "CFG recarregado");
-        print16(0, 1, "                ");
+        print16(0, 0, F("CFG recarregado"));
+        print16(0, 1, F("                "));
         delay(700);
         showServiceMenu();
       }
     }
-    if (eB && pressed(bB)) { screen = SCREEN_MENU; showMenu(); }
+    if (eB) { screen = SCREEN_MENU; showMenu(); }
   } else if (screen == SCREEN_SENSOR_TEST) {
-    if (eO && pressed(bO)) {
+    if (eO) {
       sensorCfgPage = !sensorCfgPage;
       showSensorTest(sensorCfgPage);
     }
-    if (eB && pressed(bB)) { screen = SCREEN_SERVICE_MENU; showServiceMenu(); }
+    if (eB) { screen = SCREEN_SERVICE_MENU; showServiceMenu(); }
   } else if (screen == SCREEN_RELAY_TEST) {
-    if (eU && pressed(bU)) { relayTestSelected = (relayTestSelected + 3) % 4; showRelayTest(); }
-    if (eD && pressed(bD)) { relayTestSelected = (relayTestSelected + 1) % 4; showRelayTest(); }
-    if (eO && pressed(bO)) {
+    if (eU) { relayTestSelected = (relayTestSelected + 3) % 4; showRelayTest(); }
+    if (eD) { relayTestSelected = (relayTestSelected + 1) % 4; showRelayTest(); }
+    if (eO) {
       relayTestMask ^= (1 << relayTestSelected);
       applyRelayMask(relayTestMask);
       showRelayTest();
     }
-    if (eB && pressed(bB)) {
+    if (eB) {
       relayTestMask = 0;
       applyRelayMask(0);
       screen = SCREEN_SERVICE_MENU;
       showServiceMenu();
     }
   } else if (screen == SCREEN_WIFI_STATUS) {
-    if (eO && pressed(bO)) {
+    if (eO) {
       forceNetReconnect();
-      emitUiEvent("wifi_test", 0, 0);
+      emitUiEvent(F("wifi_test"), 0, 0);
       showWifiStatus();
     }
-    if (eU && pressed(bU)) showWifiStatus();
-    if (eD && pressed(bD)) showWifiStatus();
-    if (eB && pressed(bB)) { screen = SCREEN_SERVICE_MENU; showServiceMenu(); }
+    if (eU) showWifiStatus();
+    if (eD) showWifiStatus();
+    if (eB) { screen = SCREEN_SERVICE_MENU; showServiceMenu(); }
   } else if (screen == SCREEN_CONFIG_MENU) {
-    if (eU && pressed(bU)) { configIndex = (configIndex + NCONFIG - 1) % NCONFIG; showConfigMenu(); }
-    if (eD && pressed(bD)) { configIndex = (configIndex + 1) % NCONFIG; showConfigMenu(); }
-    if (eO && pressed(bO)) {
+    if (eU) { configIndex = (configIndex + NCONFIG - 1) % NCONFIG; showConfigMenu(); }
+    if (eD) { configIndex = (configIndex + 1) % NCONFIG; showConfigMenu(); }
+    if (eO) {
       if (configIndex == 0) {
         heaterIntervalEdit = thermoCfg.minOnSec;
         if (heaterIntervalEdit < 1) heaterIntervalEdit = 1;
@@ -2214,100 +5713,175 @@ void handleButtons(StepData &st) {
         showHeaterIntervalConfig();
       }
     }
-    if (eB && pressed(bB)) { screen = SCREEN_SERVICE_MENU; showServiceMenu(); }
+    if (eB) { screen = SCREEN_SERVICE_MENU; showServiceMenu(); }
   } else if (screen == SCREEN_CONFIG_HEATER_INTERVAL) {
-    if (eU && pressed(bU)) { if (heaterIntervalEdit < 600) heaterIntervalEdit++; showHeaterIntervalConfig(); }
-    if (eD && pressed(bD)) { if (heaterIntervalEdit > 1) heaterIntervalEdit--; showHeaterIntervalConfig(); }
-    if (eO && pressed(bO)) {
+    if (eU) { if (heaterIntervalEdit < 600) heaterIntervalEdit++; showHeaterIntervalConfig(); }
+    if (eD) { if (heaterIntervalEdit > 1) heaterIntervalEdit--; showHeaterIntervalConfig(); }
+    if (eO) {
       thermoCfg.minOnSec = heaterIntervalEdit;
       thermoCfg.minOffSec = heaterIntervalEdit;
       saveThermoToEeprom();
       lcd.clear();
-      print16(0, 0, "Intervalo salvo");
-      print16(0, 1, "                ");
+      print16(0, 0, F("Intervalo salvo"));
+      print16(0, 1, F("                "));
       delay(700);
       screen = SCREEN_CONFIG_MENU;
       showConfigMenu();
     }
-    if (eB && pressed(bB)) { screen = SCREEN_CONFIG_MENU; showConfigMenu(); }
+    if (eB) { screen = SCREEN_CONFIG_MENU; showConfigMenu(); }
   } else if (screen == SCREEN_TIME_SET) {
     if (!rtcOk) {
-      if (eB && pressed(bB)) { screen = SCREEN_MENU; showMenu(); }
+      if (eB) { screen = SCREEN_MENU; showMenu(); }
       return;
     }
-    if (eU && pressed(bU)) { adjustTimeField(+1); showTimeSet(); }
-    if (eD && pressed(bD)) { adjustTimeField(-1); showTimeSet(); }
-    if (eO && pressed(bO)) {
+    if (eU) { adjustTimeField(+1); showTimeSet(); }
+    if (eD) { adjustTimeField(-1); showTimeSet(); }
+    if (eO) {
       if (timeSet.field < 5) {
         timeSet.field++;
         showTimeSet();
       } else {
         if (saveTimeSetToRtc()) {
-          emitUiEvent("time_set", timeSet.hour, timeSet.minute);
+          emitUiEvent(F("time_set"), timeSet.hour, timeSet.minute);
           lcd.clear();
-          print16(0, 0, "Hora salva");
-          print16(0, 1, "                ");
+          print16(0, 0, F("Hora salva"));
+          print16(0, 1, F("                "));
           delay(700);
         } else {
           lcd.clear();
-          print16(0, 0, "Falha RTC");
-          print16(0, 1, "                ");
+          print16(0, 0, F("Falha RTC"));
+          print16(0, 1, F("                "));
           delay(700);
         }
         screen = SCREEN_MENU;
         showMenu();
       }
     }
-    if (eB && pressed(bB)) { screen = SCREEN_MENU; showMenu(); }
+    if (eB) { screen = SCREEN_MENU; showMenu(); }
   } else if (screen == SCREEN_RUNNING) {
-    if (eB && pressed(bB)) {
+    if (eB) {
       screen = SCREEN_CONFIRM_STOP;
       lcd.clear();
-      print16(0, 0, "Parar experim?");
-      print16(0, 1, "OK=Sim Back=Nao");
+      print16(0, 0, F("Parar experim?"));
+      print16(0, 1, F("OK=Sim Back=Nao"));
     }
-    if (eO && pressed(bO)) {
+    if (eO) {
       run.paused = !run.paused;
-      if (run.paused) run.pausedAt = millis();
-      else run.totalPauseMs += millis() - run.pausedAt;
+      if (run.paused) run.pausedAt = monoMs();
+      else run.totalPauseMs += monoMs() - run.pausedAt;
+      ckptDirty = true;
     }
   } else if (screen == SCREEN_CONFIRM_STOP) {
-    if (eO && pressed(bO)) { stopExperiment("Stop"); screen = SCREEN_MENU; showMenu(); }
-    if (eB && pressed(bB)) { screen = SCREEN_RUNNING; }
+    if (eO) { stopExperiment("Stop"); screen = SCREEN_MENU; showMenu(); }
+    if (eB) { screen = SCREEN_RUNNING; }
   } else if (screen == SCREEN_RETRIEVAL) {
-    if (eO && pressed(bO)) {
+    if (eO) {
       run.waitRetrieval = false;
       run.paused = false;
       run.retrievalIndex++;
-      run.totalPauseMs += millis() - run.pausedAt;
+      run.totalPauseMs += monoMs() - run.pausedAt;
+      ckptDirty = true;
       screen = SCREEN_RUNNING;
     }
-    if (eB && pressed(bB)) { stopExperiment("Stop"); screen = SCREEN_MENU; showMenu(); }
+    if (eB) { stopExperiment("Stop"); screen = SCREEN_MENU; showMenu(); }
+  }
+}
+
+void handleButtons(StepData &st) {
+  BtnEvent ev;
+  while (btnEvents.pop(ev)) {
+    if ((uint16_t)((uint16_t)millis() - ev.ms) > BTN_STALE_MS) continue;
+    handleButtonEvent(ev, st);
+  }
+}
+
+// ===== Boot =====
+// Only pins, LCD and UARTs are set up in setup(); the slow parts run one stage per
+// loop pass so the relays are safe and the menu is live within a few milliseconds.
+enum BootStage { BOOT_RTC, BOOT_SD, BOOT_CONFIG, BOOT_HEALTH, BOOT_RESUME, BOOT_NET, BOOT_DONE };
+const char BOOT_STAGE_NAMES[BOOT_DONE][7] PROGMEM = {"rtc", "sd", "config", "health", "resume", "net"};
+
+PGM_P bootStageName(uint8_t stage) {
+  return BOOT_STAGE_NAMES[stage < BOOT_DONE ? stage : BOOT_RTC];
+}
+uint8_t bootStage = BOOT_RTC;
+uint16_t bootStageMs[BOOT_DONE];
+unsigned long bootSetupMs = 0;
+
+bool bootConfigLoaded() {
+  return bootStage > BOOT_CONFIG;
+}
+
+void bootReport() {
+  Serial.print(F("BOOT setup_ms ")); Serial.print(bootSetupMs);
+  for (uint8_t i = 0; i < BOOT_DONE; i++) {
+    Serial.print(' '); Serial.print((const __FlashStringHelper *)bootStageName(i)); Serial.print('='); Serial.print(bootStageMs[i]);
+  }
+  Serial.print(F(" total_ms ")); Serial.println(millis());
+  Serial.println(F("CFG commands ready (type: CFG SHOW)"));
+}
+
+void bootTick() {
+  if (bootStage >= BOOT_DONE) return;
+  unsigned long t0 = millis();
+  switch (bootStage) {
+    case BOOT_RTC:
+      Wire.begin();
+      rtcOk = rtc.begin();
+      rtcLostPowerOrInvalid = rtcOk ? !rtc.isrunning() : true;
+      break;
+    case BOOT_SD:
+      sdProfilesLoad();
+      if (initSD()) setSdState(SD_READY);
+      else setSdState(SD_UNAVAILABLE);
+      lastSdAttemptMs = millis();
+      if (sdOk) scanExperimentFiles();
+      break;
+    case BOOT_CONFIG:
+      loadThermoConfigChain();
+      break;
+    case BOOT_HEALTH:
+      healthBootReport();
+      spillScan();
+      break;
+    case BOOT_RESUME:
+      if (!run.active && resumeFromCheckpoint()) {
+        lcd.clear();
+        if (run.waitRetrieval) {
+          print16(0, 0, F("Retirada"));
+          print16(0, 1, F("OK=Sim Back=Nao"));
+          screen = SCREEN_RETRIEVAL;
+        } else {
+          screen = SCREEN_RUNNING;
+        }
+      } else if (screen == SCREEN_MENU) {
+        showMenu();
+      }
+      break;
+    case BOOT_NET:
+      if (cloudCfg.enabled && cloudConfigValid()) forceNetReconnect();
+      break;
   }
+  unsigned long dt = millis() - t0;
+  bootStageMs[bootStage] = (uint16_t)min(dt, 65535UL);
+  bootStage++;
+  if (bootStage == BOOT_DONE) bootReport();
 }
 
 // ===== Setup/Loop =====
 void setup() {
-  Serial.begin(115200);
-  pinMode(BTN_UP, INPUT_PULLUP);
-  pinMode(BTN_DOWN, INPUT_PULLUP);
-  pinMode(BTN_OK, INPUT_PULLUP);
-  pinMode(BTN_BACK, INPUT_PULLUP);
-  for (byte i = 0; i < 4; i++) pinMode(RELAY_PINS[i], OUTPUT);
+  wdEarlyInit();
+  stackPaint();
+  monoBegin();
+  // Relays first: latch the off level before the pins become outputs
+  applyRelayMask(0);
+  Relays::output();
   applyRelayMask(0);
+  Serial.begin(115200);
+  buttonsBegin();
 
   lcd.begin(16, 2);
   lcd.clear();
-  print16(0, 0, "Init SD...     ");
-  print16(0, 1, "                ");
-  Wire.begin();
-  rtcOk = rtc.begin();
-  rtcLostPowerOrInvalid = rtcOk ? !rtc.isrunning() : true;
-  if (initSD()) setSdState(SD_READY);
-  else setSdState(SD_UNAVAILABLE);
-  lastSdAttemptMs = millis();
-  loadThermoConfigChain();
-  lcd.clear();
   showMenu();
 
   if (DHT_USE_PULLUP) {
@@ -2316,13 +5890,12 @@ void setup() {
   }
   dht1.begin();
   dht2.begin();
-  delay(1000); // allow DHT22s to stabilize before first read
-  readSensors();
+  dhtWarmStartMs = millis();
 
   Serial1.begin(115200); // ESP8266 AT
   clearEspRxWindow();
-  if (cloudCfg.enabled && cloudConfigValid()) forceNetReconnect();
-  Serial.println(F("CFG commands ready (type: CFG SHOW)"));
+  bootSetupMs = millis();
+  wdStart();
 }
 
 void loop() {
@@ -2330,7 +5903,10 @@ void loop() {
   static unsigned long lastSensorScreenMs = 0;
   static unsigned long lastWifiScreenMs = 0;
 
-  if (!run.active && (screen == SCREEN_MENU || screen == SCREEN_EXP_LIST || screen == SCREEN_SERVICE_MENU)) {
+  wdPat();
+  wdRecoverTick();
+
+  if (bootStage > BOOT_SD && !run.active && (screen == SCREEN_MENU || screen == SCREEN_EXP_LIST || screen == SCREEN_SERVICE_MENU)) {
     bool prev = sdOk;
     checkSD();
     if (sdOk != prev) {
@@ -2350,11 +5926,20 @@ void loop() {
     sdReconnectNotice = false;
   }
 
-  processSerialCommands();
+  wdMark(WD_BOOT);
+  bootTick();
+  wdMark(WD_SERIAL);
+  if (bootConfigLoaded()) processSerialCommands(); // a CFG SAVE before the load would store defaults
+  dumpTick();
+  wdMark(WD_NET);
+  rtcAnchorTick();
   wifiAtManager();
+  sntpTick();
   cloudUploaderTick();
 
+  wdMark(WD_UI);
   handleButtons(currentStep);
+  wdMark(WD_SENSORS);
   readSensors();
 
   if (screen == SCREEN_SENSOR_TEST && millis() - lastSensorScreenMs > 1000UL) {
@@ -2366,23 +5951,46 @@ void loop() {
     showWifiStatus();
   }
 
-  if ((run.active && currentSource == SRC_SD) || logCount > 0) {
+  wdMark(WD_LOG);
+  spillWriteTick();
+  if ((run.active && currentSource == SRC_SD) || !logQueue.empty() || spillCount > 0 || spillStaged) {
     if (ensureSdReady(false)) {
       if (sdState != SD_READY) setSdState(SD_READY);
     }
     processLogFlush();
   }
+  arcTick();
+  journalTick();
+
+  wdMark(WD_RUN);
+  if (resumeStepPending && run.active) {
+    // Re-enter the step that was running at the checkpoint; its deadline is restored
+    resumeStepPending = false;
+    currentStep = stepCache[stepCacheIndex - 1];
+    uint16_t unitMs = meta.stepUnitMs ? meta.stepUnitMs : (uint16_t)STEP_UNIT_MS_DEFAULT;
+    stepDurationMs = (uint64_t)currentStep.seconds * unitMs;
+    stepStartMs = monoMs();
+    stepActive = true;
+    applyRelayMask(currentStep.mask);
+    journalStepBegin(run.currentStep, currentStep.mask, stepDurationMs);
+  }
+  checkpointTick();
+  ckptWriteTick();
 
   if (screen == SCREEN_RUNNING && run.active && !run.paused) {
     if (!stepActive) {
       if (readNextStep(currentStep)) {
         stepActive = true;
         stepDone = false;
-        stepStartMs = millis();
+        stepStartMs = monoMs();
         uint16_t unitMs = meta.stepUnitMs ? meta.stepUnitMs : (uint16_t)STEP_UNIT_MS_DEFAULT;
-        stepDurationMs = (unsigned long)currentStep.seconds * unitMs;
+        stepDurationMs = (uint64_t)currentStep.seconds * unitMs;
+        noteStepSkew(runElapsedMs(), stepPlanEndMs);
+        stepPlanEndMs += stepDurationMs;
         run.currentStep++;
         applyRelayMask(currentStep.mask);
+        journalStepBegin(run.currentStep, currentStep.mask, stepDurationMs);
+        ckptDirty = true;
       } else {
         if (run.currentStep < run.stepCount) {
           stopExperiment("SD falha");
@@ -2394,22 +6002,23 @@ void loop() {
         }
       }
     } else {
-      if (millis() - stepStartMs >= stepDurationMs) {
+      if (runElapsedMs() >= stepPlanEndMs) {
         stepActive = false;
       }
     }
 
     // retrieval pause
     if (meta.intervalMin > 0 && meta.retrievals > 0 && !run.waitRetrieval) {
-      unsigned long expMs = millis() - run.expStartMs - run.totalPauseMs;
-      unsigned long nextStop = (unsigned long)(run.retrievalIndex + 1) * meta.intervalMin * 60000UL;
+      uint64_t expMs = runElapsedMs();
+      uint64_t nextStop = (uint64_t)(run.retrievalIndex + 1) * meta.intervalMin * 60000ULL;
       if (expMs >= nextStop && run.retrievalIndex < meta.retrievals) {
         run.waitRetrieval = true;
         run.paused = true;
-        run.pausedAt = millis();
+        run.pausedAt = monoMs();
+        ckptDirty = true;
         lcd.clear();
-        print16(0, 0, "Retirada");
-        print16(0, 1, "OK=Sim Back=Nao");
+        print16(0, 0, F("Retirada"));
+        print16(0, 1, F("OK=Sim Back=Nao"));
         screen = SCREEN_RETRIEVAL;
       }
     }
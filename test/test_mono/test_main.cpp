@@ -0,0 +1,102 @@
+// Host tests for MonoClock, the wrap carry behind monoMs()/monoUs().
+//   pio test -e native
+#include <unity.h>
+
+#include "MonoClock.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Feeds both views from one simulated 64-bit microsecond time, carrying every
+// Timer0 cycle (1024 us) as the compare ISR does, and reading in between.
+struct Sim {
+  uint64_t us;
+  MonoClock ms;
+  MonoClock usClock;
+  uint64_t msBase;  // true ms and us where the clocks started (high words 0)
+  uint64_t usBase;
+
+  explicit Sim(uint64_t startUs) : us(startUs) {
+    msBase = (startUs / 1000) & 0xFFFFFFFF00000000ULL;
+    usBase = startUs & 0xFFFFFFFF00000000ULL;
+    isr();
+  }
+  uint32_t millisNow() const { return (uint32_t)(us / 1000); }
+  uint32_t microsNow() const { return (uint32_t)us; }
+  void isr() {
+    ms.carry(millisNow());
+    usClock.carry(microsNow());
+  }
+  void check() {
+    TEST_ASSERT_EQUAL_UINT64(us / 1000 - msBase, ms.read(millisNow()));
+    TEST_ASSERT_EQUAL_UINT64(us - usBase, usClock.read(microsNow()));
+  }
+};
+
+void test_carry_across_ms_wrap() {
+  MonoClock c;
+  c.carry(0xFFFFFF00UL);
+  TEST_ASSERT_EQUAL_UINT64(0xFFFFFFFFULL, c.read(0xFFFFFFFFUL));
+  c.carry(0xFFFFFFFFUL);
+  TEST_ASSERT_EQUAL_UINT64(0x100000000ULL, c.read(0));
+  c.carry(0);
+  TEST_ASSERT_EQUAL_UINT64(0x100000005ULL, c.read(5));
+}
+
+// A wrap after the last carry is still counted by read(), and not twice once carried
+void test_read_before_next_carry() {
+  MonoClock c;
+  c.carry(0xFFFFFFF0UL);
+  TEST_ASSERT_EQUAL_UINT64(0x100000010ULL, c.read(0x10));
+  c.carry(0x10);
+  TEST_ASSERT_EQUAL_UINT64(0x100000010ULL, c.read(0x10));
+  TEST_ASSERT_EQUAL_UINT64(0x100000400ULL, c.read(0x400));
+}
+
+void test_several_wraps() {
+  MonoClock c;
+  uint64_t t = 0;
+  for (int i = 0; i < 3 * 256; i++) {
+    t += 0x01000000ULL;  // 256 carries per wrap
+    c.carry((uint32_t)t);
+    TEST_ASSERT_EQUAL_UINT64(t, c.read((uint32_t)t));
+  }
+  TEST_ASSERT_EQUAL_UINT64(3ULL << 32, c.read(0));
+}
+
+// micros() wraps every ~71.6 min: cross it with both views running
+void test_us_view_across_wrap() {
+  Sim s(0xFFFFFFFFULL - 5000);
+  uint64_t last = 0;
+  for (int i = 0; i < 40; i++) {
+    s.us += 1024;
+    s.check();  // read before the ISR, as loop() may
+    s.isr();
+    uint64_t now = s.usClock.read(s.microsNow());
+    TEST_ASSERT_TRUE(now > last);
+    last = now;
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)(last >> 32));
+}
+
+// millis() wraps after ~49.7 days; micros() has wrapped ~1000 times by then
+void test_ms_view_across_wrap() {
+  Sim s(0xFFFFFFF0ULL * 1000);
+  for (int i = 0; i < 40; i++) {
+    s.us += 1024;
+    s.check();
+    s.isr();
+    s.check();
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)(s.ms.read(s.millisNow()) >> 32));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_carry_across_ms_wrap);
+  RUN_TEST(test_read_before_next_carry);
+  RUN_TEST(test_several_wraps);
+  RUN_TEST(test_us_view_across_wrap);
+  RUN_TEST(test_ms_view_across_wrap);
+  return UNITY_END();
+}
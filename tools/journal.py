@@ -0,0 +1,151 @@
+"""Decode the chamber's JOURNAL.BIN and rebuild per-run CSV files from it.
+
+  python tools/journal.py dump   E:/JOURNAL.BIN [--from-seq N]
+  python tools/journal.py export E:/JOURNAL.BIN -o out/
+
+`export` writes RUNxx.CSV in the firmware's log format plus JOURNAL_EVENTS.CSV with
+events, step summaries, health snapshots and run markers. Damaged bytes are skipped.
+"""
+import argparse
+import os
+import struct
+from typing import Any, Dict, Iterator, Tuple
+
+# Mirrors the JOURNAL_* constants and J* payloads in src/test_mega_13012026.cpp
+SYNC = 0xA5
+HDR = struct.Struct("<BBBI")
+PAYLOAD_MAX = 40
+SAMPLE = struct.Struct("<IIIHH6hBB10s")
+EVENT = struct.Struct("<IIhhHH15sB")
+STEP = struct.Struct("<IIIHHHhhBB")
+HEALTH = struct.Struct("<II6HBBBB")
+RUN = struct.Struct("<IIHBB")
+RUN_KINDS = {0: "start", 1: "stop", 2: "done"}
+CSV_HEADER = "ms;T1;U1;T2;U2;Tavg;Uavg;mask;step;epoch\n"
+
+
+def crc8(data: bytes) -> int:
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def cstr(raw: bytes) -> str:
+    return raw.split(b"\0", 1)[0].decode("ascii", "replace")
+
+
+def run_file(run_no: int) -> str:
+    return f"RUN{run_no:02d}.CSV" if run_no else ""
+
+
+def decode(kind: int, p: bytes) -> Dict[str, Any]:
+    if kind == 1:
+        line, ms, epoch, run_no, ems, t1, h1, t2, h2, ta, ha, mask, heater, step = SAMPLE.unpack(p)
+        return dict(type="sample", run_file=run_file(run_no), line_index=line, ms=ms, epoch=epoch, ems=ems,
+                    t1_10=t1, u1_10=h1, t2_10=t2, u2_10=h2, tavg_10=ta, uavg_10=ha, mask=mask, heater=heater,
+                    step=cstr(step))
+    if kind == 2:
+        ms, epoch, a0, a1, run_no, step, etype, screen = EVENT.unpack(p)
+        return dict(type="event", event_type=cstr(etype), ms=ms, epoch=epoch, arg0=a0, arg1=a1,
+                    run_file=run_file(run_no), current_step=step, screen=screen)
+    if kind == 3:
+        epoch, planned, actual, run_no, idx, samples, ta, ha, mask, heater = STEP.unpack(p)
+        return dict(type="step", epoch=epoch, run_file=run_file(run_no), step_index=idx, mask=mask,
+                    planned_ms=planned, actual_ms=actual, samples=samples, tavg_10=ta, uavg_10=ha, heater_pct=heater)
+    if kind == 4:
+        epoch, up, free, boots, wdt, drops, dropped, walks, sd, net, spill, _ = HEALTH.unpack(p)
+        return dict(type="health", epoch=epoch, uptime_s=up, free_min=free, boots=boots, wdt_resets=wdt,
+                    net_drops=drops, log_dropped=dropped, sd_walks=walks, sd_state=sd, net_state=net, spill=spill)
+    lines, epoch, run_no, kind_run, _ = RUN.unpack(p)
+    return dict(type="run", run_file=run_file(run_no), kind=RUN_KINDS.get(kind_run, str(kind_run)),
+                lines=lines, epoch=epoch)
+
+
+PAYLOAD_SIZES = {1: SAMPLE.size, 2: EVENT.size, 3: STEP.size, 4: HEALTH.size, 5: RUN.size}
+
+
+def frames(data: bytes) -> Iterator[Tuple[int, int, Dict[str, Any]]]:
+    """Yields (offset, seq, record); resyncs on the next sync byte after damage."""
+    pos = 0
+    while pos + HDR.size <= len(data):
+        sync, kind, length, seq = HDR.unpack_from(data, pos)
+        end = pos + HDR.size + length
+        if (sync != SYNC or length > PAYLOAD_MAX or PAYLOAD_SIZES.get(kind) != length
+                or end >= len(data) or crc8(data[pos + 1:end]) != data[end]):
+            pos += 1
+            continue
+        yield pos, seq, decode(kind, data[pos + HDR.size:end])
+        pos = end + 1
+
+
+def scaled10(v: int) -> str:
+    return f"{'-' if v < 0 else ''}{abs(v) // 10}.{abs(v) % 10}"
+
+
+def epoch_text(epoch: int, ems: int) -> str:
+    return f"{epoch}.{ems:03d}" if epoch else "0"
+
+
+def cmd_dump(args) -> None:
+    with open(args.journal, "rb") as f:
+        data = f.read()
+    for off, seq, rec in frames(data):
+        if seq >= args.from_seq:
+            fields = " ".join(f"{k}={v}" for k, v in rec.items() if k != "type")
+            print(f"{seq:8d} @{off:<8d} {rec['type']:<7} {fields}")
+
+
+def cmd_export(args) -> None:
+    with open(args.journal, "rb") as f:
+        data = f.read()
+    os.makedirs(args.out, exist_ok=True)
+    runs: Dict[str, Any] = {}
+    rows = 0
+    with open(os.path.join(args.out, "JOURNAL_EVENTS.CSV"), "w", newline="") as evf:
+        evf.write("seq;type;epoch;run_file;name;arg0;arg1;detail\n")
+        for _, seq, r in frames(data):
+            if r["type"] == "sample":
+                name = r["run_file"] or "RUN00.CSV"
+                out = runs.get(name)
+                if out is None:
+                    out = runs[name] = open(os.path.join(args.out, name), "w", newline="")
+                    out.write(CSV_HEADER)
+                out.write(";".join([
+                    str(r["ms"]), scaled10(r["t1_10"]), scaled10(r["u1_10"]), scaled10(r["t2_10"]),
+                    scaled10(r["u2_10"]), scaled10(r["tavg_10"]), scaled10(r["uavg_10"]), str(r["mask"]),
+                    r["step"], epoch_text(r["epoch"], r["ems"])]) + "\n")
+                rows += 1
+                continue
+            name = r.get("event_type") or r.get("kind") or ""
+            detail = ",".join(f"{k}={v}" for k, v in r.items()
+                              if k not in ("type", "epoch", "run_file", "event_type", "arg0", "arg1"))
+            evf.write(f"{seq};{r['type']};{r.get('epoch', 0)};{r.get('run_file', '')};{name};"
+                      f"{r.get('arg0', '')};{r.get('arg1', '')};{detail}\n")
+    for out in runs.values():
+        out.close()
+    print(f"{rows} samples in {len(runs)} run files -> {args.out}")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("dump", help="print every record")
+    p.add_argument("journal")
+    p.add_argument("--from-seq", type=int, default=0)
+    p.set_defaults(fn=cmd_dump)
+
+    p = sub.add_parser("export", help="rebuild RUNxx.CSV files and an event list")
+    p.add_argument("journal")
+    p.add_argument("-o", "--out", default=".")
+    p.set_defaults(fn=cmd_export)
+
+    args = ap.parse_args()
+    args.fn(args)
+
+
+if __name__ == "__main__":
+    main()
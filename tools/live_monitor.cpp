@@ -0,0 +1,177 @@
+// Shows and records the chamber's live binary stream (CFG STREAM) from the USB port.
+//
+//   g++ -O2 -o live_monitor tools/live_monitor.cpp
+//   live_monitor /dev/ttyACM0 [-o live.csv] [--baud 500000] [--quiet]
+//
+// Turns the stream on, prints one line per frame (sensor read or relay change) and
+// appends it to the CSV with the host receive time; Ctrl+C turns the stream off
+// again. Firmware text output is echoed to stderr with a "# " prefix.
+#include <csignal>
+#include <ctime>
+
+#include "serial_port.h"
+
+// Mirrors LiveFrame and the LIVE_* constants in src/test_mega_13012026.cpp
+static const uint8_t SOF = 0xD6;
+static const size_t PAYLOAD = 28;
+static const size_t FRAME = 4 + PAYLOAD + 2;
+static const int16_t LIVE_NAN = INT16_MIN;
+
+struct Live {
+  uint8_t kind;
+  uint16_t seq;
+  uint32_t ms, epoch;
+  int16_t v[6];  // t1 h1 t2 h2 tavg havg, x10
+  uint16_t step;
+  uint8_t mask, heater, flags;
+  int16_t slope100;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+static uint16_t u16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t u32(const uint8_t *p) { return u16(p) | (uint32_t)u16(p + 2) << 16; }
+
+static Live decode(const uint8_t *f) {
+  Live l;
+  l.kind = f[1];
+  l.seq = u16(f + 2);
+  const uint8_t *p = f + 4;
+  l.ms = u32(p);
+  l.epoch = u32(p + 4);
+  for (int i = 0; i < 6; i++) l.v[i] = (int16_t)u16(p + 8 + 2 * i);
+  l.step = u16(p + 20);
+  l.mask = p[22];
+  l.heater = p[23];
+  l.flags = p[24];
+  l.slope100 = (int16_t)u16(p + 26);
+  return l;
+}
+
+static std::string scaled(int v, int div) {
+  if (v == LIVE_NAN) return "nan";
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%s%d.%0*d", v < 0 ? "-" : "", abs(v) / div, div == 100 ? 2 : 1, abs(v) % div);
+  return buf;
+}
+
+static long long hostMs() {
+#ifdef _WIN32
+  FILETIME ft;
+  GetSystemTimeAsFileTime(&ft);
+  return (long long)((((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime) / 10000ULL - 11644473600000ULL);
+#else
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+#endif
+}
+
+int main(int argc, char **argv) {
+  const char *portName = nullptr, *outPath = nullptr;
+  long baud = DEFAULT_BAUD;
+  bool quiet = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) outPath = argv[++i];
+    else if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--quiet")) quiet = true;
+    else if (!portName) portName = argv[i];
+    else portName = nullptr, i = argc;
+  }
+  if (!portName) {
+    fprintf(stderr, "usage: live_monitor <port> [-o out.csv] [--baud N] [--quiet]\n");
+    return 2;
+  }
+
+  Port port;
+  if (!port.open(portName)) die(strerror(errno));
+  if (!port.setBaud(DEFAULT_BAUD)) die("cannot configure port");
+  Reader rd(port);
+  port.drain();
+  bool fast = baud != DEFAULT_BAUD;
+  if (fast && !setDeviceBaud(port, rd, baud)) die("device refused the baud rate");
+
+  FILE *csv = nullptr;
+  if (outPath) {
+    csv = fopen(outPath, "ab");
+    if (!csv) die(strerror(errno));
+    fseek(csv, 0, SEEK_END);
+    if (ftell(csv) == 0) fprintf(csv, "host_ms;seq;kind;ms;epoch;T1;U1;T2;U2;Tavg;Uavg;mask;heater;step;flags;slope\n");
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  port.write("CFG STREAM ON\n");
+
+  uint8_t f[FRAME];
+  std::string text;
+  unsigned long frames = 0, lost = 0, bad = 0;
+  bool haveSeq = false;
+  uint16_t nextSeq = 0;
+  long lastData = nowMs(), lastKeepalive = nowMs();
+  while (!stopRequested) {
+    if (fast && nowMs() - lastKeepalive > 30000) {
+      port.write("\n");  // the device drops back to 115200 after two minutes without input
+      lastKeepalive = nowMs();
+    }
+    uint8_t b;
+    if (!rd.byte(b, 200)) {
+      if (nowMs() - lastData > 10000) {
+        fprintf(stderr, "# no data for 10 s\n");
+        lastData = nowMs();
+      }
+      continue;
+    }
+    lastData = nowMs();
+    if (b != SOF) {  // firmware text between frames
+      if (b == '\n') {
+        if (!text.empty()) fprintf(stderr, "# %s\n", text.c_str());
+        text.clear();
+      } else if (b != '\r') {
+        text.push_back((char)b);
+      }
+      continue;
+    }
+    f[0] = b;
+    bool ok = true;
+    for (size_t i = 1; i < FRAME && ok; i++) ok = rd.byte(f[i], 1000);
+    if (!ok) break;
+    uint16_t crc = 0;
+    for (size_t i = 1; i < FRAME - 2; i++) crc = crc16Xmodem(crc, f[i]);
+    if (crc != u16(f + FRAME - 2)) {
+      bad++;
+      continue;
+    }
+    Live l = decode(f);
+    if (haveSeq && l.seq != nextSeq) lost += (uint16_t)(l.seq - nextSeq);
+    haveSeq = true;
+    nextSeq = (uint16_t)(l.seq + 1);
+    frames++;
+
+    long long host = hostMs();
+    const char *kind = l.kind == 2 ? "relay" : "sample";
+    if (!quiet) {
+      printf("%6u %-6s ms=%lu T1=%s U1=%s T2=%s U2=%s Tavg=%s Uavg=%s mask=%u heater=%u step=%u%s slope=%s\n",
+             l.seq, kind, (unsigned long)l.ms, scaled(l.v[0], 10).c_str(), scaled(l.v[1], 10).c_str(),
+             scaled(l.v[2], 10).c_str(), scaled(l.v[3], 10).c_str(), scaled(l.v[4], 10).c_str(),
+             scaled(l.v[5], 10).c_str(), l.mask, l.heater, l.step, (l.flags & 0x02) ? " paused" : "",
+             scaled(l.slope100, 100).c_str());
+      fflush(stdout);
+    }
+    if (csv) {
+      fprintf(csv, "%lld;%u;%s;%lu;%lu;%s;%s;%s;%s;%s;%s;%u;%u;%u;%u;%s\n", host, l.seq, kind, (unsigned long)l.ms,
+              (unsigned long)l.epoch, scaled(l.v[0], 10).c_str(), scaled(l.v[1], 10).c_str(), scaled(l.v[2], 10).c_str(),
+              scaled(l.v[3], 10).c_str(), scaled(l.v[4], 10).c_str(), scaled(l.v[5], 10).c_str(), l.mask, l.heater,
+              l.step, l.flags, scaled(l.slope100, 100).c_str());
+      fflush(csv);
+    }
+  }
+
+  port.write("CFG STREAM OFF\n");
+  if (fast && !setDeviceBaud(port, rd, DEFAULT_BAUD)) fprintf(stderr, "note: device stays at %ld baud for a while\n", baud);
+  if (csv) fclose(csv);
+  fprintf(stderr, "%lu frames, %lu lost, %lu bad\n", frames, lost, bad);
+  return 0;
+}
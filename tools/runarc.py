@@ -0,0 +1,181 @@
+"""Extract runs from the chamber's SD archive (RUNS.ARC + RUNS.IDX).
+
+  python tools/runarc.py list   E:/RUNS.IDX
+  python tools/runarc.py extract E:/RUNS.ARC E:/RUNS.IDX RUN05.CSV -o RUN05.CSV
+  python tools/runarc.py rebuild E:/RUNS.ARC -o RUNS.IDX
+  python tools/runarc.py fetch  COM5 3 -o RUN05.CSV      (needs pyserial)
+
+Runs are selected by index number or by name (the newest copy of that name).
+"""
+import argparse
+import struct
+import sys
+import time
+import zlib
+from typing import List, NamedTuple, Optional
+
+# Mirrors ArchiveEntry in src/test_mega_13012026.cpp
+ENTRY = struct.Struct("<13sBH5I")
+ARC_MAGIC = 0xA7
+
+
+class Entry(NamedTuple):
+    name: str
+    offset: int
+    length: int
+    crc: int
+    lines: int
+    epoch: int
+
+
+def unpack_entry(raw: bytes) -> Optional[Entry]:
+    name, magic, _, offset, length, crc, lines, epoch = ENTRY.unpack(raw)
+    if magic != ARC_MAGIC:
+        return None
+    return Entry(name.split(b"\0", 1)[0].decode("ascii", "replace"), offset, length, crc, lines, epoch)
+
+
+def pack_entry(e: Entry) -> bytes:
+    return ENTRY.pack(e.name.encode("ascii"), ARC_MAGIC, 0, e.offset, e.length, e.crc, e.lines, e.epoch)
+
+
+def read_index(path: str) -> List[Optional[Entry]]:
+    """Entries by record number; None for the zero filler the device writes after a
+    record torn by a reset (and for a torn last record)."""
+    with open(path, "rb") as f:
+        data = f.read()
+    out: List[Optional[Entry]] = []
+    for pos in range(0, len(data) - ENTRY.size + 1, ENTRY.size):
+        e = unpack_entry(data[pos:pos + ENTRY.size])
+        if e is None and any(data[pos:pos + ENTRY.size]):
+            print(f"{path}: skipping bad record {pos // ENTRY.size}", file=sys.stderr)
+        out.append(e)
+    return out
+
+
+def rebuild_index(arc_path: str) -> List[Entry]:
+    """Walks the trailer copies backwards from the end of the archive.
+
+    A trailer is an entry whose run ends right where it starts. Bytes that are not
+    one (a store cut short by a reset, at the end or between runs) are stepped over
+    a byte at a time, so the runs before them are still found."""
+    with open(arc_path, "rb") as f:
+        data = f.read()
+    out = []
+    end = len(data)
+    while end >= ENTRY.size:
+        e = unpack_entry(data[end - ENTRY.size:end])
+        if e is not None and e.offset + e.length == end - ENTRY.size:
+            out.append(e)
+            end = e.offset
+        else:
+            end -= 1
+    out.reverse()
+    return out
+
+
+def select(entries: List[Optional[Entry]], which: str) -> int:
+    if which.isdigit():
+        i = int(which)
+        if i < len(entries) and entries[i] is not None:
+            return i
+    else:
+        for i in range(len(entries) - 1, -1, -1):
+            if entries[i] is not None and entries[i].name.upper() == which.upper():
+                return i
+    raise SystemExit(f"run not found: {which}")
+
+
+def cmd_list(args) -> None:
+    entries = rebuild_index(args.file) if args.file.upper().endswith(".ARC") else read_index(args.file)
+    for i, e in enumerate(entries):
+        if e is None:
+            continue
+        when = time.strftime("%Y-%m-%d %H:%M", time.gmtime(e.epoch)) if e.epoch else "-"
+        print(f"{i:4d} {e.name:<12} off={e.offset} len={e.length} lines={e.lines} crc={e.crc:08X} {when}")
+
+
+def cmd_extract(args) -> None:
+    entries = read_index(args.idx) if args.idx else rebuild_index(args.arc)
+    e = entries[select(entries, args.run)]
+    with open(args.arc, "rb") as f:
+        f.seek(e.offset)
+        data = f.read(e.length)
+    if len(data) != e.length or zlib.crc32(data) != e.crc:
+        raise SystemExit(f"{e.name}: CRC mismatch, archive damaged")
+    with open(args.out or e.name, "wb") as f:
+        f.write(data)
+    print(f"{e.name}: {e.length} bytes, {e.lines} lines")
+
+
+def cmd_rebuild(args) -> None:
+    entries = rebuild_index(args.arc)
+    with open(args.out, "wb") as f:
+        for e in entries:
+            f.write(pack_entry(e))
+    print(f"{len(entries)} runs indexed")
+
+
+def cmd_fetch(args) -> None:
+    """Asks the device for one run (CFG ARC GET) and checks it against the announced CRC."""
+    import serial  # pyserial
+
+    with serial.Serial(args.port, args.baud, timeout=args.timeout) as port:
+        port.reset_input_buffer()
+        port.write(f"CFG ARC GET {args.run}\n".encode("ascii"))
+        while True:
+            line = port.readline()
+            if not line:
+                raise SystemExit("no answer from device")
+            text = line.decode("ascii", "replace").strip()
+            if text.startswith("ARC BEGIN "):
+                break
+            if text.startswith("ARC GET failed"):
+                raise SystemExit(text)
+        _, _, index, name, length, crc = text.split()
+        length = int(length)
+        data = port.read(length)
+        tail = port.readline() + port.readline()
+    if len(data) != length or zlib.crc32(data) != int(crc, 16):
+        raise SystemExit(f"{name}: transfer incomplete or corrupted")
+    if b"OK" not in tail:
+        print(f"warning: device reported {tail.decode('ascii', 'replace').strip()}", file=sys.stderr)
+    with open(args.out or name, "wb") as f:
+        f.write(data)
+    print(f"{name} (#{index}): {length} bytes")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("list", help="list archived runs from RUNS.IDX (or RUNS.ARC trailers)")
+    p.add_argument("file")
+    p.set_defaults(fn=cmd_list)
+
+    p = sub.add_parser("extract", help="copy one run out of RUNS.ARC")
+    p.add_argument("arc")
+    p.add_argument("idx", nargs="?", help="omit to use the trailers in RUNS.ARC")
+    p.add_argument("run", help="index number or RUNxx.CSV")
+    p.add_argument("-o", "--out")
+    p.set_defaults(fn=cmd_extract)
+
+    p = sub.add_parser("rebuild", help="write a fresh RUNS.IDX from RUNS.ARC")
+    p.add_argument("arc")
+    p.add_argument("-o", "--out", default="RUNS.IDX")
+    p.set_defaults(fn=cmd_rebuild)
+
+    p = sub.add_parser("fetch", help="pull one run over the USB serial port")
+    p.add_argument("port")
+    p.add_argument("run", help="index number or RUNxx.CSV")
+    p.add_argument("-o", "--out")
+    p.add_argument("--baud", type=int, default=115200)
+    p.add_argument("--timeout", type=float, default=10.0)
+    p.set_defaults(fn=cmd_fetch)
+
+    args = ap.parse_args()
+    args.fn(args)
+
+
+if __name__ == "__main__":
+    main()
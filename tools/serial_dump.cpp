@@ -0,0 +1,171 @@
+// Pulls one file off the chamber's SD card over USB serial (CFG DUMP) and checks it.
+//
+//   g++ -O2 -o serial_dump tools/serial_dump.cpp
+//   serial_dump /dev/ttyACM0 RUN05.CSV [-o RUN05.CSV] [--baud 500000]
+//   serial_dump COM5 LIST
+//
+// Frames: 0xD5 | len | offset (u32 LE) | data[len] | crc16 XMODEM over len..data.
+// An existing local copy is resumed: its complete lines are kept and the device is
+// asked to start after them; a partial last line is dropped. Every frame is checked
+// for its CRC and offset, and the CRC-32 and byte count in "DUMP END" against what
+// arrived in this session.
+#include <vector>
+
+#include "serial_port.h"
+
+static const uint8_t SOF = 0xD5;
+static const size_t HDR = 6;
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t *p, size_t n) {
+  while (n--) {
+    crc ^= *p++;
+    for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320UL & (0U - (crc & 1)));
+  }
+  return crc;
+}
+
+// ===== Transfer =====
+struct Resume {
+  unsigned long lines = 0;
+  long keep = 0;  // bytes up to and including the last newline
+};
+
+static Resume scanLocal(const std::string &path) {
+  Resume r;
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) return r;
+  long pos = 0;
+  int c;
+  while ((c = fgetc(f)) != EOF) {
+    pos++;
+    if (c == '\n') {
+      r.lines++;
+      r.keep = pos;
+    }
+  }
+  fclose(f);
+  return r;
+}
+
+static int listFiles(Port &port, Reader &rd) {
+  std::string line;
+  port.write("CFG DUMP LIST\n");
+  while (rd.line(line, 3000)) {
+    if (line == "FILE END") return 0;
+    if (line.compare(0, 5, "FILE ") == 0) printf("%s\n", line.c_str() + 5);
+  }
+  die("no answer from device");
+  return 1;
+}
+
+static int dumpFile(Port &port, Reader &rd, const std::string &name, const std::string &outPath) {
+  Resume res = scanLocal(outPath);
+  std::string cmd = "CFG DUMP " + name;
+  if (res.lines) cmd += " " + std::to_string(res.lines);
+  port.write(cmd + "\n");
+
+  std::string line;
+  if (!rd.waitFor(line, "DUMP BEGIN ", "DUMP ERR", 10000)) die("no answer from device");
+  if (line.compare(0, 8, "DUMP ERR") == 0) die(line.c_str());
+  char devName[16] = {};
+  unsigned long size = 0, start = 0, lines = 0;
+  if (sscanf(line.c_str(), "DUMP BEGIN %15s %lu %lu %lu", devName, &size, &start, &lines) != 4) die("bad DUMP BEGIN");
+  if (lines != res.lines) die("device has fewer lines than the local copy; delete it and retry");
+
+  std::vector<uint8_t> kept(res.keep);
+  if (res.keep) {
+    FILE *in = fopen(outPath.c_str(), "rb");
+    if (!in || fread(kept.data(), 1, kept.size(), in) != kept.size()) die("cannot read the local copy");
+    fclose(in);
+  }
+  FILE *out = fopen(outPath.c_str(), "wb");
+  if (!out) die(strerror(errno));
+  fwrite(kept.data(), 1, kept.size(), out);
+  if (start != (unsigned long)res.keep) fprintf(stderr, "note: local copy ends at %ld, device at %lu\n", res.keep, start);
+
+  uint32_t crc = 0xFFFFFFFFUL;
+  unsigned long expect = start, bad = 0;
+  long t0 = nowMs(), lastReport = t0;
+  std::vector<uint8_t> frame(HDR + 255 + 2);
+  std::string text;
+  while (true) {
+    uint8_t b;
+    if (!rd.byte(b, 5000)) die("timed out; run again to resume");
+    if (b != SOF) {  // text lines from the firmware land between frames
+      if (b != '\n') {
+        if (b != '\r') text.push_back((char)b);
+      } else if (text.compare(0, 8, "DUMP ERR") == 0) {
+        die(text.c_str());
+      } else {
+        text.clear();
+      }
+      continue;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < HDR - 1 && ok; i++) ok = rd.byte(frame[1 + i], 5000);
+    if (!ok) die("timed out; run again to resume");
+    uint8_t len = frame[1];
+    uint32_t offset = frame[2] | (uint32_t)frame[3] << 8 | (uint32_t)frame[4] << 16 | (uint32_t)frame[5] << 24;
+    if (offset != expect) {  // not a frame start after all, or one went missing
+      bad++;
+      continue;
+    }
+    for (size_t i = 0; i < (size_t)len + 2 && ok; i++) ok = rd.byte(frame[HDR + i], 5000);
+    if (!ok) die("timed out; run again to resume");
+    uint16_t c = 0;
+    for (size_t i = 1; i < HDR + len; i++) c = crc16Xmodem(c, frame[i]);
+    if (c != (uint16_t)(frame[HDR + len] | frame[HDR + len + 1] << 8)) die("frame CRC error; run again to resume");
+    if (len == 0) break;
+    fwrite(&frame[HDR], 1, len, out);
+    crc = crc32Update(crc, &frame[HDR], len);
+    expect += len;
+    if (nowMs() - lastReport > 1000) {
+      lastReport = nowMs();
+      fprintf(stderr, "\r%lu/%lu bytes", expect, size);
+    }
+  }
+  fflush(out);
+  fclose(out);
+
+  if (!rd.waitFor(line, "DUMP END ", "DUMP ERR", 5000)) die("missing DUMP END");
+  if (line.compare(0, 8, "DUMP ERR") == 0) die(line.c_str());
+  unsigned long devCrc = 0, devBytes = 0;
+  sscanf(line.c_str(), "DUMP END %lx %lu", &devCrc, &devBytes);
+  uint32_t got = crc ^ 0xFFFFFFFFUL;
+  if (expect != size || devBytes != expect - start || devCrc != got) die("file check failed");
+  double secs = (nowMs() - t0) / 1000.0;
+  fprintf(stderr, "\r%s: %lu bytes (%lu new) in %.1f s, %.0f B/s, crc %08X OK%s\n", devName, expect, expect - start,
+          secs, secs > 0 ? (expect - start) / secs : 0.0, got, bad ? ", resynced" : "");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *portName = nullptr, *file = nullptr, *outPath = nullptr;
+  long baud = DEFAULT_BAUD;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) outPath = argv[++i];
+    else if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atol(argv[++i]);
+    else if (!portName) portName = argv[i];
+    else if (!file) file = argv[i];
+    else file = nullptr, portName = nullptr, i = argc;
+  }
+  if (!portName || !file) {
+    fprintf(stderr, "usage: serial_dump <port> <file|LIST> [-o out] [--baud N]\n");
+    return 2;
+  }
+
+  Port port;
+  if (!port.open(portName)) die(strerror(errno));
+  if (!port.setBaud(DEFAULT_BAUD)) die("cannot configure port");
+  Reader rd(port);
+  port.drain();
+
+  bool fast = baud != DEFAULT_BAUD;
+  if (fast && !setDeviceBaud(port, rd, baud)) die("device refused the baud rate");
+  int rc = !strcmp(file, "LIST") ? listFiles(port, rd) : dumpFile(port, rd, file, outPath ? outPath : file);
+  if (fast) {
+    // Back to the default so the serial monitor works; the firmware also falls back on its own
+    if (!setDeviceBaud(port, rd, DEFAULT_BAUD)) fprintf(stderr, "note: device stays at %ld baud for a while\n", baud);
+  }
+  return rc;
+}
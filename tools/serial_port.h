@@ -0,0 +1,192 @@
+#pragma once
+// Serial port access shared by the host tools (serial_dump, live_monitor):
+// raw 8N1 without flow control, DTR left alone so opening the port does not
+// reset the board again, and 100 ms read timeouts.
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+const long DEFAULT_BAUD = 115200;
+
+inline uint16_t crc16Xmodem(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (int i = 0; i < 8; i++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  return crc;
+}
+
+inline long nowMs() {
+#ifdef _WIN32
+  return (long)GetTickCount();
+#else
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return tv.tv_sec * 1000L + tv.tv_usec / 1000;
+#endif
+}
+
+inline void die(const char *msg) {
+  fprintf(stderr, "error: %s\n", msg);
+  exit(1);
+}
+
+// ===== Port =====
+class Port {
+public:
+  bool open(const char *name) {
+#ifdef _WIN32
+    std::string path = std::string("\\\\.\\") + name;
+    h_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    return h_ != INVALID_HANDLE_VALUE;
+#else
+    fd_ = ::open(name, O_RDWR | O_NOCTTY);
+    return fd_ >= 0;
+#endif
+  }
+
+  bool setBaud(long baud) {
+#ifdef _WIN32
+    DCB dcb = {};
+    dcb.DCBlength = sizeof(dcb);
+    if (!GetCommState(h_, &dcb)) return false;
+    dcb.BaudRate = (DWORD)baud;
+    dcb.ByteSize = 8;
+    dcb.Parity = NOPARITY;
+    dcb.StopBits = ONESTOPBIT;
+    dcb.fDtrControl = DTR_CONTROL_DISABLE;  // DTR toggles reset the Mega
+    if (!SetCommState(h_, &dcb)) return false;
+    COMMTIMEOUTS to = {};
+    to.ReadIntervalTimeout = MAXDWORD;
+    to.ReadTotalTimeoutMultiplier = MAXDWORD;
+    to.ReadTotalTimeoutConstant = 100;
+    return SetCommTimeouts(h_, &to) != 0;
+#else
+    termios t;
+    if (tcgetattr(fd_, &t) != 0) return false;
+    cfmakeraw(&t);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cflag &= ~(CRTSCTS | HUPCL);  // no DTR drop (and so no reset) on close
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 1;
+    speed_t s;
+    switch (baud) {
+      case 9600: s = B9600; break;
+      case 19200: s = B19200; break;
+      case 38400: s = B38400; break;
+      case 57600: s = B57600; break;
+      case 115200: s = B115200; break;
+      case 230400: s = B230400; break;
+#ifdef B500000
+      case 500000: s = B500000; break;
+#endif
+#ifdef B1000000
+      case 1000000: s = B1000000; break;
+#endif
+      default: return false;
+    }
+    cfsetispeed(&t, s);
+    cfsetospeed(&t, s);
+    return tcsetattr(fd_, TCSADRAIN, &t) == 0;
+#endif
+  }
+
+  // Up to n bytes; 0 after about 100 ms without data
+  size_t read(uint8_t *buf, size_t n) {
+#ifdef _WIN32
+    DWORD got = 0;
+    if (!ReadFile(h_, buf, (DWORD)n, &got, nullptr)) return 0;
+    return got;
+#else
+    ssize_t got = ::read(fd_, buf, n);
+    return got > 0 ? (size_t)got : 0;
+#endif
+  }
+
+  void write(const std::string &s) {
+#ifdef _WIN32
+    DWORD done = 0;
+    WriteFile(h_, s.data(), (DWORD)s.size(), &done, nullptr);
+    FlushFileBuffers(h_);
+#else
+    if (::write(fd_, s.data(), s.size()) != (ssize_t)s.size()) die("write failed");
+    tcdrain(fd_);
+#endif
+  }
+
+  void drain() {
+    uint8_t junk[256];
+    while (read(junk, sizeof(junk)) > 0) {}
+  }
+
+private:
+#ifdef _WIN32
+  HANDLE h_ = INVALID_HANDLE_VALUE;
+#else
+  int fd_ = -1;
+#endif
+};
+
+// Byte stream over the port with line reads and a deadline per call
+class Reader {
+public:
+  explicit Reader(Port &p) : port_(p) {}
+
+  bool byte(uint8_t &b, long timeoutMs) {
+    long t0 = nowMs();
+    while (pos_ == len_) {
+      len_ = port_.read(buf_, sizeof(buf_));
+      pos_ = 0;
+      if (len_ == 0 && nowMs() - t0 > timeoutMs) return false;
+    }
+    b = buf_[pos_++];
+    return true;
+  }
+
+  bool line(std::string &out, long timeoutMs) {
+    out.clear();
+    uint8_t b;
+    while (byte(b, timeoutMs)) {
+      if (b == '\n') return true;
+      if (b != '\r') out.push_back((char)b);
+    }
+    return false;
+  }
+
+  // Skips lines until one starts with one of the prefixes
+  bool waitFor(std::string &out, const char *a, const char *b, long timeoutMs) {
+    long t0 = nowMs();
+    while (nowMs() - t0 < timeoutMs) {
+      if (!line(out, timeoutMs)) return false;
+      if (out.compare(0, strlen(a), a) == 0 || (b && out.compare(0, strlen(b), b) == 0)) return true;
+    }
+    return false;
+  }
+
+private:
+  Port &port_;
+  uint8_t buf_[4096];
+  size_t pos_ = 0, len_ = 0;
+};
+
+// CFG BAUD: the reply comes at the old rate, then both sides switch
+inline bool setDeviceBaud(Port &port, Reader &rd, long baud) {
+  std::string line;
+  port.write("CFG BAUD " + std::to_string(baud) + "\n");
+  if (!rd.waitFor(line, "BAUD ", nullptr, 3000)) return false;
+  if (line.find(' ') == std::string::npos || atol(line.c_str() + 5) != baud) {
+    fprintf(stderr, "device: %s\n", line.c_str());
+    return false;
+  }
+  return port.setBaud(baud);
+}